@@ -16,6 +16,7 @@
 #include "config.hpp"
 
 #include "clock.hpp"
+#include "log.hpp"
 #include "midi.hpp"
 #include "midi/midi_in.hpp"
 #include "music_theory.hpp"
@@ -94,7 +95,7 @@ class arpeggiator : public clock::follow<arpeggiator> {
 
   /// Start or stop the sequencer
   void run(bool is_running) {
-    std::cerr << "Run " << is_running << std::endl;
+    MUSYCL_LOG_DEBUG("Run {}", is_running);
 
     if (running && !is_running)
       // If the sequencer is going to stop, stop the current note
@@ -104,7 +105,7 @@ class arpeggiator : public clock::follow<arpeggiator> {
 
   /// Stop current note
   void stop_current_note() {
-    std::cerr << "STOP " << running << std::endl;
+    MUSYCL_LOG_DEBUG("STOP {}", running);
     if (current_note) {
       midi_in::insert(0, current_note->as_off());
       current_note.reset();
@@ -147,7 +148,7 @@ class arpeggiator : public clock::follow<arpeggiator> {
           n.velocity = 127;
         arp.current_note = n;
         midi_in::insert(0, n);
-        std::cout << "Insert " << n << std::endl;
+        MUSYCL_LOG_DEBUG("Insert {}", n);
         ++arp.note_index;
       }
     }
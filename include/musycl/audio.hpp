@@ -20,6 +20,8 @@
 #include "rtaudio/RtAudio.h"
 
 #include "musycl/config.hpp"
+#include "musycl/log.hpp"
+#include "musycl/trace.hpp"
 
 namespace musycl {
 
@@ -133,8 +135,10 @@ class audio {
                                    double time_stamp,
                                    RtAudioStreamStatus status,
                                    void* /* user_data */) {
-    if (status)
-      std::cerr << "Stream underflow detected!" << std::endl;
+    if (status) {
+      MUSYCL_TRACE_MARK("audio underflow");
+      MUSYCL_LOG_WARNING("Stream underflow detected!");
+    }
     assert(rtaudio_frame_size == frame_size &&
            "frame_size needs to be the same as the one used by RtAudio");
     // Copy 1 ready frame to the output
@@ -194,15 +198,16 @@ class audio {
   /// The sycl::pipe::write-like interface to write a MIDI message
   template <typename MusyclAudioSample>
   static inline void write(MusyclAudioSample&& s) {
+    MUSYCL_TRACE_SCOPE("audio::write");
     // Check that the output lands in the authorized values
     auto min = ranges::min(
         ranges::views::transform(s, [](auto e) { return ranges::min(e); }));
     auto max = ranges::max(
         ranges::views::transform(s, [](auto e) { return ranges::max(e); }));
     if (min < -1)
-      std::cerr << "Min saturation detected: " << min;
+      MUSYCL_LOG_WARNING("Min saturation detected: {}", min);
     if (max > 1)
-      std::cerr << "Max saturation detected: " << max;
+      MUSYCL_LOG_WARNING("Max saturation detected: {}", max);
 
     output_frames.push(std::forward<MusyclAudioSample>(s));
   }
@@ -0,0 +1,64 @@
+#ifndef MUSYCL_BACKEND_HPP
+#define MUSYCL_BACKEND_HPP
+
+/** \file Select at run time where the audio goes
+
+    An audio backend receives the computed audio frames and gives the
+    time of each new frame, which paces the computation.
+*/
+
+#include <utility>
+#include <variant>
+
+#include "musycl/audio.hpp"
+#include "musycl/backend/file.hpp"
+#include "musycl/backend/midi_loopback.hpp"
+#include "musycl/backend/null.hpp"
+#include "musycl/backend/pacing.hpp"
+#include "musycl/backend/rtaudio.hpp"
+#include "musycl/backend/rtmidi.hpp"
+#include "musycl/trace.hpp"
+
+namespace musycl {
+
+/// One of the audio backends, chosen at run time
+class audio_backend {
+  using backend_t =
+      std::variant<backend::rtaudio, backend::null_sink, backend::file_sink>;
+
+  /// The actual backend
+  backend_t b;
+
+ public:
+  /** Create the backend in place
+
+      For example
+      \code
+      musycl::audio_backend b { std::in_place_type<backend::null_sink>,
+                                backend::pacing::maximum_speed };
+      \endcode
+  */
+  template <typename Backend, typename... Args>
+  audio_backend(std::in_place_type_t<Backend> t, Args&&... args)
+      : b { t, std::forward<Args>(args)... } {}
+
+  /// Hand over a computed audio frame
+  void write(const audio::frame& a) {
+    MUSYCL_TRACE_SCOPE("audio_backend::write");
+    std::visit([&](auto& e) { e.write(a); }, b);
+  }
+
+  /// The time of the next audio frame to compute
+  midi_in::clock_type::time_point frame_time() {
+    return std::visit([](auto& e) { return e.frame_time(); }, b);
+  }
+
+  /// Finalize the output
+  void close() {
+    std::visit([](auto& e) { e.close(); }, b);
+  }
+};
+
+} // namespace musycl
+
+#endif // MUSYCL_BACKEND_HPP
@@ -0,0 +1,55 @@
+#ifndef MUSYCL_BACKEND_FILE_HPP
+#define MUSYCL_BACKEND_FILE_HPP
+
+/** \file An audio backend writing the audio into a WAV file
+*/
+
+#include <cstdint>
+#include <string>
+
+#include "musycl/audio.hpp"
+#include "musycl/backend/pacing.hpp"
+#include "musycl/wav.hpp"
+
+namespace musycl::backend {
+
+/// Write the audio frames into a WAV file, clocked by itself
+class file_sink {
+  /// The output file
+  wav::writer wav;
+
+  /// Clock the frames
+  frame_pacer pacer;
+
+ public:
+  /** Create a WAV file
+
+      \param[in] file_name is the path of the file to write
+
+      \param[in] p is the pacing, by default as fast as possible
+
+      \throw std::runtime_error if the file cannot be created
+  */
+  file_sink(const std::string& file_name, pacing p = pacing::maximum_speed)
+      : wav { file_name, audio::channel_number }
+      , pacer { p } {}
+
+  /// Append an audio frame to the file
+  void write(const audio::frame& audio) { wav.write_samples(audio); }
+
+  /// The time of the next audio frame to compute
+  auto frame_time() { return pacer.frame_time(); }
+
+  /// Number of frames computed so far
+  std::uint64_t frame_count() const { return pacer.frame_count(); }
+
+  /// Finalize the file and display the computation speed
+  void close() {
+    wav.close();
+    pacer.display_speed();
+  }
+};
+
+} // namespace musycl::backend
+
+#endif // MUSYCL_BACKEND_FILE_HPP
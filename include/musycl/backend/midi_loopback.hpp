@@ -0,0 +1,109 @@
+#ifndef MUSYCL_BACKEND_MIDI_LOOPBACK_HPP
+#define MUSYCL_BACKEND_MIDI_LOOPBACK_HPP
+
+/** \file A MIDI backend connecting the MIDI input and output inside
+    the process, to run without any MIDI device
+*/
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <span>
+
+#include "musycl/midi.hpp"
+#include "musycl/midi/midi_in.hpp"
+#include "musycl/midi/midi_out.hpp"
+#include "musycl/mpsc_queue.hpp"
+
+namespace musycl::backend {
+
+/** In-process MIDI source and sink replacing the MIDI devices
+
+    The messages sent to the loopback are received by musycl::midi_in
+    as if they came from a device. The messages written to
+    musycl::midi_out are captured to be received from the loopback
+    and can also be routed back to a musycl::midi_in port.
+
+    There can be only 1 instance at a time since the MIDI interfaces
+    are global.
+*/
+class midi_loopback {
+ public:
+  /// A message written to musycl::midi_out
+  struct output_msg {
+    /// The output port
+    std::int8_t port;
+    /// The message
+    midi::msg m;
+  };
+
+ private:
+  /// The parser of the byte stream sent to each input port
+  std::array<midi::parser, midi_in::max_ports> input_parsers;
+
+  /// The parser of the byte stream written to each output port
+  std::array<midi::parser, midi_in::max_ports> output_parsers;
+
+  /// The captured output messages
+  mpsc_queue<output_msg> output { 1024 };
+
+  /// The input port where the output is routed, -1 if none
+  int echo_port;
+
+  /// Receive the output bytes from the sending thread of musycl::midi_out
+  void capture(std::int8_t port, std::span<const std::uint8_t> bytes) {
+    output_parsers.at(port).parse(bytes, [&](const midi::msg& m) {
+      output.try_push({ port, m });
+      if (echo_port >= 0)
+        midi_in::inject(echo_port, m);
+    });
+  }
+
+ public:
+  /** Capture the MIDI output
+
+      \param[in] echo_port is the musycl::midi_in port receiving what
+      is written to musycl::midi_out, or -1 to only capture it
+  */
+  midi_loopback(int echo_port = -1)
+      : echo_port { echo_port } {
+    assert(echo_port < midi_in::max_ports);
+    midi_out {}.open([this](auto port, auto bytes) { capture(port, bytes); });
+  }
+
+  midi_loopback(const midi_loopback&) = delete;
+  midi_loopback& operator=(const midi_loopback&) = delete;
+
+  /// Stop capturing the MIDI output
+  ~midi_loopback() { midi_out::close(); }
+
+  /** Send a message as if it was received from a MIDI device, from
+      any thread
+
+      \return false if the message has been dropped by a full queue
+  */
+  bool send(std::int8_t port, const midi::msg& m) {
+    return midi_in::inject(port, m);
+  }
+
+  /** Send a MIDI byte stream as if it was received from a MIDI
+      device, only from 1 thread per port */
+  void send(std::int8_t port, std::span<const std::uint8_t> bytes) {
+    input_parsers.at(port).parse(
+        bytes, [&](const midi::msg& m) { midi_in::inject(port, m); });
+  }
+
+  /** Receive a message written to musycl::midi_out, from only 1
+      consumer thread
+
+      \return false if there is no message
+  */
+  bool try_receive(output_msg& m) { return output.try_pop(m); }
+
+  /// The number of output messages dropped because they were not received
+  std::uint64_t overflow_count() const { return output.overflow_count(); }
+};
+
+} // namespace musycl::backend
+
+#endif // MUSYCL_BACKEND_MIDI_LOOPBACK_HPP
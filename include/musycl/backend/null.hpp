@@ -0,0 +1,40 @@
+#ifndef MUSYCL_BACKEND_NULL_HPP
+#define MUSYCL_BACKEND_NULL_HPP
+
+/** \file An audio backend discarding the audio, to run without any
+    sound server
+*/
+
+#include <cstdint>
+
+#include "musycl/audio.hpp"
+#include "musycl/backend/pacing.hpp"
+
+namespace musycl::backend {
+
+/// Discard the audio frames, clocked by itself
+class null_sink {
+  /// Clock the frames
+  frame_pacer pacer;
+
+ public:
+  /// Create a sink running at the real-time pace or at the maximum speed
+  null_sink(pacing p = pacing::real_time)
+      : pacer { p } {}
+
+  /// Ignore an audio frame
+  void write(const audio::frame&) {}
+
+  /// The time of the next audio frame to compute
+  auto frame_time() { return pacer.frame_time(); }
+
+  /// Number of frames computed so far
+  std::uint64_t frame_count() const { return pacer.frame_count(); }
+
+  /// Display the computation speed
+  void close() { pacer.display_speed(); }
+};
+
+} // namespace musycl::backend
+
+#endif // MUSYCL_BACKEND_NULL_HPP
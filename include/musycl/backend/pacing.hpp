@@ -0,0 +1,78 @@
+#ifndef MUSYCL_BACKEND_PACING_HPP
+#define MUSYCL_BACKEND_PACING_HPP
+
+/** \file Clock the audio frames when there is no audio device to do it
+*/
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+
+#include "musycl/config.hpp"
+
+#include "musycl/midi/midi_in.hpp"
+
+namespace musycl::backend {
+
+/// How the audio frames are clocked without an audio device
+enum class pacing {
+  /// At the pace of the wall clock, like with an audio device
+  real_time,
+  /// As fast as the CPU allows, in a virtual time
+  maximum_speed
+};
+
+/** Compute the time of each audio frame, waiting for it or not
+    according to the pacing
+
+    With the maximum speed pacing, musycl::midi_in is switched to the
+    virtual time so the inserted MIDI messages follow the frames.
+*/
+class frame_pacer {
+  using clock_type = midi_in::clock_type;
+
+  /// The pacing used
+  pacing mode;
+
+  /// The wall clock time of the first frame
+  clock_type::time_point start = clock_type::now();
+
+  /// Number of frames started so far
+  std::uint64_t frames = 0;
+
+ public:
+  frame_pacer(pacing p)
+      : mode { p } {
+    if (mode == pacing::maximum_speed)
+      midi_in::set_virtual_time(true);
+  }
+
+  /** The time of the next frame, 1 frame period after the previous
+      one, waiting for it with the real-time pacing */
+  clock_type::time_point frame_time() {
+    auto t = start + std::chrono::duration_cast<clock_type::duration>(
+                         std::chrono::duration<double> { frames++ *
+                                                         frame_period });
+    if (mode == pacing::real_time)
+      std::this_thread::sleep_until(t);
+    return t;
+  }
+
+  /// Number of frames started so far
+  std::uint64_t frame_count() const { return frames; }
+
+  /// Display the audio time computed compared to the wall clock time
+  void display_speed() const {
+    auto audio_time = frames * frame_period;
+    auto wall_time =
+        std::chrono::duration<double> { clock_type::now() - start }.count();
+    std::cout << "Computed " << audio_time << " s of audio in " << wall_time
+              << " s, " << audio_time / wall_time << " times real time"
+              << std::endl;
+  }
+};
+
+} // namespace musycl::backend
+
+#endif // MUSYCL_BACKEND_PACING_HPP
@@ -0,0 +1,45 @@
+#ifndef MUSYCL_BACKEND_RTAUDIO_HPP
+#define MUSYCL_BACKEND_RTAUDIO_HPP
+
+/** \file An audio backend playing on an audio device through RtAudio
+*/
+
+#include <string>
+
+#include "rtaudio/RtAudio.h"
+
+#include "musycl/audio.hpp"
+#include "musycl/midi/midi_in.hpp"
+
+namespace musycl::backend {
+
+/// Play the audio frames on the default output device, which paces them
+class rtaudio {
+  /// The audio interface
+  audio audio_interface;
+
+ public:
+  /** Open the audio output
+
+      \param[in] application_name is the name of the client, also
+      used as the stream name
+
+      \param[in] api is the RtAudio API to use, such as
+      RtAudio::UNIX_JACK or RtAudio::LINUX_ALSA
+  */
+  rtaudio(const std::string& application_name, RtAudio::Api api) {
+    audio_interface.open(application_name, "output", application_name, api);
+  }
+
+  /// Send an audio frame to the output, blocking while it is full
+  void write(const audio::frame& a) { audio::write(a); }
+
+  /// The frames are computed right now
+  auto frame_time() { return midi_in::clock_type::now(); }
+
+  void close() {}
+};
+
+} // namespace musycl::backend
+
+#endif // MUSYCL_BACKEND_RTAUDIO_HPP
@@ -0,0 +1,40 @@
+#ifndef MUSYCL_BACKEND_RTMIDI_HPP
+#define MUSYCL_BACKEND_RTMIDI_HPP
+
+/** \file A MIDI backend using the MIDI devices through RtMidi
+*/
+
+#include <string>
+
+#include "rtmidi/RtMidi.h"
+
+#include "musycl/midi/midi_in.hpp"
+#include "musycl/midi/midi_out.hpp"
+
+namespace musycl::backend {
+
+/// Connect musycl::midi_in and musycl::midi_out to all the MIDI devices
+class rtmidi {
+  /// The MIDI input interface
+  midi_in input;
+
+  /// The MIDI output interface
+  midi_out output;
+
+ public:
+  /** Open all the MIDI input and output ports
+
+      \param[in] application_name is the name of the client
+
+      \param[in] api is the RtMidi API to use, such as
+      RtMidi::UNIX_JACK or RtMidi::LINUX_ALSA
+  */
+  rtmidi(const std::string& application_name, RtMidi::Api api) {
+    input.open(application_name, "input", api);
+    output.open(application_name, "output", api);
+  }
+};
+
+} // namespace musycl::backend
+
+#endif // MUSYCL_BACKEND_RTMIDI_HPP
@@ -12,6 +12,7 @@
 #include "config.hpp"
 #include "midi.hpp"
 #include "scheduler.hpp"
+#include "trace.hpp"
 
 namespace musycl {
 
@@ -26,6 +27,9 @@ class clock {
   /// Number of beats per measure (bar)
   static inline int meter = 4;
 
+  /// The tempo as the frequency of a quarter note in Hz
+  static inline float tempo = 2;
+
  public:
   /// To schedule things according to real time and duration
   static inline musycl::scheduler scheduler;
@@ -83,6 +87,7 @@ class clock {
  public:
   /// Set the global clock frequency in Hz
   static void set_tempo_frequency(float frequency) {
+    tempo = frequency;
     // The MIDI clock is 24 times the frequency of a quarter note.
     midi_dphase = frequency * midi::clock_per_quarter * frame_period;
     std::cout << "Global clock frequency = " << frequency
@@ -99,6 +104,12 @@ class clock {
   /// Set the global clock beats-per-minute
   static void set_tempo_bpm(float bpm) { set_tempo_frequency(bpm / 60); }
 
+  /// Get the global clock frequency in Hz, the frequency of a quarter note
+  static float tempo_frequency() { return tempo; }
+
+  /// Get the duration of a quarter note in second
+  static float beat_period() { return 1 / tempo; }
+
   /** Set the meter of the measure
 
       https://en.wikipedia.org/wiki/Metre_(music)
@@ -106,10 +117,25 @@ class clock {
   */
   static void set_meter(int beats) { meter = beats; }
 
+  /** Restart the time at the beginning of a measure, in the state of
+      the program start, without any MIDI clock until a tempo is set
+
+      This makes an offline rendering independent from what was
+      rendered before.
+  */
+  static void reset() {
+    phase = 0;
+    midi_dphase = 0;
+    meter = 4;
+    tempo = 2;
+    tick_type = {};
+  }
+
   /** Action to do with the tick of the audio frame clock
 
       This is where all the timing events are generated. */
   static void tick_frame_clock() {
+    MUSYCL_TRACE_SCOPE("clock::tick_frame_clock");
     scheduler.schedule();
 
     tick_type.midi_clock = false;
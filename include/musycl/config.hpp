@@ -10,8 +10,15 @@ namespace musycl {
   /// The sampling frequency of the audio input/output
   static constexpr auto sample_frequency = 48000;
 
-  /// Number of elements in an audio frame
+  /** Number of elements in an audio frame
+
+      It can be changed at build time by defining MUSYCL_FRAME_SIZE,
+      for example to benchmark other frame sizes */
+#ifdef MUSYCL_FRAME_SIZE
+  static constexpr auto frame_size = MUSYCL_FRAME_SIZE;
+#else
   static constexpr auto frame_size = 256;
+#endif
 
   /// Frame frequency
   static constexpr auto frame_frequency =
@@ -16,6 +16,7 @@
 
 #include "triSYCL/detail/shared_ptr_implementation.hpp"
 
+#include "musycl/log.hpp"
 #include "musycl/midi.hpp"
 #include "musycl/midi/midi_in.hpp"
 
@@ -180,7 +181,7 @@ class control {
     /// Dispatch to the client of this controller
     /// \todo Remove and move to group
     void dispatch() {
-      std::cout << "Dispatch from physical item" << std::endl;
+      MUSYCL_LOG_DEBUG("Dispatch from physical item");
       for (auto& l : listeners)
         l(value);
       user_interface_dispatcher(*this);
@@ -296,7 +297,7 @@ class control {
         , user_name { name }
         , phys_item { pi } {
       g->assign(pi, [&] {
-        std::cout << "Assign from group " << std::endl;
+        MUSYCL_LOG_DEBUG("Assign from group");
         physical_value.set_from_controller(phys_item.value().get().value);
       });
     }
@@ -306,8 +307,7 @@ class control {
     operator value_type&() { return value(); }
 
     void update_display() {
-      std::cout << "Control " << user_name << " set to " << value()
-                << std::endl;
+      MUSYCL_LOG_INFO("Control {} set to {}", user_name, value());
     }
 
     void set(const value_type& v) {
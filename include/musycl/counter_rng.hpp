@@ -0,0 +1,87 @@
+#ifndef MUSYCL_COUNTER_RNG_HPP
+#define MUSYCL_COUNTER_RNG_HPP
+
+/** \file A counter-based random number generator
+
+    Instead of updating a state at each call, the n-th random number of
+    a stream is a pure function of n and of the stream key, like in
+    Philox or Squares. So each voice can have its own stream, rendered
+    in any order or in parallel with the same result, and a batch of
+    random numbers is a loop without any dependency between iterations,
+    which the compiler can vectorize.
+
+    "Squares: A Fast Counter-Based RNG", Bernard Widynski, 2020
+    https://arxiv.org/abs/2004.06278
+*/
+
+#include <cstdint>
+#include <span>
+
+namespace musycl {
+
+/// A Squares counter-based generator of 32-bit random numbers
+class counter_rng {
+  /// The key selecting the stream, odd to keep the squares random
+  std::uint64_t key;
+
+  /// Mix the bits of a 64-bit integer, from the splitmix64 generator
+  static constexpr std::uint64_t mix(std::uint64_t x) {
+    x += 0x9e3779b97f4a7c15;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+  }
+
+  /// Swap the 2 halves of a 64-bit integer
+  static constexpr std::uint64_t rotate(std::uint64_t x) {
+    return x >> 32 | x << 32;
+  }
+
+ public:
+  using value_type = std::uint32_t;
+
+  /** Create the generator of a stream
+
+      \param[in] seed selects the family of streams, to render
+      different variations
+
+      \param[in] stream is the number of the stream in the family, like
+      a voice number
+  */
+  constexpr counter_rng(std::uint64_t seed = 0, std::uint64_t stream = 0)
+      : key { mix(mix(seed) ^ stream) | 1 } {}
+
+  /// The random number of the stream at some counter value
+  constexpr value_type operator()(std::uint64_t counter) const {
+    std::uint64_t x = counter * key;
+    const std::uint64_t y = x;
+    const std::uint64_t z = y + key;
+    x = rotate(x * x + y);
+    x = rotate(x * x + z);
+    x = rotate(x * x + y);
+    return (x * x + z) >> 32;
+  }
+
+  /// A random number uniformly distributed in [ -1, 1 )
+  constexpr float uniform(std::uint64_t counter) const {
+    // Interpret the bits as a signed number in [ -2^31, 2^31 )
+    return static_cast<std::int32_t>((*this)(counter)) * 0x1p-31f;
+  }
+
+  /** Fill a batch with the random numbers uniformly distributed in
+      [ -1, 1 ) from some counter value
+
+      \param[in] counter is the counter value of the first number
+
+      \param[out] batch receives the random numbers of the counter
+      values counter, counter + 1...
+  */
+  constexpr void uniform(std::uint64_t counter, std::span<float> batch) const {
+    for (std::size_t i = 0; i < batch.size(); ++i)
+      batch[i] = uniform(counter + i);
+  }
+};
+
+} // namespace musycl
+
+#endif // MUSYCL_COUNTER_RNG_HPP
@@ -6,14 +6,16 @@
 #ifndef MUSYCL_DCO_HPP
 #define MUSYCL_DCO_HPP
 
-#include <range/v3/all.hpp>
+#include <algorithm>
+#include <cstdint>
 
-#include <triSYCL/vendor/triSYCL/random/xorshift.hpp>
+#include <range/v3/all.hpp>
 
 #include "config.hpp"
 
 #include "audio.hpp"
 #include "control.hpp"
+#include "counter_rng.hpp"
 #include "group.hpp"
 #include "midi.hpp"
 #include "modulation_actuator.hpp"
@@ -36,8 +38,12 @@ class dco {
   /// The phase increment per clock to generate the right frequency
   float dphase {};
 
-  /// Some fast random generator
-  static inline trisycl::vendor::trisycl::random::xorshift<> rng;
+  /// The seed of the random detuning of all the DCOs
+  static inline std::uint64_t random_seed = 0;
+
+  /** Number of notes started since the seed, numbering the random
+      streams in the note order, whatever the rendering order */
+  static inline std::uint64_t started_notes = 0;
 
  public:
   /// Amplitude factor for the square waveform: 1 for maximal volume, 0 muted
@@ -107,6 +113,13 @@ class dco {
 
   dco() = default;
 
+  /** Restart the random streams of the DCOs from a seed, to render
+      reproducibly */
+  static void seed(std::uint64_t s) {
+    random_seed = s;
+    started_notes = 0;
+  }
+
   /** Start a note
 
       \param[in] on is the "note on" MIDI event to start with
@@ -116,10 +129,7 @@ class dco {
   auto& start(const musycl::midi::on& on) {
     note = on;
     // Add some random detuning for an analog mood
-    tune =
-        1 + 0.005 * (rng() * 2. /
-                       std::numeric_limits<decltype(rng)::value_type>::max() -
-                   1);
+    tune = 1 + 0.005 * counter_rng { random_seed, started_notes++ }.uniform(0);
     running = true;
     return *this;
   }
@@ -138,9 +148,18 @@ class dco {
   /// Return the running status
   bool is_running() { return running; }
 
-  /// Generate an audio sample
-  musycl::audio::frame audio() {
-    musycl::audio::frame f;
+  /** Generate a part of an audio frame
+
+      The parameters are sampled at the beginning of the part, so a
+      frame can be split to apply a parameter change at some sample.
+
+      \param[out] f is the audio frame to write into
+
+      \param[in] begin is the index of the first sample to generate
+
+      \param[in] end is the index past the last sample to generate
+  */
+  void render(musycl::audio::frame& f, int begin, int end) {
     if (running) {
       // Update the output frequency from the note ± 24 semitones from
       // the pitch bend
@@ -148,8 +167,8 @@ class dco {
           frequency(note, 24 * pitch_bend::value()) * tune / sample_frequency;
       set_square_waveform_parameter();
       set_triangle_waveform_parameter();
-      for (auto& e : f) {
-        e = square_signal() + triangle_signal();
+      for (int i = begin; i < end; ++i) {
+        f[i] = square_signal() + triangle_signal();
         phase += dphase;
         // The phase is cyclic modulo 1
         if (phase >= 1)
@@ -157,7 +176,13 @@ class dco {
       }
     } else
       // If the DCO is not running, the output is 0
-      ranges::fill(f, 0);
+      std::fill(f.begin() + begin, f.begin() + end, 0);
+  }
+
+  /// Generate an audio sample
+  musycl::audio::frame audio() {
+    musycl::audio::frame f;
+    render(f, 0, frame_size);
     return f;
   }
 
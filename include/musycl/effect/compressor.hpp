@@ -0,0 +1,177 @@
+#ifndef MUSYCL_EFFECT_COMPRESSOR_HPP
+#define MUSYCL_EFFECT_COMPRESSOR_HPP
+
+/** \file Feed-forward dynamic range compressor
+
+    https://en.wikipedia.org/wiki/Dynamic_range_compression
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <span>
+
+#include "../config.hpp"
+
+#include "../audio.hpp"
+#include "../trace.hpp"
+#include "level_detector.hpp"
+
+namespace musycl::effect {
+
+/** A stereo-linked compressor with a soft knee
+
+    The level is detected and the gain computed once per block of
+    \c block_size samples and the gain is then ramped linearly across
+    the block to avoid zipper noise.
+*/
+class compressor {
+ public:
+  /// Number of samples sharing a gain computation
+  static constexpr int block_size = 32;
+
+  static_assert(frame_size % block_size == 0,
+                "The frame size has to be a multiple of the block size");
+
+ private:
+  /// The detector measuring each block
+  level_detector detector { level_detector::mode::rms };
+
+  /// Level above which the gain is reduced, in dB
+  float threshold = -18;
+
+  /// Input dB above the threshold for 1 output dB above it
+  float ratio = 4;
+
+  /// Width of the soft knee around the threshold, in dB
+  float knee = 6;
+
+  /// Gain applied after the compression, in dB
+  float makeup = 0;
+
+  /// Smoothing factor per block when the level rises, 5 ms by default
+  float attack_factor = block_factor(0.005);
+
+  /// Smoothing factor per block when the level falls, 100 ms by default
+  float release_factor = block_factor(0.1);
+
+  /// The smoothed detected level in dB
+  float envelope = -120;
+
+  /// The linear gain at the end of the previous block
+  float gain = 1;
+
+  /// Smoothing factor per block for an exponential time constant in second
+  static float block_factor(float time) {
+    return std::exp(-block_size / (std::max(time, 1e-4f) * sample_frequency));
+  }
+
+  /// The static gain curve, giving the gain in dB for a level in dB
+  float gain_db(float level) const {
+    auto over = level - threshold;
+    if (2 * over < -knee)
+      return 0;
+    auto slope = 1 / ratio - 1;
+    if (2 * over > knee)
+      return slope * over;
+    // Quadratic interpolation inside the knee
+    auto x = over + knee / 2;
+    return slope * x * x / (2 * knee);
+  }
+
+ public:
+  /** Set the threshold in dB above which the gain is reduced
+
+      \return the effect itself to enable command chaining
+  */
+  auto& set_threshold(float t) {
+    threshold = t;
+    return *this;
+  }
+
+  /** Set the compression ratio, at least 1
+
+      \return the effect itself to enable command chaining
+  */
+  auto& set_ratio(float r) {
+    ratio = std::max(r, 1.f);
+    return *this;
+  }
+
+  /** Set the soft knee width in dB, 0 for a hard knee
+
+      \return the effect itself to enable command chaining
+  */
+  auto& set_knee(float k) {
+    knee = std::max(k, 0.f);
+    return *this;
+  }
+
+  /** Set the makeup gain in dB
+
+      \return the effect itself to enable command chaining
+  */
+  auto& set_makeup(float m) {
+    makeup = m;
+    return *this;
+  }
+
+  /** Set the attack time in second
+
+      \return the effect itself to enable command chaining
+  */
+  auto& set_attack(float t) {
+    attack_factor = block_factor(t);
+    return *this;
+  }
+
+  /** Set the release time in second
+
+      \return the effect itself to enable command chaining
+  */
+  auto& set_release(float t) {
+    release_factor = block_factor(t);
+    return *this;
+  }
+
+  /** Select the level detection mode
+
+      \return the effect itself to enable command chaining
+  */
+  auto& set_detection(level_detector::mode m) {
+    detector.set_mode(m);
+    return *this;
+  }
+
+  /// A silent input gives a silent output right away
+  int tail_frames() const { return 0; }
+
+  /// The current gain reduction in dB, useful for a meter
+  float reduction() const { return 20 * std::log10(gain) - makeup; }
+
+  /** Process an audio frame
+
+      \param[inout] audio frame which is processed
+  */
+  void process(audio::frame& audio) {
+    MUSYCL_TRACE_SCOPE("effect::compressor");
+    for (int b = 0; b < frame_size; b += block_size) {
+      std::span<audio::sample<>> block { &audio[b], block_size };
+      auto level = 20 * std::log10(std::max(detector.level(block), 1e-6f));
+      // Follow the level in the dB domain with attack and release
+      auto factor = level > envelope ? attack_factor : release_factor;
+      envelope = level + (envelope - level) * factor;
+      auto target = std::pow(10.f, (gain_db(envelope) + makeup) / 20);
+      // Ramp the gain across the block
+      auto step = (target - gain) / block_size;
+      for (auto& s : block) {
+        gain += step;
+        s *= gain;
+      }
+      gain = target;
+    }
+  }
+};
+
+} // namespace musycl::effect
+
+#endif // MUSYCL_EFFECT_COMPRESSOR_HPP
@@ -0,0 +1,365 @@
+#ifndef MUSYCL_EFFECT_CONVOLUTION_HPP
+#define MUSYCL_EFFECT_CONVOLUTION_HPP
+
+/** \file Stereo convolution with a long impulse response, like a
+    reverberation or a guitar cabinet
+
+    Implemented as a uniformly partitioned convolution in the
+    frequency domain with overlap-save and 1 partition per audio
+    frame, so the latency is the frame size.
+
+    https://en.wikipedia.org/wiki/Overlap%E2%80%93save_method
+    http://pcfarina.eng.unipr.it/Public/Papers/226-AES122.pdf
+*/
+
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sycl/sycl.hpp>
+
+#include "../config.hpp"
+
+#include "../audio.hpp"
+#include "../fft.hpp"
+#include "../trace.hpp"
+#include "../wav.hpp"
+
+namespace musycl::effect {
+
+/** A uniformly partitioned convolution
+
+    The impulse response is cut into partitions of a frame whose
+    spectra are precomputed. Each frame, the spectrum of the last 2
+    input frames is computed once and pushed into a frequency-domain
+    delay line, then multiplied-accumulated with all the partition
+    spectra.
+
+    Since the left and right signals are real, they are packed as the
+    real and imaginary parts of a single complex FFT and separated in
+    the frequency domain, so there is only 1 forward and 1 inverse FFT
+    per frame for both channels.
+
+    The multiply-accumulate, which is most of the work for long impulse
+    responses, can run on the default SYCL device instead of the host.
+*/
+class convolution {
+ public:
+  /// Each partition of the impulse response is a frame
+  static constexpr auto partition_size = frame_size;
+
+  /// FFT size with the overlap-save input of 2 frames
+  static constexpr auto fft_size = 2 * partition_size;
+
+  /// Only the non-negative frequency bins of real signals are kept
+  static constexpr auto bins = partition_size + 1;
+
+  /// Amount of convolved signal added to the output
+  float convolution_ratio = 1;
+
+  /// Amount of direct signal kept in the output
+  float dry_ratio = 0;
+
+ private:
+  /// The FFT engine
+  fft transform { fft_size };
+
+  /// Number of partitions of the impulse response
+  int partitions = 0;
+
+  /** Spectra of the impulse response partitions, split in real and
+      imaginary parts, indexed by [channel][partition][bin] */
+  std::vector<float> ir_re;
+  std::vector<float> ir_im;
+
+  /** The frequency-domain delay line of the input spectra, with the
+      same layout as the impulse response spectra */
+  std::vector<float> fdl_re;
+  std::vector<float> fdl_im;
+
+  /// Slot of the most recent input spectrum in the delay line
+  int fdl_head = 0;
+
+  /// The previous input frame, for the overlap-save
+  audio::frame previous_input {};
+
+  /// FFT work arrays
+  std::vector<float> work_re = std::vector<float>(fft_size);
+  std::vector<float> work_im = std::vector<float>(fft_size);
+
+  /// The spectrum accumulators, indexed by [channel][bin]
+  std::vector<float> acc_re = std::vector<float>(2 * bins);
+  std::vector<float> acc_im = std::vector<float>(2 * bins);
+
+  /// Run the multiply-accumulate on a SYCL device
+  bool on_device;
+
+  /// A queue to the default device
+  sycl::queue q;
+
+  /// The device copies of the impulse response spectra
+  std::optional<sycl::buffer<float>> ir_re_buffer;
+  std::optional<sycl::buffer<float>> ir_im_buffer;
+
+  /// The device copies of the frequency-domain delay line
+  std::optional<sycl::buffer<float>> fdl_re_buffer;
+  std::optional<sycl::buffer<float>> fdl_im_buffer;
+
+  /// Offset of a spectrum in the [channel][partition][bin] layout
+  int offset(int channel, int partition) const {
+    return (channel * partitions + partition) * bins;
+  }
+
+  /** Split the spectrum of the packed (left + i right) signal in the
+      work arrays into the left and right spectra
+
+      With Z[k] = L[k] + i R[k] and L, R spectra of real signals,
+      L[k] = (Z[k] + conj(Z[N - k]))/2 and R[k] = (Z[k] - conj(Z[N -
+      k]))/2i
+
+      \param[out] *_re, *_im are the [channel][bin] output spectra
+  */
+  void unpack(float* l_re, float* l_im, float* r_re, float* r_im) const {
+    for (int k = 0; k < bins; ++k) {
+      auto mirror = (fft_size - k) % fft_size;
+      auto a_re = work_re[k];
+      auto a_im = work_im[k];
+      auto b_re = work_re[mirror];
+      auto b_im = work_im[mirror];
+      l_re[k] = (a_re + b_re) / 2;
+      l_im[k] = (a_im - b_im) / 2;
+      r_re[k] = (a_im + b_im) / 2;
+      r_im[k] = (b_re - a_re) / 2;
+    }
+  }
+
+  /// Multiply-accumulate all the partitions on the host
+  void multiply_accumulate() {
+    std::ranges::fill(acc_re, 0);
+    std::ranges::fill(acc_im, 0);
+    for (int c = 0; c < 2; ++c) {
+      float* y_re = &acc_re[c * bins];
+      float* y_im = &acc_im[c * bins];
+      for (int p = 0; p < partitions; ++p) {
+        // The input spectrum delayed by p frames meets partition p
+        auto slot = (fdl_head - p + partitions) % partitions;
+        const float* x_re = &fdl_re[offset(c, slot)];
+        const float* x_im = &fdl_im[offset(c, slot)];
+        const float* h_re = &ir_re[offset(c, p)];
+        const float* h_im = &ir_im[offset(c, p)];
+        // Complex multiply-accumulate, unit-stride so vectorizable
+        for (int k = 0; k < bins; ++k) {
+          y_re[k] += x_re[k] * h_re[k] - x_im[k] * h_im[k];
+          y_im[k] += x_re[k] * h_im[k] + x_im[k] * h_re[k];
+        }
+      }
+    }
+  }
+
+  /// Multiply-accumulate all the partitions on the SYCL device
+  void device_multiply_accumulate() {
+    // The new input spectra for the 2 channels
+    const float* new_spectra[] = { &fdl_re[offset(0, fdl_head)],
+                                   &fdl_im[offset(0, fdl_head)],
+                                   &fdl_re[offset(1, fdl_head)],
+                                   &fdl_im[offset(1, fdl_head)] };
+    sycl::buffer<float> x_re { new_spectra[0], bins };
+    sycl::buffer<float> x_im { new_spectra[1], bins };
+    sycl::buffer<float> x_re_r { new_spectra[2], bins };
+    sycl::buffer<float> x_im_r { new_spectra[3], bins };
+    // The output spectra, copied back on destruction
+    sycl::buffer<float> y_re { acc_re.data(), acc_re.size() };
+    sycl::buffer<float> y_im { acc_im.data(), acc_im.size() };
+    // Capture explicitly to avoid capturing \c *this
+    auto head = fdl_head;
+    auto p_number = partitions;
+    // Insert the new spectra in the device delay line
+    q.submit([&](auto& cgh) {
+      sycl::accessor l_re { x_re, cgh, sycl::read_only };
+      sycl::accessor l_im { x_im, cgh, sycl::read_only };
+      sycl::accessor r_re { x_re_r, cgh, sycl::read_only };
+      sycl::accessor r_im { x_im_r, cgh, sycl::read_only };
+      sycl::accessor d_re { *fdl_re_buffer, cgh, sycl::write_only };
+      sycl::accessor d_im { *fdl_im_buffer, cgh, sycl::write_only };
+      cgh.parallel_for(bins, [=](int k) {
+        d_re[head * bins + k] = l_re[k];
+        d_im[head * bins + k] = l_im[k];
+        d_re[(p_number + head) * bins + k] = r_re[k];
+        d_im[(p_number + head) * bins + k] = r_im[k];
+      });
+    });
+    // 1 work-item per channel and frequency bin
+    q.submit([&](auto& cgh) {
+      sycl::accessor d_re { *fdl_re_buffer, cgh, sycl::read_only };
+      sycl::accessor d_im { *fdl_im_buffer, cgh, sycl::read_only };
+      sycl::accessor h_re { *ir_re_buffer, cgh, sycl::read_only };
+      sycl::accessor h_im { *ir_im_buffer, cgh, sycl::read_only };
+      sycl::accessor o_re { y_re, cgh, sycl::write_only };
+      sycl::accessor o_im { y_im, cgh, sycl::write_only };
+      cgh.parallel_for(2 * bins, [=](int i) {
+        auto c = i / bins;
+        auto k = i % bins;
+        float s_re = 0;
+        float s_im = 0;
+        for (int p = 0; p < p_number; ++p) {
+          auto x = (c * p_number + (head - p + p_number) % p_number) * bins + k;
+          auto h = (c * p_number + p) * bins + k;
+          s_re += d_re[x] * h_re[h] - d_im[x] * h_im[h];
+          s_im += d_re[x] * h_im[h] + d_im[x] * h_re[h];
+        }
+        o_re[i] = s_re;
+        o_im[i] = s_im;
+      });
+    });
+    /* The \c y_re and \c y_im buffer destructions wait for the kernel
+       and copy the result back to the accumulators */
+  }
+
+ public:
+  /** Create a convolution engine
+
+      \param[in] use_device selects whether the multiply-accumulate
+      runs on the default SYCL device or on the host
+  */
+  convolution(bool use_device = false)
+      : on_device { use_device } {}
+
+  /// Create a convolution engine with an impulse response from a WAV file
+  convolution(const std::string& file_name, bool use_device = false)
+      : convolution { use_device } {
+    load(file_name);
+  }
+
+  /** Load the impulse response from a WAV file
+
+      A mono impulse response is used for both channels, otherwise the
+      first 2 channels are used for the left and right channels. It is
+      resampled to the synthesizer sampling frequency if needed.
+
+      \return the effect itself to enable command chaining
+  */
+  convolution& load(const std::string& file_name) {
+    auto ir = wav::read(file_name);
+    ir.resample(sample_frequency);
+    if (ir.channels.size() == 1)
+      ir.channels.push_back(ir.channels.front());
+    return set_impulse_response(ir.channels[audio::left],
+                                ir.channels[audio::right]);
+  }
+
+  /** Set the impulse response of each channel
+
+      \return the effect itself to enable command chaining
+  */
+  convolution& set_impulse_response(const std::vector<float>& left,
+                                    const std::vector<float>& right) {
+    auto length = std::max({ left.size(), right.size(), std::size_t { 1 } });
+    partitions = (length + partition_size - 1) / partition_size;
+    ir_re.assign(2 * partitions * bins, 0);
+    ir_im.assign(2 * partitions * bins, 0);
+    fdl_re.assign(2 * partitions * bins, 0);
+    fdl_im.assign(2 * partitions * bins, 0);
+    fdl_head = 0;
+    previous_input = {};
+    for (int p = 0; p < partitions; ++p) {
+      /* Pack the left and right partitions into a single complex
+         signal, zero-padded to the FFT size for the linear
+         convolution */
+      std::ranges::fill(work_re, 0);
+      std::ranges::fill(work_im, 0);
+      auto begin = static_cast<std::size_t>(p) * partition_size;
+      for (int i = 0; i < partition_size; ++i) {
+        if (begin + i < left.size())
+          work_re[i] = left[begin + i];
+        if (begin + i < right.size())
+          work_im[i] = right[begin + i];
+      }
+      transform.forward(work_re, work_im);
+      unpack(&ir_re[offset(0, p)], &ir_im[offset(0, p)], &ir_re[offset(1, p)],
+             &ir_im[offset(1, p)]);
+    }
+    if (on_device) {
+      ir_re_buffer.emplace(std::as_const(ir_re).data(), ir_re.size());
+      ir_im_buffer.emplace(std::as_const(ir_im).data(), ir_im.size());
+      fdl_re_buffer.emplace(fdl_re.size());
+      fdl_im_buffer.emplace(fdl_im.size());
+      q.submit([&](auto& cgh) {
+        cgh.fill(sycl::accessor { *fdl_re_buffer, cgh, sycl::write_only,
+                                  sycl::no_init },
+                 0.f);
+      });
+      q.submit([&](auto& cgh) {
+        cgh.fill(sycl::accessor { *fdl_im_buffer, cgh, sycl::write_only,
+                                  sycl::no_init },
+                 0.f);
+      });
+    }
+    return *this;
+  }
+
+  /// Length of the impulse response in frames
+  int length() const { return partitions; }
+
+  /// Number of frames the output lasts after the input became silent
+  int tail_frames() const { return partitions + 1; }
+
+  /** Process an audio frame
+
+      \param[inout] audio frame which is processed
+  */
+  void process(audio::frame& audio) {
+    MUSYCL_TRACE_SCOPE("effect::convolution");
+    if (partitions == 0)
+      return;
+    // Overlap-save: transform the previous and the current input frames
+    for (int i = 0; i < frame_size; ++i) {
+      work_re[i] = previous_input[i][audio::left];
+      work_im[i] = previous_input[i][audio::right];
+      work_re[frame_size + i] = audio[i][audio::left];
+      work_im[frame_size + i] = audio[i][audio::right];
+    }
+    previous_input = audio;
+    transform.forward(work_re, work_im);
+    // The delay line moves forward by 1 frame
+    fdl_head = (fdl_head + 1) % partitions;
+    unpack(&fdl_re[offset(0, fdl_head)], &fdl_im[offset(0, fdl_head)],
+           &fdl_re[offset(1, fdl_head)], &fdl_im[offset(1, fdl_head)]);
+
+    if (on_device)
+      device_multiply_accumulate();
+    else
+      multiply_accumulate();
+
+    /* Pack back the left and right spectra Y_l and Y_r into the
+       spectrum of (y_l + i y_r), using the Hermitian symmetry for the
+       negative frequencies */
+    const float* l_re = &acc_re[0];
+    const float* l_im = &acc_im[0];
+    const float* r_re = &acc_re[bins];
+    const float* r_im = &acc_im[bins];
+    for (int k = 0; k < bins; ++k) {
+      work_re[k] = l_re[k] - r_im[k];
+      work_im[k] = l_im[k] + r_re[k];
+    }
+    for (int k = bins; k < fft_size; ++k) {
+      auto mirror = fft_size - k;
+      work_re[k] = l_re[mirror] + r_im[mirror];
+      work_im[k] = r_re[mirror] - l_im[mirror];
+    }
+    transform.inverse(work_re, work_im);
+    // Only the second half is free from the circular convolution aliasing
+    for (int i = 0; i < frame_size; ++i) {
+      auto& s = audio[i];
+      s[audio::left] = dry_ratio * s[audio::left] +
+                       convolution_ratio * work_re[frame_size + i];
+      s[audio::right] = dry_ratio * s[audio::right] +
+                        convolution_ratio * work_im[frame_size + i];
+    }
+  }
+};
+
+} // namespace musycl::effect
+
+#endif // MUSYCL_EFFECT_CONVOLUTION_HPP
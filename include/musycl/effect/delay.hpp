@@ -1,27 +1,74 @@
 #ifndef MUSYCL_EFFECT_DELAY_HPP
 #define MUSYCL_EFFECT_DELAY_HPP
 
-/// \file Simple delay implemented with std::ranges on CPU, allowing only a
-/// delay by an integral number of frame
+/** \file Stereo, ping-pong and multi-tap delay which can follow the
+    tempo of the clock
 
-#include <algorithm>
+    All the taps are read at fractional positions from a single
+    circular delay line in one kernel.
+*/
 
-#include <range/v3/all.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
 
 #include <sycl/sycl.hpp>
 
 #include "../config.hpp"
 
 #include "../audio.hpp"
+#include "../clock.hpp"
+#include "../tail.hpp"
+#include "../trace.hpp"
 
 namespace musycl::effect {
 
 class delay {
  public:
-  // Keep 5 seconds of delay
-  static constexpr auto frame_delay = static_cast<int>(5 * frame_frequency);
-  // Size of the delay line
-  static constexpr auto delay_size = frame_delay * frame_size;
+  /// The ways the taps are combined and fed back
+  enum class mode : std::int8_t {
+    /// The right channel is delayed twice as much as the left one
+    stereo,
+    /// The echoes bounce between the left and right channels
+    ping_pong,
+    /// Several panned taps at multiples of the delay time
+    multi_tap
+  };
+
+  /// A tap of the multi-tap mode
+  struct tap {
+    /// Delay of the tap as a multiple of the delay time
+    float time_ratio = 1;
+    /// Level of the tap
+    float gain = 1;
+    /// Pan of the tap, from -1 for left to +1 for right
+    float pan = 0;
+  };
+
+  /// Maximum number of taps read from the delay line
+  static constexpr int max_taps = 4;
+
+  /// Keep a little more than 5 seconds in the delay line, a power of 2
+  static constexpr int delay_size = [] {
+    int s = 1;
+    while (s < 5 * sample_frequency + frame_size + 2)
+      s *= 2;
+    return s;
+  }();
+
+  /** The delay time has to be longer than a frame, so the whole frame
+      can be computed in parallel from the past samples, including the
+      next sample read by the interpolation */
+  static constexpr int minimum_delay = frame_size + 1;
+
+  /// The shortest base delay time
+  static constexpr float minimum_delay_line_time =
+      static_cast<float>(minimum_delay) / sample_frequency;
+
+  /// The longest base delay time
+  static constexpr float maximum_delay_line_time =
+      static_cast<float>(delay_size - frame_size - 2) / sample_frequency;
 
   /// Almost a 8th note of delay by default at 120 bpm sounds cool
   float delay_line_time = 0.245;
@@ -32,17 +79,68 @@ class delay {
   /// Feedback from the output into the input
   float feedback_ratio = 0.2;
 
+  /// Duration of the crossfade when the delay time changes, in frame
+  static constexpr int crossfade_frames = 4;
+
+  /// Some note values expressed in quarter notes to synchronize the delay
+  static constexpr float whole = 4;
+  static constexpr float half = 2;
+  static constexpr float quarter = 1;
+  static constexpr float eighth = 0.5;
+  static constexpr float sixteenth = 0.25;
+
+  /// A dotted note value, lasting 1.5 times the note
+  static constexpr float dotted(float note) { return note * 1.5f; }
+
+  /// A triplet note value, 3 of them lasting as long as 2 notes
+  static constexpr float triplet(float note) { return note * 2 / 3; }
+
  private:
-  // A queue to the default device
+  /// The stereo gain of a tap of the multi-tap mode
+  static sycl::marray<float, audio::channel_number> tap_gain(const tap& t) {
+    return { t.gain * std::min(1 - t.pan, 1.f),
+             t.gain * std::min(1 + t.pan, 1.f) };
+  }
+
+  /// The delays of a tap in sample and its stereo gain
+  struct tap_state {
+    float previous_delay;
+    float delay;
+    sycl::marray<float, audio::channel_number> gain;
+  };
+
+  /// A queue to the default device
   sycl::queue q;
 
-  // The buffer implementing the delay line on the accelerator
+  /// The circular buffer implementing the delay line on the accelerator
   sycl::buffer<audio::sample<>> delay_line { delay_size };
 
-  // Buffer used for the output but which is also used for the
-  // feedback, so keep it alive across following frame computation
-  // \todo need to be 0-initialized. Improve SYCL specification
-  sycl::buffer<audio::sample<>> output { frame_size };
+  /// Index in the delay line where the next frame is written
+  int write_index = 0;
+
+  /// The current mode
+  mode current_mode = mode::stereo;
+
+  /// The taps used in multi-tap mode
+  std::array<tap, max_taps> taps { { { 1, 0.8, -0.7 },
+                                     { 2, 0.6, 0.7 },
+                                     { 3, 0.4, -0.3 },
+                                     { 4, 0.3, 0.3 } } };
+
+  /// Number of taps used in multi-tap mode
+  int tap_number = max_taps;
+
+  /// Length of the delay in quarter note when following the clock, 0 if not
+  float sync_note = 0;
+
+  /// Delay time in sample of the previous frame, to detect changes
+  float delay_time = 0;
+
+  /// Delay time in sample before the current change
+  float previous_delay_time = 0;
+
+  /// Frames since the last delay time change, to drive the crossfade
+  int crossfade_position = crossfade_frames;
 
  public:
   delay() {
@@ -54,69 +152,185 @@ class delay {
     });
   }
 
+  /** Select how the taps are combined and fed back
+
+      \return the effect itself to enable command chaining
+  */
+  auto& set_mode(mode m) {
+    current_mode = m;
+    return *this;
+  }
+
+  /** Synchronize the delay time with the clock tempo
+
+      \param[in] note is the delay as a note value in quarter notes,
+      like \c delay::eighth or \c delay::dotted(delay::eighth), or 0
+      to use \c delay_line_time instead
+
+      \return the effect itself to enable command chaining
+  */
+  auto& set_sync(float note) {
+    sync_note = std::max(note, 0.f);
+    return *this;
+  }
+
+  /** Set a tap of the multi-tap mode
+
+      \return the effect itself to enable command chaining
+  */
+  auto& set_tap(int index, const tap& t) {
+    taps.at(index) = t;
+    return *this;
+  }
+
+  /** Set the number of taps used in multi-tap mode
+
+      \return the effect itself to enable command chaining
+  */
+  auto& set_tap_number(int n) {
+    tap_number = std::clamp(n, 1, max_taps);
+    return *this;
+  }
+
+  /// The current base delay time in second
+  float time() const {
+    auto t = sync_note > 0 ? sync_note * clock::beat_period() : delay_line_time;
+    return std::clamp(t, minimum_delay_line_time, maximum_delay_line_time);
+  }
+
+  /** The gain of the feedback loop for 1 trip through the delay line,
+      the largest of the 2 channels
+
+      In multi-tap mode all the taps are fed back, so their gains add up.
+  */
+  float loop_gain() const {
+    auto feedback = std::abs(feedback_ratio);
+    if (current_mode != mode::multi_tap)
+      return feedback;
+    sycl::marray<float, audio::channel_number> sum { 0 };
+    for (int t = 0; t < tap_number; ++t)
+      sum += sycl::fabs(tap_gain(taps[t]));
+    return feedback * std::max(sum[audio::left], sum[audio::right]);
+  }
+
+  /// Number of frames the echoes last after the input became silent
+  int tail_frames() const {
+    auto feedback = loop_gain();
+    if (feedback >= 1)
+      return infinite_tail;
+    // The longest tap delay
+    float longest = current_mode == mode::stereo ? 2 : 1;
+    if (current_mode == mode::multi_tap)
+      for (int t = 0; t < tap_number; ++t)
+        longest = std::max(longest, taps[t].time_ratio);
+    // Number of trips through the delay line to decay down to silence
+    auto trips = feedback < silence_threshold
+                     ? 1
+                     : std::ceil(std::log(silence_threshold) /
+                                 std::log(feedback)) + 1;
+    return frames_from_time(longest * time() * trips);
+  }
+
   /**  Process an audio frame
 
        \param[inout] 1 audio frame which is processed
   */
   void process(audio::frame& audio) {
+    MUSYCL_TRACE_SCOPE("effect::delay");
+    // Start a crossfade when the delay time changes
+    auto new_delay_time = time() * sample_frequency;
+    if (new_delay_time != delay_time) {
+      if (delay_time == 0)
+        previous_delay_time = new_delay_time;
+      else
+        // Start from where an ongoing crossfade is, instead of jumping
+        previous_delay_time += (delay_time - previous_delay_time) *
+                               crossfade_position / crossfade_frames;
+      delay_time = new_delay_time;
+      crossfade_position = 0;
+    }
+    // Compute the position and gain of each tap from the base delay
+    std::array<tap_state, max_taps> states;
+    int active_taps = 0;
+    auto add_tap = [&](float ratio,
+                       sycl::marray<float, audio::channel_number> gain) {
+      auto clamp = [](float d) {
+        return std::clamp(d, static_cast<float>(minimum_delay),
+                          static_cast<float>(delay_size - frame_size - 2));
+      };
+      states[active_taps++] = { clamp(previous_delay_time * ratio),
+                                clamp(delay_time * ratio), gain };
+    };
+    switch (current_mode) {
+    case mode::stereo:
+      add_tap(1, { 1, 0 });
+      add_tap(2, { 0, 1 });
+      break;
+    case mode::ping_pong:
+      add_tap(1, { 1, 1 });
+      break;
+    case mode::multi_tap:
+      for (int t = 0; t < tap_number; ++t)
+        add_tap(taps[t].time_ratio, tap_gain(taps[t]));
+      break;
+    }
+    // Crossfade ramp from the previous to the current delay across the frame
+    float fade_start =
+        static_cast<float>(crossfade_position) / crossfade_frames;
+    float fade_step = crossfade_position < crossfade_frames
+                          ? 1.f / (crossfade_frames * frame_size)
+                          : 0;
+    crossfade_position = std::min(crossfade_position + 1, crossfade_frames);
+
     // Make a buffer from the audio frame so it can processed from a SYCL kernel
     sycl::buffer<audio::sample<>> input_output { audio.data(), audio.size() };
-    // Delay shift in term of sample number
-    int shift = delay_line_time * sample_frequency;
-
-    // Submit a command group to the default device
-    q.submit([&](auto& cgh) {
-      // Request a read-write access to the delay buffer on the device
-      sycl::accessor d { delay_line, cgh };
-      // Shift the delay line with a kernel on the device
-      cgh.parallel_for(frame_size, [=](int i) {
-        // Shift the delay line by a frame towards the beginning,
-        // strip-mined by frame
-        for (int sample = 0; sample < delay_size - frame_size;
-             sample += frame_size)
-          d[sample + i] = d[sample + frame_size + i];
-      });
-    });
-    // Complete the delay line with the input and the output feedback
-    q.submit([&](auto& cgh) {
-      // Request a read access to the audio frame on the device
-      sycl::accessor io { input_output, cgh, sycl::read_only };
-      // Request a read access to the previous output frame on the device
-      sycl::accessor out { output, cgh, sycl::read_only };
-      // Request a read-write access to the delay buffer on the device
-      sycl::accessor d { delay_line, cgh };
-      // Capture explicitly \c feedback_ratio to avoid capture \c *this
-      cgh.parallel_for(frame_size, [=, feedback_ratio = feedback_ratio](int i) {
-        // Copy the input frame to the end of the delay line
-        d.rbegin()[i] = io.rbegin()[i];
-        // Re-inject some output on-top of the input for the
-        // feedback
-        d.rbegin()[i] += feedback_ratio * out.rbegin()[i];
-      });
-    });
-    // Then, use the delay buffer to compute the output
     q.submit([&](auto& cgh) {
       // Request a read-write access to the audio frame on the device
       sycl::accessor io { input_output, cgh };
-      // Request a write access to the audio frame on the device
-      sycl::accessor out { output, cgh, sycl::write_only };
       // Request a read-write access to the delay buffer on the device
       sycl::accessor d { delay_line, cgh };
-      // The delay processing kernel to run on the device.
-      // Capture explicitly \c delay_line_ratio to avoid capture \c *this
-      cgh.parallel_for(frame_size, [=, delay_line_ratio =
-                                           delay_line_ratio](int i) {
-        // The output is the input plus some ratio of the delayed signal.
-        // Left channel
-        out.rbegin()[i][0] =
-            io.rbegin()[i][0] + d.rbegin()[shift + i][0] * delay_line_ratio;
-        // Right channel with twice the delay
-        out.rbegin()[i][1] =
-            io.rbegin()[i][1] + d.rbegin()[2 * shift + i][1] * delay_line_ratio;
-        // Then copy back the output to the io audio frame to be returned
-        io.rbegin()[i] = out.rbegin()[i];
+      // Capture explicitly the parameters to avoid capture \c *this
+      cgh.parallel_for(frame_size, [=, w = write_index, m = current_mode,
+                                    ratio = delay_line_ratio,
+                                    feedback = feedback_ratio](int i) {
+        // Read the delay line with a linear interpolation. Since the
+        // delays are longer than 1 frame, only past samples are read
+        auto read = [&](float delay) {
+          auto position = w + i - delay;
+          auto index = static_cast<int>(sycl::floor(position));
+          auto fraction = position - index;
+          return audio::sample<> {
+            d[index & (delay_size - 1)] * (1 - fraction) +
+            d[(index + 1) & (delay_size - 1)] * fraction
+          };
+        };
+        auto fade = sycl::fmin(fade_start + fade_step * (i + 1), 1.f);
+        // Sum all the taps in a single pass over the delay line
+        audio::sample<> wet { 0 };
+        for (int t = 0; t < active_taps; ++t) {
+          auto& s = states[t];
+          audio::sample<> v = read(s.delay);
+          if (fade < 1)
+            v = v * fade + read(s.previous_delay) * (1 - fade);
+          wet[audio::left] += v[audio::left] * s.gain[audio::left];
+          wet[audio::right] += v[audio::right] * s.gain[audio::right];
+        }
+        audio::sample<> in = io[i];
+        // Write the input and the feedback into the delay line
+        if (m == mode::ping_pong)
+          // Send the mono input into the left channel and cross the feedback
+          d[(w + i) & (delay_size - 1)] = audio::sample<> {
+            { .left = (in[audio::left] + in[audio::right]) / 2 +
+                      feedback * wet[audio::right],
+              .right = feedback * wet[audio::left] }
+          };
+        else
+          d[(w + i) & (delay_size - 1)] = in + feedback * wet;
+        // The output is the input plus some ratio of the delayed signal
+        io[i] = in + wet * ratio;
       });
     });
+    write_index = (write_index + frame_size) & (delay_size - 1);
     /* The \c input_output buffer destruction cause the data to be
        transferred from the device and be copy backed to the audio
        frame */
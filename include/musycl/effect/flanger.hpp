@@ -14,6 +14,8 @@
 #include "../config.hpp"
 
 #include "../audio.hpp"
+#include "../tail.hpp"
+#include "../trace.hpp"
 
 namespace musycl::effect {
 
@@ -76,11 +78,19 @@ class flanger {
     });
   }
 
+  /** The input keeps sounding for the longest delay, plus the next
+      sample used by the interpolation */
+  int tail_frames() const {
+    return frames_from_samples(
+        static_cast<int>(delay_line_time * sample_frequency) + 1);
+  }
+
   /** Process an audio frame
 
       \param[inout] 1 audio frame which is processed
   */
   void process(audio::buffer input_output) {
+    MUSYCL_TRACE_SCOPE("effect::flanger");
     assert(lfo_phase >= 0 && lfo_phase < 1);
     // Delay shift in term of sample number
     int shift = delay_line_time * sample_frequency;
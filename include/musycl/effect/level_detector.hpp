@@ -0,0 +1,80 @@
+#ifndef MUSYCL_EFFECT_LEVEL_DETECTOR_HPP
+#define MUSYCL_EFFECT_LEVEL_DETECTOR_HPP
+
+/** \file Block-based signal level detection for the dynamics effects
+
+    https://en.wikipedia.org/wiki/Dynamic_range_compression
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <span>
+
+#include <sycl/sycl.hpp>
+
+#include "../config.hpp"
+
+#include "../audio.hpp"
+
+namespace musycl::effect {
+
+/** Measure the level of a block of samples, linked across the stereo
+    channels
+
+    The detection is done with element-wise operations on the whole
+    stereo samples, so the channels are processed in SIMD and the
+    inner loop can be vectorized.
+*/
+class level_detector {
+ public:
+  /// The detection modes
+  enum class mode : std::int8_t {
+    /// Maximum absolute value of the block
+    peak,
+    /// Root mean square of the block
+    rms
+  };
+
+ private:
+  /// Current detection mode
+  mode detection = mode::peak;
+
+ public:
+  level_detector(mode m = mode::peak)
+      : detection { m } {}
+
+  /** Select the detection mode
+
+      \return the detector itself to enable command chaining
+  */
+  auto& set_mode(mode m) {
+    detection = m;
+    return *this;
+  }
+
+  /** Measure the level of a block of samples
+
+      \param[in] block is the block of samples to measure
+
+      \return the linear level of the loudest channel
+  */
+  float level(std::span<const audio::sample<>> block) const {
+    // Use the plain sycl::marray since the SYCL builtins may not work
+    // on audio::sample
+    sycl::marray<audio::value_type, audio::channel_number> acc { 0 };
+    if (detection == mode::peak)
+      for (auto& s : block)
+        acc = sycl::fmax(acc, s.fabs());
+    else {
+      for (auto& s : block)
+        acc += s * s;
+      acc = sycl::sqrt(acc / static_cast<audio::value_type>(block.size()));
+    }
+    return std::max(acc[audio::left], acc[audio::right]);
+  }
+};
+
+} // namespace musycl::effect
+
+#endif // MUSYCL_EFFECT_LEVEL_DETECTOR_HPP
@@ -0,0 +1,149 @@
+#ifndef MUSYCL_EFFECT_LIMITER_HPP
+#define MUSYCL_EFFECT_LIMITER_HPP
+
+/** \file Lookahead brickwall limiter
+
+    https://en.wikipedia.org/wiki/Dynamic_range_compression#Limiting
+*/
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <span>
+
+#include "../config.hpp"
+
+#include "../audio.hpp"
+#include "../tail.hpp"
+#include "../trace.hpp"
+#include "level_detector.hpp"
+
+namespace musycl::effect {
+
+/** A stereo-linked brickwall limiter with lookahead
+
+    The signal is delayed by \c lookahead_blocks blocks so the gain can
+    start decreasing before a peak arrives. The gain at the end of
+    each block is the smallest of:
+
+    - the gain needed by the current and the next block, so that every
+      sample of a block, which sees a linear ramp between the gains at
+      both ends of the block, stays below the ceiling;
+
+    - the linear ramps reaching in time the gain needed by the later
+      blocks of the lookahead, giving a smooth attack;
+
+    - the previous gain moving back towards 1 according to the release
+      time.
+*/
+class limiter {
+ public:
+  /// Number of samples sharing a gain computation
+  static constexpr int block_size = 32;
+
+  /// Number of blocks seen in advance, also the latency in blocks
+  static constexpr int lookahead_blocks = 4;
+
+  /// The latency introduced by the limiter in sample
+  static constexpr int latency = lookahead_blocks * block_size;
+
+ private:
+  static_assert(frame_size % block_size == 0,
+                "The frame size has to be a multiple of the block size");
+
+  /// Number of blocks in a frame
+  static constexpr int frame_blocks = frame_size / block_size;
+
+  /// The peak detector
+  level_detector detector { level_detector::mode::peak };
+
+  /// The delayed samples followed by the current frame
+  std::array<audio::sample<>, latency + frame_size> delayed {};
+
+  /// The gain needed by each block of \c delayed
+  std::array<float, lookahead_blocks + frame_blocks> needed;
+
+  /// Maximum output level, linear, -1 dB by default
+  float ceiling = from_db(-1);
+
+  /// Recovery factor of the gain per block, 50 ms by default
+  float release_factor = block_factor(0.05);
+
+  /// The linear gain at the end of the previous block
+  float gain = 1;
+
+  /// Convert a level in dB to a linear level
+  static float from_db(float db) { return std::pow(10.f, db / 20); }
+
+  /// Recovery factor per block for an exponential time constant in second
+  static float block_factor(float time) {
+    return std::exp(-block_size / (std::max(time, 1e-3f) * sample_frequency));
+  }
+
+ public:
+  limiter() { needed.fill(1); }
+
+  /** Set the maximum output level in dB
+
+      \return the effect itself to enable command chaining
+  */
+  auto& set_ceiling(float c) {
+    ceiling = from_db(c);
+    return *this;
+  }
+
+  /** Set the release time in second
+
+      \return the effect itself to enable command chaining
+  */
+  auto& set_release(float t) {
+    release_factor = block_factor(t);
+    return *this;
+  }
+
+  /** The lookahead delays the output by its latency, which can be
+      longer than a frame with a small frame size */
+  int tail_frames() const { return frames_from_samples(latency); }
+
+  /// The current gain reduction in dB, useful for a meter
+  float reduction() const { return 20 * std::log10(gain); }
+
+  /** Process an audio frame
+
+      The output is delayed by \c latency samples.
+
+      \param[inout] audio frame which is processed
+  */
+  void process(audio::frame& audio) {
+    MUSYCL_TRACE_SCOPE("effect::limiter");
+    std::ranges::copy(audio, delayed.begin() + latency);
+    // Detect the gain needed by each new block
+    for (int b = 0; b < frame_blocks; ++b) {
+      auto peak = detector.level(
+          std::span { &delayed[latency + b * block_size], block_size });
+      needed[lookahead_blocks + b] = peak > ceiling ? ceiling / peak : 1;
+    }
+    for (int b = 0; b < frame_blocks; ++b) {
+      // Recover towards unity gain
+      auto target = 1 - (1 - gain) * release_factor;
+      target = std::min({ target, needed[b], needed[b + 1] });
+      // Start early to reach smoothly the gains needed later
+      for (int j = 2; j <= lookahead_blocks; ++j)
+        target = std::min(target, gain + (needed[b + j] - gain) / j);
+      auto step = (target - gain) / block_size;
+      for (int i = 0; i < block_size; ++i) {
+        gain += step;
+        audio[b * block_size + i] = delayed[b * block_size + i] * gain;
+      }
+      gain = target;
+    }
+    // Keep the lookahead part for the next frame
+    std::ranges::copy_n(delayed.begin() + frame_size, latency, delayed.begin());
+    std::ranges::copy_n(needed.begin() + frame_blocks, lookahead_blocks,
+                        needed.begin());
+  }
+};
+
+} // namespace musycl::effect
+
+#endif // MUSYCL_EFFECT_LIMITER_HPP
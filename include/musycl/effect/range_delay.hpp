@@ -11,6 +11,7 @@
 #include "../config.hpp"
 
 #include "../audio.hpp"
+#include "../trace.hpp"
 
 namespace musycl::effect {
 
@@ -31,6 +32,7 @@ class range_delay {
  public:
   /// Process an audio frame
   void process(musycl::audio::frame& audio) {
+    MUSYCL_TRACE_SCOPE("effect::range_delay");
     std::shift_left(delay.begin(), delay.end(), frame_size);
     std::ranges::copy(audio, delay.end() - frame_size);
     int shift = delay_line_time * sample_frequency;
@@ -0,0 +1,291 @@
+#ifndef MUSYCL_EFFECT_REVERB_HPP
+#define MUSYCL_EFFECT_REVERB_HPP
+
+/** \file Algorithmic reverberation based on a feedback delay network
+
+    https://ccrma.stanford.edu/~jos/pasp/Feedback_Delay_Networks_FDN.html
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+#include <vector>
+
+#include <sycl/sycl.hpp>
+
+#include "../config.hpp"
+
+#include "../audio.hpp"
+#include "../tail.hpp"
+#include "../trace.hpp"
+
+namespace musycl::effect {
+
+/** A reverberation made of a feedback delay network (FDN)
+
+    Each of the \c Lines circular delay lines is read with a slowly
+    modulated fractional delay, damped by a 1-pole low-pass filter,
+    attenuated according to the reverberation time and mixed back
+    into all the lines through an orthogonal matrix.
+
+    All the lines are stored interleaved and processed together as a
+    \c sycl::marray so the per-sample work is done in SIMD across the
+    lines.
+
+    The left input feeds the even lines and the right input the odd
+    ones, which also provide the respective outputs.
+
+    \param Lines is the number of delay lines, a power of 2
+*/
+template <int Lines = 8> class feedback_delay_network {
+  static_assert(Lines >= 2 && (Lines & (Lines - 1)) == 0,
+                "The number of lines has to be a power of 2");
+
+ public:
+  /// A value for each delay line
+  using line_vector = sycl::marray<float, Lines>;
+
+  /// The orthogonal matrices available to mix the line outputs
+  enum class mixing : std::int8_t { hadamard, householder };
+
+  /// Amount of reverberation added to the output, none by default
+  float reverb_ratio = 0;
+
+ private:
+  /// Shortest delay line length in second, for the largest room
+  static constexpr float shortest_line_time = 0.025;
+
+  /// Longest delay line length in second, for the largest room
+  static constexpr float longest_line_time = 0.085;
+
+  /// Maximum modulation depth of the delay lines in second
+  static constexpr float max_modulation_time = 0.002;
+
+  /// Size of the interleaved circular buffer, a power of 2
+  static constexpr int delay_size = [] {
+    int s = 1;
+    while (s < (longest_line_time + max_modulation_time) * sample_frequency +
+                   frame_size + 2)
+      s *= 2;
+    return s;
+  }();
+
+  /// The interleaved circular delay lines
+  std::vector<line_vector> delay_line =
+      std::vector<line_vector>(delay_size, line_vector { 0 });
+
+  /// Index in the delay line of the next sample to write
+  int write_index = 0;
+
+  /// Length of each delay line in samples
+  line_vector length;
+
+  /// Feedback gain of each line to reach the reverberation time
+  line_vector gain;
+
+  /// State of the damping low-pass filter of each line
+  line_vector damping_state { 0 };
+
+  /// Phase of the modulation LFO of each line, between 0 and 1
+  line_vector modulation_phase;
+
+  /// Modulation of each line at the end of the previous frame, in sample
+  line_vector previous_modulation { 0 };
+
+  /// The current room size in ]0, 1]
+  float size = 0.7;
+
+  /// The current reverberation time in second
+  float rt60 = 2;
+
+  /// The damping factor in [ 0, 1 [, 0 for no high-frequency damping
+  float damping = 0.3;
+
+  /// The modulation depth in sample
+  float modulation_depth = 0.0005 * sample_frequency;
+
+  /// The modulation phase increment per frame
+  float modulation_dphase = 0.5f * frame_size / sample_frequency;
+
+  /// The feedback mixing matrix
+  mixing matrix = mixing::hadamard;
+
+  /// Recompute the line lengths and gains from the high-level parameters
+  void update_parameters() {
+    auto is_prime = [](int n) {
+      for (int d = 2; d * d <= n; ++d)
+        if (n % d == 0)
+          return false;
+      return n > 1;
+    };
+    for (int i = 0; i < Lines; ++i) {
+      /* Spread the lengths geometrically and use prime numbers of
+         samples to avoid coinciding echoes */
+      auto t = shortest_line_time *
+               std::pow(longest_line_time / shortest_line_time,
+                        static_cast<float>(i) / (Lines - 1));
+      auto l = static_cast<int>(size * t * sample_frequency);
+      while (!is_prime(l))
+        ++l;
+      length[i] = l;
+      // Attenuation of -60 dB after rt60 seconds
+      gain[i] = std::pow(10.f, -3 * length[i] / (rt60 * sample_frequency));
+    }
+  }
+
+  /// Read the delay line i at a fractional delay with linear interpolation
+  float read(int line, float delay) const {
+    auto position = write_index - delay;
+    auto index = static_cast<int>(std::floor(position));
+    auto fraction = position - index;
+    return delay_line[index & (delay_size - 1)][line] * (1 - fraction) +
+           delay_line[(index + 1) & (delay_size - 1)][line] * fraction;
+  }
+
+  /// Mix the line outputs with the feedback matrix
+  line_vector mix(line_vector v) const {
+    if (matrix == mixing::householder) {
+      // A = I - 2/N 1.1^T
+      float sum = 0;
+      for (int i = 0; i < Lines; ++i)
+        sum += v[i];
+      return v - 2.f * sum / Lines;
+    }
+    // In-place fast Walsh-Hadamard transform, normalized to be orthogonal
+    for (int h = 1; h < Lines; h *= 2)
+      for (int i = 0; i < Lines; i += 2 * h)
+        for (int j = i; j < i + h; ++j) {
+          auto a = v[j];
+          auto b = v[j + h];
+          v[j] = a + b;
+          v[j + h] = a - b;
+        }
+    return v * (1 / std::sqrt(static_cast<float>(Lines)));
+  }
+
+ public:
+  feedback_delay_network() {
+    // Spread the LFO phases across the lines
+    for (int i = 0; i < Lines; ++i)
+      modulation_phase[i] = static_cast<float>(i) / Lines;
+    update_parameters();
+  }
+
+  /** Set the room size in ]0, 1], scaling the delay line lengths
+
+      \return the effect itself to enable command chaining
+  */
+  auto& set_size(float s) {
+    size = std::clamp(s, 0.05f, 1.f);
+    update_parameters();
+    return *this;
+  }
+
+  /** Set the reverberation time in second, for a -60 dB decay
+
+      \return the effect itself to enable command chaining
+  */
+  auto& set_time(float t) {
+    rt60 = std::max(t, 0.01f);
+    update_parameters();
+    return *this;
+  }
+
+  /** Set the high-frequency damping in [ 0, 1 [
+
+      \return the effect itself to enable command chaining
+  */
+  auto& set_damping(float d) {
+    damping = std::clamp(d, 0.f, 0.99f);
+    return *this;
+  }
+
+  /** Set the delay line modulation
+
+      \param[in] depth is the modulation depth in second
+
+      \param[in] frequency is the modulation frequency in Hz
+
+      \return the effect itself to enable command chaining
+  */
+  auto& set_modulation(float depth, float frequency) {
+    modulation_depth =
+        std::clamp(depth, 0.f, max_modulation_time) * sample_frequency;
+    modulation_dphase = frequency * frame_size / sample_frequency;
+    return *this;
+  }
+
+  /** Select the feedback mixing matrix
+
+      \return the effect itself to enable command chaining
+  */
+  auto& set_mixing(mixing m) {
+    matrix = m;
+    return *this;
+  }
+
+  /// Reverberation time in second
+  float time() const { return rt60; }
+
+  /** Number of frames the reverberation lasts after the input became
+      silent, down to the silence threshold and not only -60 dB, so it
+      is not cut while still audible */
+  int tail_frames() const {
+    return frames_from_time(time_to_silence(rt60) + size * longest_line_time +
+                            max_modulation_time);
+  }
+
+  /** Process an audio frame
+
+      \param[inout] audio frame which is processed
+  */
+  void process(audio::frame& audio) {
+    MUSYCL_TRACE_SCOPE("effect::reverb");
+    // Move the modulation LFOs by a frame
+    modulation_phase += modulation_dphase;
+    modulation_phase -= sycl::floor(modulation_phase);
+    line_vector modulation =
+        (sycl::sin(modulation_phase * 2.f * std::numbers::pi_v<float>) + 1.f) *
+        (modulation_depth / 2);
+    // Ramp linearly the modulation across the frame
+    auto modulation_step = (modulation - previous_modulation) / frame_size;
+    auto current_modulation = previous_modulation;
+    previous_modulation = modulation;
+    const float output_gain = 2 / std::sqrt(static_cast<float>(Lines));
+
+    for (auto& s : audio) {
+      current_modulation += modulation_step;
+      auto delay = length + current_modulation;
+      line_vector out;
+      for (int i = 0; i < Lines; ++i)
+        out[i] = read(i, delay[i]);
+      // High-frequency damping with a 1-pole low-pass filter per line
+      damping_state = out * (1 - damping) + damping_state * damping;
+      auto feedback = mix(damping_state * gain);
+      // Inject the input in alternate lines
+      for (int i = 0; i < Lines; i += 2) {
+        feedback[i] += s[audio::left];
+        feedback[i + 1] += s[audio::right];
+      }
+      delay_line[write_index] = feedback;
+      write_index = (write_index + 1) & (delay_size - 1);
+
+      float left = 0;
+      float right = 0;
+      for (int i = 0; i < Lines; i += 2) {
+        left += out[i];
+        right += out[i + 1];
+      }
+      s[audio::left] += reverb_ratio * output_gain * left;
+      s[audio::right] += reverb_ratio * output_gain * right;
+    }
+  }
+};
+
+/// The default reverberation with 8 delay lines
+using reverb = feedback_delay_network<>;
+
+} // namespace musycl::effect
+
+#endif // MUSYCL_EFFECT_REVERB_HPP
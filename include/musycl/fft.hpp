@@ -0,0 +1,111 @@
+#ifndef MUSYCL_FFT_HPP
+#define MUSYCL_FFT_HPP
+
+/** \file A radix-2 fast Fourier transform
+
+    https://en.wikipedia.org/wiki/Cooley%E2%80%93Tukey_FFT_algorithm
+*/
+
+#include <cassert>
+#include <cmath>
+#include <numbers>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace musycl {
+
+/** A complex fast Fourier transform for a power-of-2 size
+
+    The data are kept in split real and imaginary arrays and the
+    twiddle factors are precomputed stage by stage, so every butterfly
+    stage is made of unit-stride loops which can be vectorized by the
+    compiler.
+*/
+class fft {
+  /// Number of complex points of the transform
+  int size;
+
+  /// Index permutation implementing the bit-reversal reordering
+  std::vector<std::pair<int, int>> bit_reverse_swaps;
+
+  /** Twiddle factors of all the stages one after the other
+
+      The stage combining 2 half-transforms of size \c h uses the \c h
+      factors starting at index \c h - 1. */
+  std::vector<float> twiddle_re;
+  std::vector<float> twiddle_im;
+
+  /// In-place decimation-in-time transform with the given direction sign
+  void transform(std::span<float> re, std::span<float> im, float sign) const {
+    assert(re.size() == size && im.size() == size);
+    for (auto [i, j] : bit_reverse_swaps) {
+      std::swap(re[i], re[j]);
+      std::swap(im[i], im[j]);
+    }
+    for (int half = 1; half < size; half *= 2) {
+      const float* w_re = &twiddle_re[half - 1];
+      const float* w_im = &twiddle_im[half - 1];
+      for (int block = 0; block < size; block += 2 * half) {
+        float* a_re = &re[block];
+        float* a_im = &im[block];
+        float* b_re = &re[block + half];
+        float* b_im = &im[block + half];
+        // The butterflies of a block, independent so vectorizable
+        for (int k = 0; k < half; ++k) {
+          auto t_re = b_re[k] * w_re[k] - sign * b_im[k] * w_im[k];
+          auto t_im = b_im[k] * w_re[k] + sign * b_re[k] * w_im[k];
+          b_re[k] = a_re[k] - t_re;
+          b_im[k] = a_im[k] - t_im;
+          a_re[k] += t_re;
+          a_im[k] += t_im;
+        }
+      }
+    }
+  }
+
+ public:
+  /// Prepare a transform of \c n complex points, \c n being a power of 2
+  explicit fft(int n)
+      : size { n } {
+    assert(n > 0 && (n & (n - 1)) == 0 && "the size has to be a power of 2");
+    for (int i = 0, j = 0; i < n; ++i) {
+      if (i < j)
+        bit_reverse_swaps.emplace_back(i, j);
+      // Increment j in bit-reversed order
+      auto bit = n >> 1;
+      for (; j & bit; bit >>= 1)
+        j ^= bit;
+      j |= bit;
+    }
+    // Use a negative exponent, the inverse transform flips the sign
+    for (int half = 1; half < n; half *= 2)
+      for (int k = 0; k < half; ++k) {
+        auto angle = -std::numbers::pi * k / half;
+        twiddle_re.push_back(std::cos(angle));
+        twiddle_im.push_back(std::sin(angle));
+      }
+  }
+
+  /// Number of complex points of the transform
+  int points() const { return size; }
+
+  /// In-place forward transform
+  void forward(std::span<float> re, std::span<float> im) const {
+    transform(re, im, 1);
+  }
+
+  /// In-place inverse transform, including the 1/N normalization
+  void inverse(std::span<float> re, std::span<float> im) const {
+    transform(re, im, -1);
+    const float scale = 1.f / size;
+    for (int i = 0; i < size; ++i) {
+      re[i] *= scale;
+      im[i] *= scale;
+    }
+  }
+};
+
+} // namespace musycl
+
+#endif // MUSYCL_FFT_HPP
@@ -0,0 +1,496 @@
+#ifndef MUSYCL_GRAPH_HPP
+#define MUSYCL_GRAPH_HPP
+
+/** \file An audio processing graph made of generator, filter and
+    effect nodes connected through audio ports
+
+    The nodes are sorted topologically into levels. The nodes of a
+    level only depend on nodes of previous levels so they can be run
+    in parallel by a worker pool. The audio frames flowing between the
+    nodes are stored in a few buffer slots reused according to their
+    liveness.
+
+    A node whose inputs have been silent for longer than its tail is
+    bypassed and produces silence, so an idle graph costs almost
+    nothing.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config.hpp"
+
+#include "audio.hpp"
+#include "tail.hpp"
+#include "trace.hpp"
+
+namespace musycl {
+
+class graph {
+ public:
+  /// The type of the data flowing through the ports
+  using frame = audio::frame;
+
+  /** The processing done by a node for a frame, reading from the
+      input ports and writing to the output ports */
+  using process_function =
+      std::function<void(std::span<const frame* const> inputs,
+                          std::span<frame* const> outputs)>;
+
+ private:
+  /// An output port of a node
+  struct port {
+    int node;
+    int index;
+  };
+
+  /// Slot index used for an unconnected input, reading silence
+  static constexpr int silent_slot = -1;
+
+  struct node {
+    std::string name;
+    int input_number;
+    int output_number;
+    process_function process;
+    /// The output 0 can use the same frame as the input 0
+    bool in_place;
+    /// The sources of each input port, summed if there are several
+    std::vector<std::vector<port>> sources;
+    /** The number of frames the node keeps producing sound after its
+        inputs became silent, never bypassed if empty */
+    std::function<int()> tail;
+    /// Number of consecutive frames with silent inputs
+    int silent_frames = 0;
+    /// The stage timing the node processing
+    trace::stage_id trace_stage;
+
+    /// The topological level, computed by compile()
+    int level;
+    /// The slot of each input and output port, computed by compile()
+    std::vector<int> input_slots;
+    std::vector<int> output_slots;
+    /// The frames read and written by the node, computed by compile()
+    std::vector<const frame*> inputs;
+    std::vector<frame*> outputs;
+    /// The frames to sum for each input with several sources
+    std::vector<std::vector<const frame*>> mixed_inputs;
+    /// The slots of all the sources, to know whether the input is silent
+    std::vector<int> source_slots;
+  };
+
+  /// All the nodes in insertion order
+  std::vector<node> nodes;
+
+  /// The node indices of each level, computed by compile()
+  std::vector<std::vector<int>> levels;
+
+  /// The storage of the frames flowing between the nodes
+  std::vector<frame> slots;
+
+  /** Whether each slot contains silence. Not a std::vector<bool> so
+      parallel nodes can update their own slots */
+  std::vector<std::uint8_t> silent;
+
+  /// The source of the graph output, if any
+  std::optional<port> output_port;
+
+  /// A frame of silence for the unconnected inputs
+  static inline const frame silence {};
+
+  /// Set when the topology changes and the schedule has to be recomputed
+  bool dirty = true;
+
+  /// Threads helping to run the nodes of a level in parallel
+  std::vector<std::jthread> workers;
+
+  /// Synchronize the start and the end of a level among the threads
+  std::barrier<> level_barrier;
+
+  /// The level currently executed by the threads
+  const std::vector<int>* current_level = nullptr;
+
+  /// Index of the next node to execute in the current level
+  std::atomic<int> next_node;
+
+  /// Request the workers to exit
+  std::atomic<bool> stopping = false;
+
+  /// Execute a node
+  void run(node& n) {
+    if (n.tail) {
+      auto silent_input = std::ranges::all_of(
+          n.source_slots, [&](auto s) { return silent[s] != 0; });
+      n.silent_frames =
+          silent_input ? std::min(n.silent_frames + 1, infinite_tail - 1) : 0;
+      if (n.silent_frames > n.tail()) {
+        // Bypass the node since it has nothing to produce
+        for (auto s : n.output_slots) {
+          slots[s].fill(0);
+          silent[s] = true;
+        }
+        return;
+      }
+    }
+    MUSYCL_TRACE_STAGE_SCOPE(n.trace_stage);
+    for (int i = 0; i < n.input_number; ++i)
+      if (!n.mixed_inputs[i].empty()) {
+        // Sum all the sources into the input slot
+        auto& mix = slots[n.input_slots[i]];
+        mix = *n.mixed_inputs[i].front();
+        for (auto source : std::span { n.mixed_inputs[i] }.subspan(1))
+          for (auto&& [m, s] : ranges::views::zip(mix, *source))
+            m += s;
+      }
+    n.process(n.inputs, n.outputs);
+    for (auto s : n.output_slots)
+      silent[s] = is_silent(slots[s]);
+  }
+
+  /// Execute the nodes of the current level until there is none left
+  void run_current_level() {
+    for (int i; (i = next_node++) < current_level->size();)
+      run(nodes[(*current_level)[i]]);
+  }
+
+  /// The loop of a worker thread
+  void work() {
+    if constexpr (trace::enabled)
+      trace::set_thread_name("graph worker");
+    for (;;) {
+      // Wait for a level to start
+      level_barrier.arrive_and_wait();
+      if (stopping)
+        return;
+      run_current_level();
+      // Signal the end of the level
+      level_barrier.arrive_and_wait();
+    }
+  }
+
+  /// Sort the nodes into levels and allocate the slots of the frames
+  void compile() {
+    // Compute the level of each node with a topological sort
+    const int size = nodes.size();
+    std::vector<int> in_degree(size);
+    std::vector<std::vector<int>> successors(size);
+    for (int n = 0; n < size; ++n)
+      for (auto& input : nodes[n].sources)
+        for (auto& p : input) {
+          ++in_degree[n];
+          successors[p.node].push_back(n);
+        }
+    levels.clear();
+    std::vector<int> ready;
+    for (int n = 0; n < size; ++n)
+      if (in_degree[n] == 0)
+        ready.push_back(n);
+    int sorted = 0;
+    while (!ready.empty()) {
+      std::vector<int> next;
+      for (auto n : ready) {
+        nodes[n].level = levels.size();
+        for (auto s : successors[n])
+          if (--in_degree[s] == 0)
+            next.push_back(s);
+      }
+      sorted += ready.size();
+      levels.push_back(std::move(ready));
+      ready = std::move(next);
+    }
+    if (sorted != size)
+      throw std::runtime_error { "graph: the node connections form a cycle" };
+
+    /* Liveness of each output: the last level reading it and its
+       number of readers */
+    constexpr auto forever = std::numeric_limits<int>::max();
+    std::vector<std::vector<int>> last_use(size);
+    std::vector<std::vector<int>> readers(size);
+    for (int n = 0; n < size; ++n) {
+      last_use[n].assign(nodes[n].output_number, nodes[n].level);
+      readers[n].assign(nodes[n].output_number, 0);
+    }
+    for (auto& n : nodes)
+      for (auto& input : n.sources)
+        for (auto& p : input) {
+          last_use[p.node][p.index] =
+              std::max(last_use[p.node][p.index], n.level);
+          ++readers[p.node][p.index];
+        }
+    if (output_port)
+      last_use[output_port->node][output_port->index] = forever;
+
+    // Allocate the slots level by level, reusing the dead ones
+    int slot_number = 0;
+    std::vector<int> slot_end;
+    auto allocate = [&](int end) {
+      for (int s = 0; s < slot_number; ++s)
+        if (slot_end[s] < 0) {
+          slot_end[s] = end;
+          return s;
+        }
+      slot_end.push_back(end);
+      return slot_number++;
+    };
+    for (int l = 0; l < levels.size(); ++l) {
+      // Release the slots no longer read from this level on
+      for (auto& e : slot_end)
+        if (e >= 0 && e < l)
+          e = -1;
+      for (auto index : levels[l]) {
+        auto& n = nodes[index];
+        n.input_slots.assign(n.input_number, silent_slot);
+        n.output_slots.assign(n.output_number, silent_slot);
+        for (int i = 0; i < n.input_number; ++i) {
+          auto& s = n.sources[i];
+          if (s.size() == 1)
+            n.input_slots[i] = nodes[s[0].node].output_slots[s[0].index];
+          else if (s.size() > 1)
+            // A slot to mix the sources, only used by this node
+            n.input_slots[i] = allocate(l);
+        }
+        for (int o = 0; o < n.output_number; ++o) {
+          auto end = last_use[index][o];
+          if (o == 0 && n.in_place && n.input_number > 0 &&
+              n.input_slots[0] != silent_slot) {
+            // Reuse the input slot if this node is its only reader
+            auto& s = n.sources[0];
+            if (s.size() > 1 || (readers[s[0].node][s[0].index] == 1 &&
+                                 last_use[s[0].node][s[0].index] != forever)) {
+              n.output_slots[0] = n.input_slots[0];
+              slot_end[n.input_slots[0]] = end;
+              continue;
+            }
+          }
+          n.output_slots[o] = allocate(end);
+        }
+      }
+    }
+    slots.assign(slot_number, frame {});
+    silent.assign(slot_number, true);
+
+    // Resolve the slots into frame pointers
+    auto address = [&](int slot) {
+      return slot == silent_slot ? &silence : &slots[slot];
+    };
+    for (auto& n : nodes) {
+      n.inputs.clear();
+      n.mixed_inputs.assign(n.input_number, {});
+      n.source_slots.clear();
+      for (int i = 0; i < n.input_number; ++i) {
+        n.inputs.push_back(address(n.input_slots[i]));
+        for (auto& p : n.sources[i]) {
+          auto slot = nodes[p.node].output_slots[p.index];
+          n.source_slots.push_back(slot);
+          if (n.sources[i].size() > 1)
+            n.mixed_inputs[i].push_back(address(slot));
+        }
+      }
+      n.outputs.clear();
+      for (auto s : n.output_slots)
+        n.outputs.push_back(&slots[s]);
+    }
+    dirty = false;
+  }
+
+ public:
+  /** Create a graph
+
+      \param[in] worker_number is the number of threads helping the
+      calling thread to run the independent nodes in parallel
+  */
+  explicit graph(int worker_number = 0)
+      : level_barrier { worker_number + 1 } {
+    for (int w = 0; w < worker_number; ++w)
+      workers.emplace_back([this] { work(); });
+  }
+
+  graph(const graph&) = delete;
+  graph& operator=(const graph&) = delete;
+
+  ~graph() {
+    if (!workers.empty()) {
+      stopping = true;
+      // Release the workers waiting for a level so they can exit
+      level_barrier.arrive_and_wait();
+    }
+  }
+
+  /** Add a node
+
+      \param[in] name is used for diagnostics
+
+      \param[in] inputs is the number of input ports
+
+      \param[in] outputs is the number of output ports
+
+      \param[in] process is called for each frame with the input and
+      output frames
+
+      \param[in] in_place allows output 0 to be the same frame as
+      input 0 to spare a buffer
+
+      \param[in] tail returns the number of frames the node keeps
+      producing sound after its inputs became silent, to bypass it
+      after that. The node is never bypassed without it
+
+      \return the index of the node
+  */
+  int add_node(std::string name, int inputs, int outputs,
+               process_function process, bool in_place = false,
+               std::function<int()> tail = {}) {
+    auto trace_stage = trace::stage(name);
+    nodes.push_back({ .name = std::move(name),
+                      .input_number = inputs,
+                      .output_number = outputs,
+                      .process = std::move(process),
+                      .in_place = in_place,
+                      .sources = std::vector<std::vector<port>>(inputs),
+                      .tail = std::move(tail),
+                      .trace_stage = trace_stage });
+    dirty = true;
+    return nodes.size() - 1;
+  }
+
+  /** Add a node generating a frame without any input
+
+      \return the index of the node
+  */
+  int add_generator(std::string name, std::function<void(frame&)> generate) {
+    return add_node(std::move(name), 0, 1,
+                    [generate = std::move(generate)](auto, auto outputs) {
+                      generate(*outputs[0]);
+                    });
+  }
+
+  /** Add a node with 1 input and 1 output transforming a frame in place
+
+      \param[in] tail returns the number of frames the processing
+      keeps producing sound after its input became silent, to bypass
+      it after that. The node is never bypassed without it
+
+      \return the index of the node
+  */
+  int add_processor(std::string name, std::function<void(frame&)> transform,
+                    std::function<int()> tail = {}) {
+    return add_node(
+        std::move(name), 1, 1,
+        [transform = std::move(transform)](auto inputs, auto outputs) {
+          if (inputs[0] != outputs[0])
+            *outputs[0] = *inputs[0];
+          transform(*outputs[0]);
+        },
+        true, std::move(tail));
+  }
+
+  /** Add an effect like the ones from musycl::effect, which are used
+      by reference
+
+      The effect is bypassed once its tail is over after its input
+      became silent, see musycl::tail_frames().
+
+      \return the index of the node
+  */
+  template <typename Effect>
+    requires requires(Effect e, frame f) { e.process(f); }
+  int add_effect(std::string name, Effect& effect) {
+    return add_processor(
+        std::move(name), [&effect](frame& f) { effect.process(f); },
+        [&effect] { return tail_frames(effect); });
+  }
+
+  /** Connect an output port of a node to an input port of another one
+
+      Several outputs connected to the same input are summed.
+
+      \return the graph itself to enable command chaining
+  */
+  graph& connect(int from, int to, int from_port = 0, int to_port = 0) {
+    if (from_port >= nodes.at(from).output_number ||
+        to_port >= nodes.at(to).input_number)
+      throw std::out_of_range { "graph: connecting " + nodes[from].name +
+                                " to " + nodes[to].name +
+                                " with a non existing port" };
+    nodes[to].sources[to_port].push_back({ from, from_port });
+    dirty = true;
+    return *this;
+  }
+
+  /** Connect a chain of 1-input 1-output nodes
+
+      \return the graph itself to enable command chaining
+  */
+  graph& chain(std::initializer_list<int> node_chain) {
+    for (auto it = node_chain.begin(); it + 1 < node_chain.end(); ++it)
+      connect(it[0], it[1]);
+    return *this;
+  }
+
+  /** Select the node output providing the output of the graph
+
+      \return the graph itself to enable command chaining
+  */
+  graph& set_output(int node, int node_port = 0) {
+    output_port = port { node, node_port };
+    dirty = true;
+    return *this;
+  }
+
+  /// The number of frames used to hold the data between the nodes
+  int slot_number() {
+    if (dirty)
+      compile();
+    return slots.size();
+  }
+
+  /// Display the schedule of the graph
+  void display() {
+    if (dirty)
+      compile();
+    for (int l = 0; l < levels.size(); ++l) {
+      std::cout << "graph level " << l << ':';
+      for (auto n : levels[l])
+        std::cout << ' ' << nodes[n].name;
+      std::cout << std::endl;
+    }
+    std::cout << "graph using " << slots.size() << " frame slots" << std::endl;
+  }
+
+  /** Run all the nodes for a frame
+
+      \param[out] audio receives the output of the graph, if any
+  */
+  void process(frame& audio) {
+    if (dirty)
+      compile();
+    for (auto& level : levels)
+      if (workers.empty() || level.size() == 1)
+        // Not worth waking up the workers
+        for (auto n : level)
+          run(nodes[n]);
+      else {
+        current_level = &level;
+        next_node = 0;
+        level_barrier.arrive_and_wait();
+        run_current_level();
+        level_barrier.arrive_and_wait();
+      }
+    if (output_port)
+      audio = slots[nodes[output_port->node].output_slots[output_port->index]];
+  }
+};
+
+} // namespace musycl
+
+#endif // MUSYCL_GRAPH_HPP
@@ -15,6 +15,7 @@
 //#include "triSYCL/detail/cache.hpp"
 
 #include "musycl/control.hpp"
+#include "musycl/log.hpp"
 #include <musycl/midi/controller/keylab_essential.hpp>
 #include <musycl/user_interface.hpp>
 
@@ -62,8 +63,8 @@ class group {
 
   /// Assign an action to a control item
   void assign(control::physical_item& ci, std::function<void()> f) {
-    std::cout << "Register assign group " << (void*)this << " PI "
-              << (void*)&ci << std::endl;
+    MUSYCL_LOG_DEBUG("Register assign group {} PI {}", (void*)this,
+                     (void*)&ci);
     physical_items.emplace(&ci, f);
   }
 
@@ -78,12 +79,11 @@ class group {
       no action for this control item
    */
   bool try_dispatch(control::physical_item& ci) const {
-    std::cout << "Try dispatch group " << (void*)this << " PI "
-              << (void*)&ci << std::endl;
+    MUSYCL_LOG_DEBUG("Try dispatch group {} PI {}", (void*)this, (void*)&ci);
     auto v = physical_items.find(&ci);
     if (v == physical_items.end())
       return false;
-    std::cerr << "Dispatch from group " << name << std::endl;
+    MUSYCL_LOG_DEBUG("Dispatch from group {}", name);
     v->second();
     return true;
   }
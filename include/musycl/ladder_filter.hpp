@@ -7,7 +7,10 @@
 #include <cmath>
 #include <numbers>
 
+#include "musycl/config.hpp"
+#include "musycl/log.hpp"
 #include "musycl/low_pass_filter.hpp"
+#include "musycl/tail.hpp"
 
 namespace musycl {
 
@@ -21,6 +24,12 @@ class ladder_filter {
   /// Implement the delay for the IIR and FIR
   std::array<low_pass_filter, 4> filters;
 
+  /// Resonance frequency of the filter, 0 while the filter is flat
+  float frequency = 0;
+
+  /// Oversampling factor of the rate at which the filter runs
+  int oversampling = 1;
+
 public:
 
   /** Set the resonance frequency of the filter
@@ -28,9 +37,25 @@ public:
       \return the object itself to enable command chaining
   */
   auto& set_frequency(float f) {
-    std::cout << "resonance_filter frequency = " << f << std::endl;
+    frequency = f;
+    MUSYCL_LOG_TRACE("ladder_filter frequency = {}", f);
     for (auto& filter : filters)
-      filter.set_cutoff_frequency(f);
+      filter.set_cutoff_frequency(f, oversampling*sample_frequency);
+    return *this;
+  }
+
+
+  /** Set the oversampling factor of the rate at which the filter is
+      run, typically by an oversampler to reduce the aliasing of the
+      output clamping
+
+      \return the object itself to enable command chaining
+  */
+  auto& set_oversampling(int factor) {
+    oversampling = factor;
+    // Keep the filter flat if no frequency has been set yet
+    if (frequency > 0)
+      set_frequency(frequency);
     return *this;
   }
 
@@ -44,11 +69,26 @@ public:
   */
   auto& set_resonance(float r) {
     resonance = r;
-    std::cout << "resonance_filter resonance = " << r << std::endl;
+    MUSYCL_LOG_TRACE("ladder_filter resonance = {}", r);
     return *this;
   }
 
 
+  /** Number of frames for the output to decay without input
+
+      This is a rough estimation, considering that the resonance
+      lengthens the decay and that the filter self-oscillates when the
+      resonance reaches 4.
+  */
+  int tail_frames() const {
+    if (resonance >= 4)
+      return infinite_tail;
+    auto stage = filters[0].tail_frames();
+    if (stage == infinite_tail)
+      return infinite_tail;
+    return static_cast<int>(std::ceil(4 * stage / (1 - resonance / 4)));
+  }
+
   /// Get a filtered output from an input value
   float filter(float in) {
     /* Apply 4 low-pass filters in a row with some negative feedback for the
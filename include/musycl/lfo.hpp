@@ -10,6 +10,7 @@
 
 #include "config.hpp"
 #include "clock.hpp"
+#include "log.hpp"
 
 namespace musycl {
 
@@ -61,9 +62,8 @@ public:
   */
   auto& set_frequency(float frequency) {
     dphase = frequency*frame_size/sample_frequency;
-    std::cout << "LFO frequency = " << frequency << " Hz, period = "
-              << 1/frequency << " s, "
-              << static_cast<int>(frequency*60) << " bpm" << std::endl;
+    MUSYCL_LOG_DEBUG("LFO frequency = {} Hz, period = {} s, {} bpm", frequency,
+                     1/frequency, static_cast<int>(frequency*60));
     return *this;
   }
 
@@ -71,7 +71,7 @@ public:
   /// Set the LFO low level of the output
   auto& set_low(float l) {
     low = l;
-    std::cout << "LFO low level = " << low << std::endl;
+    MUSYCL_LOG_DEBUG("LFO low level = {}", low);
     return *this;
   }
 
@@ -79,7 +79,7 @@ public:
   /// Set the LFO high level of the output
   auto& set_high(float h) {
     high = h;
-    std::cout << "LFO high level = " << high << std::endl;
+    MUSYCL_LOG_DEBUG("LFO high level = {}", high);
     return *this;
   }
 
@@ -0,0 +1,290 @@
+#ifndef MUSYCL_LOG_HPP
+#define MUSYCL_LOG_HPP
+
+/** \file Asynchronous logging cheap enough for the audio and MIDI threads
+
+    A log call only copies its format string pointer and its arguments
+    as a binary record into a lock-free queue. A background thread
+    formats the records later and writes them out, so the real-time
+    threads never format, allocate nor wait for the output.
+
+    The messages below MUSYCL_LOG_LEVEL are removed at compile time,
+    without even evaluating their arguments:
+    \code
+    // Compiled out unless MUSYCL_LOG_LEVEL is 1 (debug) or lower
+    MUSYCL_LOG_DEBUG("note {} with volume {}", note, volume);
+    \endcode
+*/
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <ostream>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "mpsc_queue.hpp"
+#include "rt_safety.hpp"
+
+/** The minimum level of the messages compiled in: 0 for trace, 1 for
+    debug, 2 for info, 3 for warning, 4 for error and 5 for nothing */
+#ifndef MUSYCL_LOG_LEVEL
+#define MUSYCL_LOG_LEVEL 2
+#endif
+
+namespace musycl::log {
+
+/// The severity of a message
+enum class level : int { trace, debug, info, warning, error, off };
+
+/// The minimum level of the messages compiled in
+inline constexpr auto compiled_level = static_cast<level>(MUSYCL_LOG_LEVEL);
+
+/// Whether the messages of a level are compiled in
+constexpr bool is_compiled(level l) { return l >= compiled_level; }
+
+/** A string argument copied into the record, truncated to fit, since
+    the original string may be gone when the record is formatted */
+class short_string {
+  std::array<char, 31> characters;
+  std::uint8_t size;
+
+ public:
+  short_string(std::string_view s)
+      : size { static_cast<std::uint8_t>(
+            std::min(s.size(), characters.size())) } {
+    std::copy_n(s.begin(), size, characters.begin());
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const short_string& s) {
+    return os << std::string_view { s.characters.data(), s.size };
+  }
+};
+
+namespace detail {
+
+/// Size of the arguments stored in a record
+inline constexpr std::size_t payload_size = 96;
+
+/** How an argument is stored: the strings are copied, except the
+    character pointers which are assumed to be literals */
+template <typename T>
+using stored_t =
+    std::conditional_t<std::is_convertible_v<const T&, std::string_view> &&
+                           !std::is_convertible_v<const T&, const char*>,
+                       short_string, std::decay_t<const T>>;
+
+/// The binary representation of a message
+struct record {
+  level severity;
+  /// The time since the start of the logger in ns
+  std::uint64_t time;
+  /// The format string, with a {} for each argument
+  const char* format;
+  /// Format the arguments from the payload
+  void (*write)(std::ostream& os, std::string_view format,
+                const std::byte* payload);
+  std::array<std::byte, payload_size> payload;
+};
+
+/// The offset of each argument in the payload
+template <typename... Ts> constexpr auto offsets() {
+  std::array<std::size_t, sizeof...(Ts)> o {};
+  std::size_t position = 0;
+  std::size_t i = 0;
+  ((o[i++] = position, position += sizeof(Ts)), ...);
+  return o;
+}
+
+/// Store an argument into the payload with its stored type
+template <typename T, typename Arg> void store(std::byte* p, const Arg& a) {
+  const T value(a);
+  std::memcpy(p, &value, sizeof(T));
+}
+
+/// Read back an argument from the payload
+template <typename T> T load(const std::byte* p) {
+  std::array<std::byte, sizeof(T)> bytes;
+  std::memcpy(bytes.data(), p, sizeof(T));
+  return std::bit_cast<T>(bytes);
+}
+
+/// Write a message, replacing each {} of the format by an argument
+template <typename... Ts>
+void write(std::ostream& os, std::string_view format,
+           const std::byte* payload) {
+  constexpr auto o = offsets<Ts...>();
+  auto next = [&](const auto& argument) {
+    auto p = format.find("{}");
+    os << format.substr(0, p);
+    if (p == std::string_view::npos) {
+      // More arguments than {}
+      format = {};
+      return;
+    }
+    os << argument;
+    format.remove_prefix(p + 2);
+  };
+  [&]<std::size_t... I>(std::index_sequence<I...>) {
+    (next(load<Ts>(payload + o[I])), ...);
+  }(std::index_sequence_for<Ts...> {});
+  os << format;
+}
+
+/// The state of the logger, with the thread writing the messages
+class logger {
+  /// The records waiting to be written
+  mpsc_queue<record> records { 4096 };
+
+  /// Number of records pushed, to know when everything is written
+  std::atomic<std::uint64_t> pushed = 0;
+
+  /// Number of records written or dropped
+  std::atomic<std::uint64_t> done = 0;
+
+  /// Where the messages go
+  std::atomic<std::ostream*> output = &std::clog;
+
+  /// The time origin of the messages
+  const std::chrono::steady_clock::time_point origin =
+      std::chrono::steady_clock::now();
+
+  /// Start the writing thread only once
+  std::once_flag started;
+
+  /// To check cheaply whether the writing thread is running
+  std::atomic<bool> running = false;
+
+  /// Number of dropped records already reported, by the writing thread
+  std::uint64_t reported_overflows = 0;
+
+  /// Write the waiting records, from the writing thread only
+  void drain() {
+    record r;
+    auto& os = *output.load();
+    while (records.try_pop(r)) {
+      static constexpr std::array<const char*, 5> names { "trace", "debug",
+                                                          "info", "warning",
+                                                          "error" };
+      // Keep the stream formatting for the arguments of the messages
+      std::array<char, 32> time;
+      std::snprintf(time.data(), time.size(), "%.6f", r.time / 1e9);
+      os << '[' << names[static_cast<int>(r.severity)] << ' ' << time.data()
+         << "] ";
+      r.write(os, r.format, r.payload.data());
+      os << '\n';
+      ++done;
+    }
+    if (auto o = records.overflow_count(); o != reported_overflows) {
+      os << "[warning] " << o - reported_overflows
+         << " log messages dropped since the queue was full\n";
+      reported_overflows = o;
+    }
+    os.flush();
+  }
+
+ public:
+  /// Start the thread writing the messages, if not already done
+  void start() {
+    std::call_once(started, [this] {
+      // Detached since the program may end with std::quick_exit()
+      std::thread { [this] {
+        for (;;) {
+          drain();
+          std::this_thread::sleep_for(std::chrono::milliseconds { 10 });
+        }
+      } }.detach();
+      running = true;
+    });
+  }
+
+  /// Queue a message, from any thread
+  template <typename... Args>
+  void push(level severity, const char* format, const Args&... args) {
+    static_assert((std::is_trivially_copyable_v<stored_t<Args>> && ...),
+                  "log arguments have to be trivially copyable or strings");
+    static_assert((sizeof(stored_t<Args>) + ... + 0) <= payload_size,
+                  "too many log arguments");
+    if (!running.load(std::memory_order_relaxed)) {
+      // The thread is started only once
+      MUSYCL_RT_SAFETY_ALLOW();
+      start();
+    }
+    record r {};
+    r.severity = severity;
+    r.time = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - origin)
+            .count());
+    r.format = format;
+    r.write = &detail::write<stored_t<Args>...>;
+    constexpr auto o = offsets<stored_t<Args>...>();
+    [&]<std::size_t... I>(std::index_sequence<I...>) {
+      (store<stored_t<Args>>(r.payload.data() + o[I], args), ...);
+    }(std::index_sequence_for<Args...> {});
+    ++pushed;
+    if (!records.try_push(r))
+      ++done;
+  }
+
+  /// Wait for all the messages queued so far to be written
+  void flush() {
+    auto target = pushed.load();
+    while (done.load() < target)
+      std::this_thread::sleep_for(std::chrono::milliseconds { 1 });
+  }
+
+  /// Send the messages to another stream
+  void set_output(std::ostream& os) { output = &os; }
+};
+
+inline logger& state() {
+  static logger l;
+  return l;
+}
+
+} // namespace detail
+
+/** Start the thread writing the messages
+
+    Otherwise it is started by the first message, which is better to
+    avoid on a real-time thread.
+*/
+inline void start() { detail::state().start(); }
+
+/// Wait for all the messages logged so far to be written
+inline void flush() { detail::state().flush(); }
+
+/// Send the messages to another stream than std::clog
+inline void set_output(std::ostream& os) { detail::state().set_output(os); }
+
+} // namespace musycl::log
+
+/// Log a message of some level if it is compiled in
+#define MUSYCL_LOG(severity, ...)                                            \
+  do {                                                                       \
+    if constexpr (::musycl::log::is_compiled(severity))                     \
+      ::musycl::log::detail::state().push(severity, __VA_ARGS__);           \
+  } while (false)
+
+#define MUSYCL_LOG_TRACE(...)                                                \
+  MUSYCL_LOG(::musycl::log::level::trace, __VA_ARGS__)
+#define MUSYCL_LOG_DEBUG(...)                                                \
+  MUSYCL_LOG(::musycl::log::level::debug, __VA_ARGS__)
+#define MUSYCL_LOG_INFO(...) MUSYCL_LOG(::musycl::log::level::info, __VA_ARGS__)
+#define MUSYCL_LOG_WARNING(...)                                              \
+  MUSYCL_LOG(::musycl::log::level::warning, __VA_ARGS__)
+#define MUSYCL_LOG_ERROR(...)                                                \
+  MUSYCL_LOG(::musycl::log::level::error, __VA_ARGS__)
+
+#endif // MUSYCL_LOG_HPP
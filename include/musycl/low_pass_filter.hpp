@@ -4,10 +4,11 @@
 #define MUSYCL_LOW_PASS_FILTER_HPP
 
 #include <cmath>
-#include <iostream>
 #include <numbers>
 
 #include <musycl/config.hpp>
+#include <musycl/log.hpp>
+#include <musycl/tail.hpp>
 
 namespace musycl {
 
@@ -35,23 +36,41 @@ public:
   */
   auto& set_smoothing_factor(float sf) {
     smoothing_factor = sf;
-    std::cout << "low_pass_filter smoothing_factor = " << sf << std::endl;
+    MUSYCL_LOG_TRACE("low_pass_filter smoothing_factor = {}", sf);
     return *this;
   }
 
 
   /** Set the cutoff frequency of the filter
 
+      \param[in] cf is the cutoff frequency in Hz
+
+      \param[in] rate is the sampling frequency at which the filter
+      runs, higher than sample_frequency when it is oversampled
+
       \return the object itself to enable command chaining
   */
-  auto& set_cutoff_frequency(float cf) {
-    std::cout << "low_pass_filter cutoff frequency = " << cf << std::endl;
-    set_smoothing_factor(2*std::numbers::pi*cf/sample_frequency
-                         /(2*std::numbers::pi*cf/sample_frequency + 1));
+  auto& set_cutoff_frequency(float cf, float rate = sample_frequency) {
+    MUSYCL_LOG_TRACE("low_pass_filter cutoff frequency = {}", cf);
+    set_smoothing_factor(2*std::numbers::pi*cf/rate
+                         /(2*std::numbers::pi*cf/rate + 1));
     return *this;
   }
 
 
+  /// Number of frames for the output to decay to silence without input
+  int tail_frames() const {
+    if (smoothing_factor >= 1)
+      return 0;
+    if (smoothing_factor <= 0)
+      return infinite_tail;
+    // Each sample the output is multiplied by 1 - smoothing_factor
+    return frames_from_time(std::log(silence_threshold)
+                            / std::log(1 - smoothing_factor)
+                            / sample_frequency);
+  }
+
+
   /// Get a filtered output from an input value
   float filter(float in) {
     // 1 single-tap IIR filter
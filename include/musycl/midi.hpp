@@ -8,13 +8,23 @@
     "MIDI 1.0 Detailed Specification", Document Version 4.2.1, Revised
     February 1996
     https://www.midi.org/specifications/midi1-specifications/m1-v4-2-1-midi-1-0-detailed-specification-96-1-4
+
+    The MIDI messages are small trivially copyable objects and the
+    parsing does not allocate memory, so they can be used from
+    real-time threads.
 */
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
 #include <cmath>
+#include <cstddef>
 #include <cstdint>
+#include <span>
 #include <string>
+#include <type_traits>
 #include <variant>
-#include <vector>
 
 #include <range/v3/all.hpp>
 
@@ -338,17 +348,78 @@ class sysex_header {
                           const sysex_header&) = default;
 };
 
+/** Storage of the SysEx payloads out of the MIDI messages
+
+    The payloads are copied into a preallocated circular buffer, so a
+    SysEx message is just a reference to its payload. A payload
+    remains valid until \c capacity more bytes of SysEx have been
+    received, which is plenty for the few SysEx messages in flight.
+*/
+class sysex_arena {
+ public:
+  /// The size of the buffer, dividing 2^32 so the positions can wrap around
+  static constexpr std::uint32_t capacity = 1 << 16;
+
+ private:
+  /// The circular buffer holding the payloads
+  std::array<std::uint8_t, capacity> storage;
+
+  /// Number of bytes reserved since the beginning, modulo 2^32
+  std::atomic<std::uint32_t> cursor = 0;
+
+ public:
+  /** Store a payload
+
+      This is lock-free and can be used by several threads at the
+      same time.
+
+      \return the position of the payload
+  */
+  std::uint32_t store(std::span<const std::uint8_t> payload) {
+    assert(payload.size() <= capacity);
+    std::uint32_t size = payload.size();
+    auto position = cursor.load(std::memory_order_relaxed);
+    std::uint32_t start;
+    do {
+      // Skip the end of the buffer if the payload does not fit before it
+      start = position;
+      if (auto room = capacity - start % capacity; room < size)
+        start += room;
+    } while (!cursor.compare_exchange_weak(position, start + size,
+                                           std::memory_order_relaxed));
+    std::ranges::copy(payload, storage.begin() + start % capacity);
+    return start;
+  }
+
+  /// Access to a payload from its position and size
+  std::span<const std::uint8_t> view(std::uint32_t position,
+                                     std::uint32_t size) const {
+    return { storage.data() + position % capacity, size };
+  }
+
+  /// Check that a payload has not been overwritten yet
+  bool valid(std::uint32_t position, std::uint32_t size) const {
+    return cursor.load(std::memory_order_relaxed) - position <= capacity;
+  }
+};
+
 /// The MIDI "System Exclusive" message
 class sysex : public sysex_header {
- public:
-  using value_type = std::vector<std::uint8_t>;
+  /// Position of the payload in the arena
+  std::uint32_t position;
 
-  /// The value associated to this control change
-  value_type v;
+  /// Size of the payload in byte
+  std::uint32_t size;
 
-  /// Construct the SysEx from 2 iterators
-  template <typename Iterator1, typename Iterator2>
-  sysex(Iterator1 begin, Iterator2 end) : v { begin, end } {}
+ public:
+  /// The storage of the payloads of all the SysEx messages
+  static inline sysex_arena arena;
+
+  /** Construct the SysEx from its payload, without the 0xf0 and 0xf7
+      framing bytes, which is copied into the arena */
+  explicit sysex(std::span<const std::uint8_t> payload)
+      : position { arena.store(payload) }
+      , size { static_cast<std::uint32_t>(payload.size()) } {}
 
   /// Get the header of this message
   const sysex_header& header() const { return *this; }
@@ -357,12 +428,20 @@ class sysex : public sysex_header {
   template <class CharT, class Traits>
   friend std::basic_ostream<CharT, Traits>&
   operator<<(std::basic_ostream<CharT, Traits>& os, const sysex& s) {
-    return os << "sysex: " << s.header()
-              << " value: " << ranges::views::all(s.v);
+    os << "sysex: " << s.header() << " value: [";
+    for (const char* separator = ""; auto b : s.value()) {
+      os << separator << int { b };
+      separator = ",";
+    }
+    return os << ']';
   }
 
-  /// The raw value
-  value_type value() { return v; }
+  /// The payload, which is empty if it has already been overwritten
+  std::span<const std::uint8_t> value() const {
+    if (!arena.valid(position, size))
+      return {};
+    return arena.view(position, size);
+  }
 };
 
 /** A MIDI message can be one of different types, including the
@@ -370,6 +449,9 @@ class sysex : public sysex_header {
 using msg = std::variant<std::monostate, midi::on, midi::off,
                          midi::control_change, midi::pitch_bend, midi::sysex>;
 
+static_assert(std::is_trivially_copyable_v<msg>,
+              "MIDI messages are copied around in real-time code");
+
 /// Output the MIDI message value to a standard output stream
 template <class CharT, class Traits>
 std::basic_ostream<CharT, Traits>&
@@ -457,40 +539,194 @@ static inline std::int8_t channel(std::uint8_t first_byte) {
   return first_byte & 0b1111;
 }
 
-/// Parse a MIDI byte message into a specific MIDI instruction
-inline msg parse(const std::vector<std::uint8_t>& midi_message) {
-  msg m;
-  if (!midi_message.empty()) {
-    auto sh = status_high(midi_message[0]);
-    /// Interesting MIDI messages have 3 bytes
-    if (midi_message.size() == 3) {
-      if (sh == 9 && midi_message[2] != 0)
-        // Start the note on the given channel if the velocity is non 0
-        m = midi::on { channel(midi_message[0]), midi_message[1],
-                       midi_message[2] };
-      else if (sh == 8 //< Note-off status
-                       // But a note-on with a 0-velocity means also a note-off
-               || (sh == 9 && midi_message[2] == 0))
-        // Stop the note on the given channel
-        m = midi::off { channel(midi_message[0]), midi_message[1],
-                        midi_message[2] };
-      else if (sh == 0xb)
-        // This is a control change message
-        m = midi::control_change { channel(midi_message[0]), midi_message[1],
-                                   midi_message[2] };
-      else if (sh == 0xe)
-        // This is a control change message
-        m = midi::pitch_bend { channel(midi_message[0]),
-                               midi_message[1] | (midi_message[2] << 7) };
+/** Incremental parser of a MIDI byte stream
+
+    It handles the running status, the real-time messages interleaved
+    anywhere, even inside a SysEx message, and the SysEx messages
+    split across several chunks of bytes, without any memory
+    allocation. The real-time messages and the messages without a
+    musycl::midi::msg alternative are skipped.
+*/
+class parser {
+ public:
+  /// The longest SysEx payload accepted, longer ones are dropped
+  static constexpr std::size_t max_sysex_size = 1024;
+
+ private:
+  /// The current status byte, used as running status, 0 if none
+  std::uint8_t status = 0;
+
+  /// The data bytes received for the current message
+  std::array<std::uint8_t, 2> data;
+
+  /// Number of data bytes received for the current message
+  int data_count = 0;
+
+  /// Whether a SysEx message is being received
+  bool in_sysex = false;
+
+  /// The payload of the SysEx being received
+  std::array<std::uint8_t, max_sysex_size> sysex_payload;
+
+  /// Size of the SysEx payload received so far
+  std::size_t sysex_size = 0;
+
+  /// Whether the SysEx being received is too long to be kept
+  bool sysex_overflow = false;
+
+  /// Number of data bytes following a status byte
+  static int data_length(std::uint8_t status) {
+    switch (status_high(status)) {
+    case 0xc: // Program change
+    case 0xd: // Channel pressure
+      return 1;
+    case 0xf:
+      // System common messages
+      return status == 0xf2 ? 2 : status == 0xf1 || status == 0xf3 ? 1 : 0;
+    default:
+      return 2;
+    }
+  }
+
+  /// Build the message from the status and data bytes
+  msg decode() const {
+    auto sh = status_high(status);
+    if (sh == 9 && data[1] != 0)
+      // Start the note on the given channel if the velocity is non 0
+      return midi::on { channel(status), data[0], data[1] };
+    if (sh == 8 //< Note-off status
+                // But a note-on with a 0-velocity means also a note-off
+        || sh == 9)
+      // Stop the note on the given channel
+      return midi::off { channel(status), data[0], data[1] };
+    if (sh == 0xb)
+      // This is a control change message
+      return midi::control_change { channel(status), data[0], data[1] };
+    if (sh == 0xe)
+      // This is a pitch bend message
+      return midi::pitch_bend { channel(status), data[0] | (data[1] << 7) };
+    return {};
+  }
+
+ public:
+  /** Parse the next byte of the stream
+
+      \param[in] byte is the next byte
+
+      \param[out] m receives the message completed by this byte if any
+
+      \return true if a message has been completed
+  */
+  bool parse(std::uint8_t byte, msg& m) {
+    // Real-time messages can appear anywhere and change nothing
+    if (byte >= 0xf8)
+      return false;
+    if (byte & 0x80) {
+      // A status byte, which also ends any SysEx message
+      if (in_sysex) {
+        in_sysex = false;
+        if (byte == 0xf7 && !sysex_overflow) {
+          m = midi::sysex { std::span { sysex_payload.data(), sysex_size } };
+          return true;
+        }
+      }
+      data_count = 0;
+      // The system messages cancel the running status
+      status = byte < 0xf0 ? byte : 0;
+      if (byte == 0xf0) {
+        in_sysex = true;
+        sysex_size = 0;
+        sysex_overflow = false;
+      } else if (byte > 0xf0 && data_length(byte) > 0)
+        // Keep the status only to skip the data bytes
+        status = byte;
+      return false;
     }
-    // A SysEx message start with 0xf0 and ends with 0xf7
-    else if (midi_message[0] == 0xf0 && *std::prev(midi_message.end()) == 0xf7)
-      m = midi::sysex { &midi_message[1],
-                        &midi_message[midi_message.size() - 1] };
+    // A data byte
+    if (in_sysex) {
+      if (sysex_size < max_sysex_size)
+        sysex_payload[sysex_size++] = byte;
+      else
+        sysex_overflow = true;
+      return false;
+    }
+    if (status == 0)
+      // Some data without status to skip
+      return false;
+    data[data_count++] = byte;
+    if (data_count < data_length(status))
+      return false;
+    data_count = 0;
+    if (status >= 0xf0) {
+      // The system common messages are not kept as running status
+      status = 0;
+      return false;
+    }
+    m = decode();
+    return !std::holds_alternative<std::monostate>(m);
   }
+
+  /** Parse a chunk of the byte stream
+
+      \param[in] bytes is the next chunk of the stream
+
+      \param[in] emit is called with each message completed
+  */
+  template <typename Callable>
+  void parse(std::span<const std::uint8_t> bytes, Callable&& emit) {
+    msg m;
+    for (auto b : bytes)
+      if (parse(b, m))
+        emit(m);
+  }
+};
+
+/** Parse a MIDI byte message into a specific MIDI instruction
+
+    \return the last message of the bytes, or an empty message
+*/
+inline msg parse(std::span<const std::uint8_t> midi_message) {
+  parser p;
+  msg m;
+  p.parse(midi_message, [&](const msg& e) { m = e; });
   return m;
 }
 
+/** Encode a MIDI message into its byte representation
+
+    \param[in] m is the message to encode, an empty message producing
+    nothing
+
+    \param[out] out is where to write the bytes
+
+    \return the output iterator after the last byte written
+*/
+template <typename OutputIterator>
+OutputIterator encode(const msg& m, OutputIterator out) {
+  auto put = [&](auto... bytes) {
+    ((*out++ = static_cast<std::uint8_t>(bytes)), ...);
+  };
+  std::visit(
+      [&](const auto& e) {
+        using type = std::remove_cvref_t<decltype(e)>;
+        if constexpr (std::is_same_v<type, on>)
+          put(0x90 | e.channel, e.note, e.velocity);
+        else if constexpr (std::is_same_v<type, off>)
+          put(0x80 | e.channel, e.note, e.velocity);
+        else if constexpr (std::is_same_v<type, control_change>)
+          put(0xb0 | e.channel, e.number, e.value);
+        else if constexpr (std::is_same_v<type, pitch_bend>)
+          put(0xe0 | e.channel, e.v & 0x7f, e.v >> 7);
+        else if constexpr (std::is_same_v<type, sysex>) {
+          put(0xf0);
+          out = std::ranges::copy(e.value(), out).out;
+          put(0xf7);
+        }
+      },
+      m);
+  return out;
+}
+
 } // namespace musycl::midi
 
 #endif // MUSYCL_MIDI_HPP
@@ -6,11 +6,15 @@
     Represent a MIDI controller like the Arturia KeyLab49 Essential
  */
 
+#include <array>
+#include <cassert>
 #include <chrono>
+#include <cstdint>
 #include <cstdlib>
 #include <functional>
 #include <iomanip>
 #include <iostream>
+#include <span>
 #include <string>
 #include <thread>
 #include <tuple>
@@ -63,6 +67,20 @@ using namespace std::chrono_literals;
     /// The user interface logic
     user_interface& ui;
 
+    /// Coalescing key of the display messages, only the latest is sent
+    static constexpr std::uint32_t display_key = 1;
+
+    /** First coalescing key of the button light messages, each button
+        has its own key */
+    static constexpr std::uint32_t button_light_key = 0x100;
+
+    /// The light level sent to each button, -1 if unknown
+    std::array<std::int8_t, 128> light_levels = [] {
+      std::array<std::int8_t, 128> l;
+      l.fill(-1);
+      return l;
+    }();
+
     /** Button light fuzzing
 
         Experiment with some light commands
@@ -319,30 +337,71 @@ using namespace std::chrono_literals;
                                       [this](auto) { refresh_display(); });
     }
 
-    /** Send a MIDI SysEx message by prepending SysEx Start and
-        appending SysEx End
+    /// A buffer on the stack large enough for any MIDI output message
+    using message_buffer = std::array<std::uint8_t, midi_out::max_message_size>;
+
+    /** Encode a MIDI SysEx message by prepending SysEx Start and
+        appending SysEx End, without any memory allocation
 
-        \return a copy of the full MIDI message sent, for example for
-        later replay.
+        \param[out] buffer receives the message
+
+        \return the message in the buffer, empty if it does not fit
      */
-    template <typename... Ranges> auto send_sysex(Ranges&&... messages) {
+    template <typename... Ranges>
+    static std::span<const std::uint8_t> encode_sysex(message_buffer& buffer,
+                                                      Ranges&&... messages) {
       static auto constexpr sysex_start = { '\xf0' };
       static auto constexpr sysex_end = { '\xf7' };
 
-      auto sysex_message = ranges::to<std::vector<std::uint8_t>>(
-          ranges::views::concat(sysex_start, sysex_id, dev_id, sub_dev_id,
-                               messages..., sysex_end));
-      midi_out::write(sysex_message);
-      return sysex_message;
+      std::size_t size = 0;
+      auto append = [&](auto&& range) {
+        for (auto c : range) {
+          if (size < buffer.size())
+            buffer[size] = c;
+          ++size;
+        }
+      };
+      append(sysex_start);
+      append(sysex_id);
+      append(dev_id);
+      append(sub_dev_id);
+      (append(messages), ...);
+      append(sysex_end);
+      assert(size <= buffer.size() && "SysEx message too long");
+      if (size > buffer.size())
+        return {};
+      return { buffer.data(), size };
+    }
+
+    /** Send a MIDI SysEx message by prepending SysEx Start and
+        appending SysEx End
+
+        \param[in] key is the coalescing key of the message, a pending
+        message with the same key being replaced by this one, or
+        midi_out::no_coalescing
+
+        \return true if the message is queued, false if it is dropped
+     */
+    template <typename... Ranges>
+    bool send_sysex(std::uint32_t key, Ranges&&... messages) {
+      message_buffer buffer;
+      auto sysex_message = encode_sysex(buffer, messages...);
+      return !sysex_message.empty() && midi_out::try_write(sysex_message, key);
     }
 
     /// Return the underlying user interface
     user_interface& get_user_interface() { return ui; }
 
     void button_light(std::int8_t button, std::int8_t level) {
+      // Skip the update if the light is already at this level
+      if (light_levels[button & 0x7f] == level)
+        return;
       static auto constexpr sysex_button_light = { '\x2', '\0', '\x10' };
-      send_sysex(sysex_button_light, ranges::views::single(button),
-                 ranges::views::single(level));
+      // Remember the level only once sent, to retry a dropped message
+      if (send_sysex(button_light_key + (button & 0x7f), sysex_button_light,
+                     ranges::views::single(button),
+                     ranges::views::single(level)))
+        light_levels[button & 0x7f] = level;
     }
 
     /// Store the last displayed message to refresh the display regularly
@@ -361,11 +420,18 @@ using namespace std::chrono_literals;
                }) |
                ranges::views::join;
       static auto constexpr sysex_display_command = { '\x4', '\0', '\x60' };
-      last_displayed_sysex_message = send_sysex(sysex_display_command, r);
+      message_buffer buffer;
+      auto sysex_message = encode_sysex(buffer, sysex_display_command, r);
+      // Keep a copy for later replay
+      last_displayed_sysex_message.assign(sysex_message.begin(),
+                                          sysex_message.end());
+      midi_out::try_write(sysex_message, display_key);
     }
 
     /// Refresh the LCD display with the last displayed message
-    void refresh_display() { midi_out::write(last_displayed_sysex_message); }
+    void refresh_display() {
+      midi_out::write(last_displayed_sysex_message, display_key);
+    }
 
     /** Display a blinking cursor
 
@@ -379,7 +445,7 @@ using namespace std::chrono_literals;
     void blink() {
       static auto constexpr blink_display_command = { '\x4', '\0', '\x60', '\0',
                                                       '\0' };
-      send_sysex(blink_display_command);
+      send_sysex(midi_out::no_coalescing, blink_display_command);
     }
 
     /// This is notified on each beat by the clocking framework
@@ -0,0 +1,185 @@
+#ifndef MUSYCL_MIDI_DISPATCH_TABLE_HPP
+#define MUSYCL_MIDI_DISPATCH_TABLE_HPP
+
+/** \file A dense table to find in constant time the actions to run on
+    a MIDI message
+*/
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+#include "musycl/midi.hpp"
+
+namespace musycl::midi {
+
+/** The actions to run on the MIDI messages, indexed by port, message
+    kind, channel and first data byte
+
+    The actions are registered during the setup and compiled into a
+    table of ranges over a contiguous array of actions, so finding
+    the actions of a message is a mere indexing, without any
+    comparison nor memory allocation.
+
+    \param Ports is the number of MIDI ports
+*/
+template <int Ports> class dispatch_table {
+ public:
+  /// An action to run on a MIDI message
+  using action = std::function<void(const msg&)>;
+
+ private:
+  /// Number of MIDI channels
+  static constexpr int channels = 16;
+
+  /// Number of values of a MIDI data byte
+  static constexpr int data_values = 128;
+
+  /// The message kinds keyed also by their first data byte
+  enum keyed_kind { note_on, note_off, control_change_kind, keyed_kinds };
+
+  /// The first key of the pitch bend messages, keyed only by channel
+  static constexpr int pitch_bend_key = keyed_kinds * channels * data_values;
+
+  /// The key of the SysEx messages
+  static constexpr int sysex_key = pitch_bend_key + channels;
+
+  /// Number of keys for each port
+  static constexpr int keys_per_port = sysex_key + 1;
+
+  /// An action as registered, before compilation
+  struct registration {
+    int port;
+    int key;
+    action a;
+  };
+
+  /// The actions in registration order
+  std::vector<registration> registrations;
+
+  /// The actions sorted by port and key
+  std::vector<action> actions;
+
+  /// A range of actions for a key
+  struct range {
+    std::uint32_t first;
+    std::uint32_t last;
+  };
+
+  /// The ranges of actions for each key of the ports with actions
+  std::vector<range> ranges;
+
+  /// Index in \c ranges of the table of each port, -1 if no action
+  std::array<int, Ports> port_tables;
+
+  /// Whether some actions have been registered since the compilation
+  bool dirty = false;
+
+  /// Compute the key of a message kind keyed by its first data byte
+  static int keyed(keyed_kind kind, int channel, int data) {
+    assert(0 <= channel && channel < channels);
+    assert(0 <= data && data < data_values);
+    return (kind * channels + channel) * data_values + data;
+  }
+
+  static int key(const on_header& h) {
+    return keyed(note_on, h.channel, h.note);
+  }
+
+  static int key(const off_header& h) {
+    return keyed(note_off, h.channel, h.note);
+  }
+
+  static int key(const control_change_header& h) {
+    return keyed(control_change_kind, h.channel, h.number);
+  }
+
+  static int key(const pitch_bend_header& h) {
+    assert(0 <= h.channel && h.channel < channels);
+    return pitch_bend_key + h.channel;
+  }
+
+  static int key(const sysex_header&) { return sysex_key; }
+
+  /// The key of a message, -1 for an empty message
+  static int key(const msg& m) {
+    return std::visit(
+        [](const auto& e) {
+          if constexpr (std::is_same_v<decltype(e), const std::monostate&>)
+            return -1;
+          else
+            return key(e.header());
+        },
+        m);
+  }
+
+  /// Build the table from the registered actions
+  void compile() {
+    auto sorted = registrations;
+    std::ranges::stable_sort(sorted, [](auto& a, auto& b) {
+      return std::pair { a.port, a.key } < std::pair { b.port, b.key };
+    });
+    actions.clear();
+    ranges.clear();
+    port_tables.fill(-1);
+    for (auto it = sorted.begin(); it != sorted.end();) {
+      auto port = it->port;
+      port_tables[port] = ranges.size();
+      ranges.resize(ranges.size() + keys_per_port, { 0, 0 });
+      auto table = ranges.begin() + port_tables[port];
+      for (; it != sorted.end() && it->port == port; ++it) {
+        auto& r = table[it->key];
+        if (r.first == r.last)
+          r.first = r.last = actions.size();
+        actions.push_back(it->a);
+        ++r.last;
+      }
+    }
+    dirty = false;
+  }
+
+ public:
+  dispatch_table() { port_tables.fill(-1); }
+
+  /** Register an action
+
+      \param[in] port is the MIDI port
+
+      \param[in] header is the header of the messages triggering the
+      action, such as a musycl::midi::control_change_header
+
+      \param[in] a is the action to run with the message
+  */
+  template <typename Header>
+  void add(int port, const Header& header, action a) {
+    assert(0 <= port && port < Ports);
+    registrations.push_back({ port, key(header), std::move(a) });
+    dirty = true;
+  }
+
+  /** Run the actions registered for a message, in registration order
+
+      The table is compiled on the first dispatch after a
+      registration, which allocates memory, so the registrations
+      should be done during the setup.
+  */
+  void dispatch(int port, const msg& m) {
+    if (dirty)
+      compile();
+    auto k = key(m);
+    if (k < 0 || port_tables[port] < 0)
+      return;
+    auto [first, last] = ranges[port_tables[port] + k];
+    for (auto i = first; i != last; ++i)
+      actions[i](m);
+  }
+};
+
+} // namespace musycl::midi
+
+#endif // MUSYCL_MIDI_DISPATCH_TABLE_HPP
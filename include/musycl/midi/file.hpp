@@ -0,0 +1,348 @@
+#ifndef MUSYCL_MIDI_FILE_HPP
+#define MUSYCL_MIDI_FILE_HPP
+
+/** \file Read and write Standard MIDI Files (SMF)
+
+    https://www.midi.org/specifications/file-format-specifications/standard-midi-files
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include "musycl/midi.hpp"
+
+namespace musycl::midi {
+
+/** The MIDI messages of a file with their timing, all the tracks merged
+
+    The SysEx payloads are owned by the sequence, since the arena of
+    musycl::midi::sysex is recycled by the live SysEx messages, and
+    they are copied into the arena only when the event is played.
+*/
+struct sequence {
+  /// A MIDI message at some time
+  struct event {
+    /// Time of the message in tick from the beginning
+    std::uint32_t tick;
+    /// The message, empty for a SysEx whose payload is in the sequence
+    msg m;
+    /// Whether it is a SysEx message with its payload in the sequence
+    bool is_sysex = false;
+    /// Position of the SysEx payload in sysex_payloads
+    std::uint32_t sysex_position = 0;
+    /// Size of the SysEx payload
+    std::uint32_t sysex_size = 0;
+  };
+
+  /// A change of tempo at some time
+  struct tempo_change {
+    /// Time of the change in tick from the beginning
+    std::uint32_t tick;
+    /// The new tempo as the duration of a quarter note in microsecond
+    std::uint32_t microseconds_per_quarter;
+  };
+
+  /// The default tempo of a MIDI file, 120 beats per minute
+  static constexpr std::uint32_t default_microseconds_per_quarter = 500'000;
+
+  /// The time resolution of the ticks
+  int ticks_per_quarter = 480;
+
+  /// The messages of all the tracks, sorted by time
+  std::vector<event> events;
+
+  /// The payloads of the SysEx events one after the other
+  std::vector<std::uint8_t> sysex_payloads;
+
+  /// The tempo changes, sorted by time and starting at tick 0
+  std::vector<tempo_change> tempo_map { { 0,
+                                          default_microseconds_per_quarter } };
+
+  /// Append a SysEx event, copying its payload into the sequence
+  void add_sysex(std::uint32_t tick, std::span<const std::uint8_t> payload) {
+    events.push_back({ .tick = tick,
+                       .is_sysex = true,
+                       .sysex_position =
+                           static_cast<std::uint32_t>(sysex_payloads.size()),
+                       .sysex_size = static_cast<std::uint32_t>(
+                           payload.size()) });
+    sysex_payloads.insert(sysex_payloads.end(), payload.begin(),
+                          payload.end());
+  }
+
+  /// Append an event, copying the payload of a SysEx into the sequence
+  void add(std::uint32_t tick, const msg& m) {
+    if (auto sx = std::get_if<sysex>(&m))
+      add_sysex(tick, sx->value());
+    else
+      events.push_back({ tick, m });
+  }
+
+  /// The SysEx payload of an event, empty for the other messages
+  std::span<const std::uint8_t> sysex_payload(const event& e) const {
+    return { sysex_payloads.data() + e.sysex_position, e.sysex_size };
+  }
+
+  /** The message of an event, with the payload of a SysEx copied into
+      the arena of musycl::midi::sysex to be sent */
+  msg message(const event& e) const {
+    if (e.is_sysex)
+      return sysex { sysex_payload(e) };
+    return e.m;
+  }
+
+  /// The time of the last event in tick
+  std::uint32_t length() const {
+    return events.empty() ? 0 : events.back().tick;
+  }
+
+  /// Convert a time in tick to a time in second according to the tempo map
+  double seconds(std::uint32_t tick) const {
+    double s = 0;
+    for (std::size_t i = 0; i < tempo_map.size(); ++i) {
+      auto end = i + 1 < tempo_map.size()
+                     ? std::min(tick, tempo_map[i + 1].tick)
+                     : tick;
+      if (end <= tempo_map[i].tick)
+        break;
+      s += (end - tempo_map[i].tick) * 1e-6 *
+           tempo_map[i].microseconds_per_quarter / ticks_per_quarter;
+    }
+    return s;
+  }
+};
+
+namespace detail {
+
+/// Read a big-endian integer of \c Bytes bytes
+template <int Bytes> std::uint32_t big_endian(const std::uint8_t* p) {
+  std::uint32_t v = 0;
+  for (int i = 0; i < Bytes; ++i)
+    v = v << 8 | p[i];
+  return v;
+}
+
+/// Append a big-endian integer of \c Bytes bytes
+template <int Bytes>
+void put_big_endian(std::vector<std::uint8_t>& out, std::uint32_t v) {
+  for (int i = Bytes - 1; i >= 0; --i)
+    out.push_back(v >> 8 * i);
+}
+
+/// Append a variable-length quantity, 7 bits per byte
+inline void put_variable_length(std::vector<std::uint8_t>& out,
+                                std::uint32_t v) {
+  std::uint8_t bytes[5];
+  int n = 0;
+  do {
+    bytes[n++] = v & 0x7f;
+    v >>= 7;
+  } while (v);
+  while (n-- > 0)
+    out.push_back(bytes[n] | (n ? 0x80 : 0));
+}
+
+} // namespace detail
+
+/** Read a Standard MIDI File of type 0 or 1
+
+    The tracks are merged into a single sequence of events. The
+    messages without a musycl::midi::msg alternative are skipped. For
+    a file with a SMPTE time division, the ticks are made equivalent
+    to quarter notes with a constant tempo of 1 quarter note per
+    second.
+
+    \param[in] file_name is the path of the file to read
+
+    \throw std::runtime_error if the file cannot be read or decoded
+*/
+inline sequence read_file(const std::string& file_name) {
+  std::ifstream f { file_name, std::ios::binary };
+  if (!f)
+    throw std::runtime_error { "Cannot open MIDI file " + file_name };
+  const std::vector<std::uint8_t> b { std::istreambuf_iterator<char> { f },
+                                      {} };
+  auto error = [&](const std::string& message) {
+    return std::runtime_error { file_name + ": " + message };
+  };
+  if (b.size() < 14 || !std::ranges::equal(std::span { b.data(), 4 },
+                                           std::string_view { "MThd" }))
+    throw error("not a Standard MIDI File");
+  auto format = detail::big_endian<2>(&b[8]);
+  auto division = detail::big_endian<2>(&b[12]);
+  if (format > 1)
+    throw error("only the MIDI file types 0 and 1 are supported");
+
+  sequence s;
+  s.tempo_map.clear();
+  if (division & 0x8000) {
+    // SMPTE frames per second and ticks per frame
+    auto fps = -static_cast<std::int8_t>(division >> 8);
+    s.ticks_per_quarter = fps * (division & 0xff);
+    s.tempo_map.push_back({ 0, 1'000'000 });
+  } else
+    s.ticks_per_quarter = division;
+  if (s.ticks_per_quarter <= 0)
+    throw error("invalid time division");
+
+  // Iterate on the chunks, skipping the unknown ones
+  std::size_t p = 8 + std::size_t { detail::big_endian<4>(&b[4]) };
+  for (; p + 8 <= b.size();) {
+    auto id = std::span { &b[p], 4 };
+    std::size_t size = detail::big_endian<4>(&b[p + 4]);
+    auto begin = p + 8;
+    if (size > b.size() - begin)
+      throw error("chunk extending past the end of the file");
+    auto end = begin + size;
+    p = end;
+    if (!std::ranges::equal(id, std::string_view { "MTrk" }))
+      continue;
+    std::uint32_t tick = 0;
+    std::uint8_t status = 0;
+    parser channel_parser;
+    auto i = begin;
+    auto variable_length = [&] {
+      std::uint32_t v = 0;
+      std::uint8_t c;
+      do {
+        if (i >= end)
+          throw error("truncated track");
+        c = b[i++];
+        v = v << 7 | (c & 0x7f);
+      } while (c & 0x80);
+      return v;
+    };
+    while (i < end) {
+      tick += variable_length();
+      if (i >= end)
+        throw error("truncated track");
+      if (b[i] == 0xff) {
+        // Meta event
+        if (i + 1 >= end)
+          throw error("truncated track");
+        auto type = b[i + 1];
+        i += 2;
+        auto length = variable_length();
+        if (i + length > end)
+          throw error("truncated meta event");
+        if (type == 0x51 && length == 3)
+          s.tempo_map.push_back({ tick, detail::big_endian<3>(&b[i]) });
+        i += length;
+        if (type == 0x2f)
+          // End of track
+          break;
+      } else if (b[i] == 0xf0 || b[i] == 0xf7) {
+        // SysEx event or escaped bytes
+        auto kind = b[i++];
+        auto length = variable_length();
+        if (i + length > end)
+          throw error("truncated SysEx event");
+        std::span payload { b.data() + i, length };
+        if (!payload.empty() && payload.back() == 0xf7)
+          payload = payload.first(payload.size() - 1);
+        if (kind == 0xf0 && payload.size() <= parser::max_sysex_size)
+          s.add_sysex(tick, payload);
+        i += length;
+        status = 0;
+      } else {
+        // Channel message, possibly with a running status
+        if (b[i] & 0x80)
+          status = b[i++];
+        if (status == 0)
+          throw error("data byte without status");
+        msg m;
+        channel_parser.parse(status, m);
+        // Real-time and system common statuses cannot appear here
+        auto length = status_high(status) == 0xc || status_high(status) == 0xd
+                          ? 1
+                          : 2;
+        if (i + length > end)
+          throw error("truncated channel message");
+        bool complete = false;
+        for (int d = 0; d < length; ++d)
+          complete = channel_parser.parse(b[i++], m);
+        if (complete)
+          s.events.push_back({ tick, m });
+      }
+    }
+  }
+  // Merge the tracks
+  std::ranges::stable_sort(s.events, {}, &sequence::event::tick);
+  std::ranges::stable_sort(s.tempo_map, {}, &sequence::tempo_change::tick);
+  if (s.tempo_map.empty() || s.tempo_map.front().tick != 0)
+    s.tempo_map.insert(s.tempo_map.begin(),
+                       { 0, sequence::default_microseconds_per_quarter });
+  return s;
+}
+
+/** Write a sequence as a Standard MIDI File of type 0
+
+    \param[in] file_name is the path of the file to write
+
+    \param[in] s is the sequence to write
+
+    \throw std::runtime_error if the file cannot be written
+*/
+inline void write_file(const std::string& file_name, const sequence& s) {
+  std::vector<std::uint8_t> track;
+  std::uint32_t tick = 0;
+  // Interleave the tempo changes and the messages
+  auto tempo = s.tempo_map.begin();
+  auto put_tempo = [&] {
+    detail::put_variable_length(track, tempo->tick - tick);
+    tick = tempo->tick;
+    for (auto v : { 0xff, 0x51, 0x03 })
+      track.push_back(v);
+    detail::put_big_endian<3>(track, tempo->microseconds_per_quarter);
+    ++tempo;
+  };
+  for (auto& e : s.events) {
+    while (tempo != s.tempo_map.end() && tempo->tick <= e.tick)
+      put_tempo();
+    if (!e.is_sysex && std::holds_alternative<std::monostate>(e.m))
+      continue;
+    detail::put_variable_length(track, e.tick - tick);
+    tick = e.tick;
+    if (e.is_sysex) {
+      // The SysEx length includes the final 0xf7
+      auto payload = s.sysex_payload(e);
+      track.push_back(0xf0);
+      detail::put_variable_length(track, payload.size() + 1);
+      std::ranges::copy(payload, std::back_inserter(track));
+      track.push_back(0xf7);
+    } else
+      encode(e.m, std::back_inserter(track));
+  }
+  while (tempo != s.tempo_map.end())
+    put_tempo();
+  // End of track
+  for (auto v : { 0x00, 0xff, 0x2f, 0x00 })
+    track.push_back(v);
+
+  std::vector<std::uint8_t> b { 'M', 'T', 'h', 'd' };
+  detail::put_big_endian<4>(b, 6);
+  detail::put_big_endian<2>(b, 0);
+  detail::put_big_endian<2>(b, 1);
+  detail::put_big_endian<2>(b, s.ticks_per_quarter);
+  for (auto c : { 'M', 'T', 'r', 'k' })
+    b.push_back(c);
+  detail::put_big_endian<4>(b, track.size());
+  b.insert(b.end(), track.begin(), track.end());
+
+  std::ofstream f { file_name, std::ios::binary };
+  f.write(reinterpret_cast<const char*>(b.data()), b.size());
+  if (!f)
+    throw std::runtime_error { "Cannot write MIDI file " + file_name };
+}
+
+} // namespace musycl::midi
+
+#endif // MUSYCL_MIDI_FILE_HPP
@@ -4,17 +4,23 @@
 /** \file SYCL abstraction for a MIDI input pipe
 
     Based on RtMidi library.
+
+    The MIDI messages are time stamped on arrival so they can be
+    applied at the right sample of an audio frame instead of at the
+    beginning of the frame.
 */
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
 #include <chrono>
 #include <cstdint>
 #include <cstdlib>
 #include <functional>
-#include <iomanip>
 #include <iostream>
-#include <map>
 #include <memory>
+#include <optional>
 #include <string>
 #include <thread>
 #include <tuple>
@@ -23,13 +29,18 @@
 #include <vector>
 
 #include <boost/callable_traits/args.hpp>
-#include <boost/fiber/buffered_channel.hpp>
 
 #include "rtmidi/RtMidi.h"
 
 #include <triSYCL/detail/overloaded.hpp>
 
+#include "musycl/config.hpp"
+
 #include "musycl/midi.hpp"
+#include "musycl/log.hpp"
+#include "musycl/midi/dispatch_table.hpp"
+#include "musycl/mpsc_queue.hpp"
+#include "musycl/trace.hpp"
 
 namespace musycl {
 
@@ -42,40 +53,90 @@ using namespace std::chrono_literals;
     kernels, so there can be only 1 instance of a MIDI input
     interface. */
 class midi_in {
+ public:
+  /// The clock used to time stamp the MIDI messages
+  using clock_type = std::chrono::steady_clock;
+
+  /// A MIDI message with its arrival time
+  struct timed_msg {
+    midi::msg msg;
+    clock_type::time_point time;
+  };
+
+  /// Maximum number of MIDI input ports
+  static auto constexpr max_ports = 16;
+
+ private:
   /// Capacity of the MIDI message pipe
-  static auto constexpr pipe_min_capacity = 64;
+  static auto constexpr pipe_min_capacity = 256;
 
-  /// The buffered channel used on MIDI input with the right size by default
-  struct pipe_channel : boost::fibers::buffered_channel<midi::msg> {
+  /// The lock-free queue used on MIDI input with the right size by default
+  struct pipe_channel : mpsc_queue<timed_msg> {
     pipe_channel()
-        : boost::fibers::buffered_channel<midi::msg> { pipe_min_capacity } {}
+        : mpsc_queue<timed_msg> { pipe_min_capacity } {}
+  };
+
+  /// Relate the RtMidi time stamps of a port to \c clock_type
+  struct time_base {
+    /// Time of the last synchronization with \c clock_type, epoch if none
+    clock_type::time_point origin;
+    /// RtMidi time elapsed since \c origin in second
+    double elapsed;
   };
 
+  /** Maximum difference accepted between the time computed from the
+      RtMidi time stamps and the arrival time before synchronizing again */
+  static auto constexpr max_drift = 20ms;
+
+  /// The time base of each MIDI port
+  static inline std::array<time_base, max_ports> time_bases;
+
+  /// The parser of the byte stream of each MIDI port
+  static inline std::array<midi::parser, max_ports> parsers;
+
+  /// Time mapped to the first sample of the audio frame being computed
+  static inline clock_type::time_point frame_start;
+
+  /// Time given to the last start_frame()
+  static inline clock_type::time_point frame_now;
+
+  /// Whether the time follows start_frame() instead of the wall clock
+  static inline bool virtual_time = false;
+
+  /** The next message to dispatch of each port, taken from its queue
+      to be compared with the other ports */
+  static inline std::array<std::optional<timed_msg>, max_ports>
+      dispatch_heads;
+
+  /** The next message to read of each port, taken from its queue to be
+      compared with a time limit */
+  static inline std::array<std::optional<timed_msg>, max_ports> read_heads;
+
   /** The handlers to control the MIDI input interfaces
 
       Use a pointer because RtMidiIn is a broken type and is neither
       copyable nor movable */
   static inline std::vector<std::unique_ptr<RtMidiIn>> interfaces;
 
-  /// FIFO used to implement the pipe of MIDI messages on each port
-  static inline std::map<std::int8_t, pipe_channel> channels;
+  /** FIFO used to implement the pipe of MIDI messages on each port
+
+      They are all allocated up-front so the MIDI call-backs, the
+      arpeggiators and the controller threads can push into them
+      concurrently with the audio thread reading them */
+  static inline std::array<pipe_channel, max_ports> channels;
 
   /* FIFO used to postpone event dispatch at a time picked by the user
      to avoid race condition */
-  static inline std::map<std::int8_t, pipe_channel> dispatch_channels;
-
-  /// A key to dispatch MIDI messages from this index
-  struct port_msg_header {
-    std::int8_t port;
-    midi::msg_header header;
-    // Just use some lexicographic comparison by default
-    auto operator<=>(const port_msg_header&) const = default;
-  };
+  static inline std::array<pipe_channel, max_ports> dispatch_channels;
+
+  /// Actions to run for each received message from each MIDI port
+  static inline midi::dispatch_table<max_ports> midi_actions;
+
+  /// Display the received MIDI bytes
+  static inline std::atomic<bool> debug = false;
 
-  /// Actions to run for each received CC message from each MIDI port
-  static inline std::multimap<port_msg_header,
-                              std::function<void(const midi::msg&)>>
-      midi_actions;
+  /// Observer of the messages dispatched to the registered actions
+  static inline std::function<void(std::int8_t, const timed_msg&)> monitor;
 
   /// Check for RtMidi errors
   static auto constexpr check_error = [](auto&& function) {
@@ -87,6 +148,29 @@ class midi_in {
     }
   };
 
+  /** Compute the time of a MIDI message from its RtMidi time stamp
+
+      RtMidi provides the time since the previous message on the port,
+      measured by the MIDI driver, which keeps the spacing of messages
+      delivered together to the call-back. The sum of these deltas is
+      anchored on \c clock_type and synchronized again if it drifts
+      away from the arrival time.
+  */
+  static clock_type::time_point message_time(std::int8_t port,
+                                             double time_stamp) {
+    auto now = clock_type::now();
+    auto& base = time_bases[port];
+    if (base.origin != clock_type::time_point {}) {
+      base.elapsed += time_stamp;
+      auto time = base.origin + std::chrono::duration_cast<clock_type::duration>(
+                                    std::chrono::duration<double> { base.elapsed });
+      if (time <= now && now - time < max_drift)
+        return time;
+    }
+    base = { now, 0 };
+    return now;
+  }
+
   /// Process the incomming MIDI messages
   static inline void process_midi_in(double time_stamp,
                                      std::vector<std::uint8_t>* p_midi_message,
@@ -94,23 +178,26 @@ class midi_in {
     auto& midi_message = *p_midi_message;
     auto n_bytes = midi_message.size();
     auto p = reinterpret_cast<std::intptr_t>(port);
-    std::cout << "Received from port " << p << " at time stamp = " << time_stamp
-              << std::endl
-              << '\t';
-    for (int i = 0; i < n_bytes; ++i)
-      std::cout << "Byte " << i << " = 0x" << std::hex << std::setw(2)
-                << std::setfill('0') << static_cast<int>(midi_message[i])
-                << ", " << std::resetiosflags(std::cout.flags());
-    std::cout << std::endl;
-
-    auto m = musycl::midi::parse(midi_message);
-    /* Enqueue the midi message for future event dispatch by
-       dispatch_registered_actions(). If it is full, just drop the
-       message */
-    dispatch_channels[p].try_push(m);
-    /* Also enqueue the midi event for explicit consumption. If it is
-       full, just drop the message */
-    channels[p].try_push(m);
+    if (debug.load(std::memory_order_relaxed)) {
+      // Dump the bytes in hexadecimal without allocating, truncated by
+      // the logger for the long system exclusive messages
+      std::array<char, 3 * 16> hex;
+      std::size_t size = 0;
+      for (auto b : midi_message) {
+        if (size + 3 > hex.size())
+          break;
+        hex[size++] = "0123456789abcdef"[b >> 4];
+        hex[size++] = "0123456789abcdef"[b & 0xf];
+        hex[size++] = ' ';
+      }
+      MUSYCL_LOG_INFO("Received {} bytes from port {} at time stamp = {}: {}",
+                      n_bytes, p, time_stamp,
+                      std::string_view { hex.data(), size });
+    }
+
+    auto time = message_time(p, time_stamp);
+    parsers[p].parse(midi_message,
+                     [&](const midi::msg& msg) { inject(p, msg, time); });
   }
 
  public:
@@ -125,6 +212,12 @@ class midi_in {
     std::cout << "\nThere are " << n_in_ports
               << " MIDI input sources available.\n";
 
+    if (n_in_ports > max_ports) {
+      std::cerr << "Only the first " << max_ports
+                << " MIDI input ports are used" << std::endl;
+      n_in_ports = max_ports;
+    }
+
     for (auto i = 0; i < n_in_ports; ++i) {
       interfaces.push_back(check_error([&] {
         return std::make_unique<RtMidiIn>(backend, application_name);
@@ -155,18 +248,164 @@ class midi_in {
     }
   }
 
+  /// Display or not the MIDI bytes received, which is slow
+  static void set_debug(bool d) { debug = d; }
+
   /// The sycl::pipe::read-like interface to read a MIDI message
-  static midi::msg read(std::int8_t port) { return channels[port].value_pop(); }
+  static midi::msg read(std::int8_t port) {
+    midi::msg m;
+    // There is no notification from the lock-free queue, so just poll
+    while (!try_read(port, m))
+      std::this_thread::sleep_for(1ms);
+    return m;
+  }
 
   /// The non-blocking sycl::pipe::read-like interface to read a MIDI message
   static bool try_read(std::int8_t port, midi::msg& m) {
-    return channels[port].try_pop(m) ==
-           boost::fibers::channel_op_status::success;
+    clock_type::time_point time;
+    return try_read(port, m, time);
+  }
+
+  /** The non-blocking sycl::pipe::read-like interface to read a MIDI
+      message with its arrival time */
+  static bool try_read(std::int8_t port, midi::msg& m,
+                       clock_type::time_point& time) {
+    return try_read_before(port, clock_type::time_point::max(), m, time);
   }
 
-  /// Insert a new MIDI message in the input flow
-  static void insert(std::int8_t port, const midi::msg& m) {
-    channels[port].push(m);
+  /** The non-blocking sycl::pipe::read-like interface to read a MIDI
+      message with its arrival time, only if it arrived before some
+      time
+
+      This allows to interleave the reading of a port with the
+      messages of other sources in time order.
+
+      \param[in] limit is the time the message has to arrive before,
+      otherwise it stays in the port for a later read
+  */
+  static bool try_read_before(std::int8_t port, clock_type::time_point limit,
+                              midi::msg& m, clock_type::time_point& time) {
+    assert(0 <= port && port < max_ports);
+    auto& head = read_heads[port];
+    if (!head) {
+      timed_msg t;
+      if (!channels[port].try_pop(t))
+        return false;
+      head = t;
+    }
+    if (!(head->time < limit))
+      return false;
+    m = std::move(head->msg);
+    time = head->time;
+    head.reset();
+    return true;
+  }
+
+  /** Insert a new MIDI message in the input flow
+
+      This can be used from any thread. If the queue of the port is
+      full, the message is dropped and counted in overflow_count()
+
+      \return false if the message has been dropped
+  */
+  static bool insert(std::int8_t port, const midi::msg& m,
+                     clock_type::time_point time = now()) {
+    assert(0 <= port && port < max_ports);
+    return channels[port].try_push({ m, time });
+  }
+
+  /** Inject a MIDI message as if it was received on a port
+
+      This can be used from any thread, for example to play a MIDI
+      file.
+
+      \return false if the message has been dropped by a full queue
+  */
+  static bool inject(std::int8_t port, const midi::msg& m,
+                     clock_type::time_point time = now()) {
+    assert(0 <= port && port < max_ports);
+    timed_msg t { m, time };
+    /* Enqueue the midi message for future event dispatch by
+       dispatch_registered_actions(). If it is full, the message is
+       dropped and counted in dispatch_overflow_count() */
+    auto dispatched = dispatch_channels[port].try_push(t);
+    /* Also enqueue the midi event for explicit consumption. If it is
+       full, the message is dropped and counted in overflow_count() */
+    return channels[port].try_push(t) && dispatched;
+  }
+
+  /** Observe the messages dispatched to the registered actions, for
+      example to record them
+
+      \param[in] m is called in the dispatching thread with the port
+      and the message, or is empty to stop observing
+  */
+  static void
+  set_monitor(std::function<void(std::int8_t, const timed_msg&)> m) {
+    monitor = std::move(m);
+  }
+
+  /// The number of MIDI messages dropped because of a full queue on a port
+  static std::uint64_t overflow_count(std::int8_t port) {
+    return channels.at(port).overflow_count();
+  }
+
+  /** The number of MIDI messages dropped before the dispatch of the
+      registered actions because of a full queue on a port */
+  static std::uint64_t dispatch_overflow_count(std::int8_t port) {
+    return dispatch_channels.at(port).overflow_count();
+  }
+
+  /** Start the computation of a new audio frame
+
+      The MIDI messages received during the last frame period are
+      mapped into this frame, so they are delayed by 1 frame but keep
+      their relative timing.
+
+      \param[in] now is the time the frame computation starts
+  */
+  static void start_frame(clock_type::time_point now = clock_type::now()) {
+    frame_now = now;
+    frame_start = now - std::chrono::duration_cast<clock_type::duration>(
+                            std::chrono::duration<double> { frame_period });
+  }
+
+  /** Use the time given to start_frame() as the current time instead
+      of the wall clock
+
+      This is used to render faster than real time, where the frame
+      times are computed instead of measured.
+  */
+  static void set_virtual_time(bool v) { virtual_time = v; }
+
+  /// The current time, used by default for the inserted messages
+  static clock_type::time_point now() {
+    return virtual_time ? frame_now : clock_type::now();
+  }
+
+  /** The index in the current audio frame of the sample where to
+      apply a MIDI message
+
+      \param[in] time is the arrival time of the message
+
+      \return the sample index, 0 for a message too old for the
+      current frame
+  */
+  static int frame_offset(clock_type::time_point time) {
+    auto offset = std::chrono::duration<double> { time - frame_start }.count() *
+                  sample_frequency;
+    return std::clamp(static_cast<int>(offset), 0, frame_size - 1);
+  }
+
+  /** The time of a sample of the current audio frame, the reverse of
+      frame_offset()
+
+      \param[in] offset is the sample index in the frame
+  */
+  static clock_type::time_point frame_time(int offset) {
+    return frame_start + std::chrono::duration_cast<clock_type::duration>(
+                             std::chrono::duration<double> {
+                                 (offset + 0.5) / sample_frequency });
   }
 
   /** Dispatch the registered actions for a MIDI input event
@@ -175,15 +414,41 @@ class midi_in {
       called by the user at the right time, typically when this will
       not cause race condition, compared to asynchronous call back
       happening in a background thread.
+
+      The messages of all the ports are interleaved in time order by
+      merging the port queues, which are already in time order, without
+      any memory allocation.
+
+      \param[in] advance is called if any with the time of each
+      message before its actions, to let the audio rendering and the
+      other message consumers reach the time where the message applies
    */
-  static void dispatch_registered_actions() {
-    for (auto&& [port, channel] : dispatch_channels) {
-      midi::msg m;
-      while (channel.try_pop(m) == boost::fibers::channel_op_status::success) {
-        std::cout << m << std::endl;
-        auto [first, last] = midi_actions.equal_range({ port, m });
-        std::for_each(first, last, [&](auto&& action) { action.second(m); });
+  static void dispatch_registered_actions(
+      const std::function<void(clock_type::time_point)>& advance = {}) {
+    MUSYCL_TRACE_SCOPE("midi_in::dispatch_registered_actions");
+    for (;;) {
+      // Find the oldest message at the head of the ports, the first on ties
+      std::int8_t oldest = -1;
+      for (std::int8_t port = 0; port < max_ports; ++port) {
+        auto& head = dispatch_heads[port];
+        if (!head) {
+          timed_msg t;
+          if (dispatch_channels[port].try_pop(t))
+            head = t;
+        }
+        if (head &&
+            (oldest < 0 || head->time < dispatch_heads[oldest]->time))
+          oldest = port;
       }
+      if (oldest < 0)
+        return;
+      auto m = *dispatch_heads[oldest];
+      dispatch_heads[oldest].reset();
+      if (monitor)
+        monitor(oldest, m);
+      if (advance)
+        advance(m.time);
+      midi_actions.dispatch(oldest, m.msg);
     }
   }
 
@@ -191,17 +456,18 @@ class midi_in {
 
       \param[in] port is the input MIDI port
 
-      \param[in] header is the MIDI message header to dispatch
+      \param[in] header is the MIDI message header to dispatch, such
+      as a midi::on_header or a midi::pitch_bend_header
 
       \param[in] action is the action to call with the matching MIDI
       message
   */
-  template <typename Callable>
-  static void add_action(std::int8_t port, const midi::msg_header& header,
+  template <typename Header, typename Callable>
+  static void add_action(std::int8_t port, const Header& header,
                          Callable&& action) {
     std::cout << "midi_in::add_action on port " << int { port } << " for "
-              << header << std::endl;
-    midi_actions.emplace(port_msg_header { port, header }, action);
+              << midi::msg_header { header } << std::endl;
+    midi_actions.add(port, header, std::forward<Callable>(action));
   }
 
   /** Associate an action to a channel controller (CC)
@@ -224,16 +490,16 @@ class midi_in {
     // Register an action producing the right value for the action
     if constexpr (std::is_floating_point_v<arg0_t>)
       // If we have a floating point type, scale the value in [0, 1]
-      midi_actions.emplace(
-          port_msg_header { port, midi::control_change_header { channel, number } },
+      midi_actions.add(
+          port, midi::control_change_header { channel, number },
           [action = std::forward<Callable>(action)](const midi::msg& m) {
             action(midi::control_change::get_value_as<arg0_t>(
                 std::get<midi::control_change>(m).value));
           });
     else
       // Just provides the CC value directly to the action
-      midi_actions.emplace(
-          port_msg_header { port, midi::control_change_header { channel, number } },
+      midi_actions.add(
+          port, midi::control_change_header { channel, number },
           [action = std::forward<Callable>(action)](const midi::msg& m) {
             action(std::get<midi::control_change>(m).value);
           });
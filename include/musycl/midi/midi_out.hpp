@@ -4,18 +4,32 @@
 /** \file SYCL abstraction for a MIDI output pipe
 
     Based on RtMidi library.
+
+    The messages are sent by a dedicated thread, so the blocking device
+    I/O never happens on the audio path.
 */
 
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
 #include <cstdlib>
 #include <functional>
 #include <iostream>
+#include <list>
+#include <map>
 #include <memory>
+#include <span>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include "rtmidi/RtMidi.h"
 
 #include "musycl/midi.hpp"
+#include "musycl/mpsc_queue.hpp"
 
 namespace musycl {
 
@@ -26,14 +40,75 @@ using namespace std::chrono_literals;
 
     In SYCL the type is used to synthesize the connection between
     kernels, so there can be only 1 instance of a MIDI input
-    interface. */
+    interface.
+
+    The messages are handed over through a lock-free queue to a
+    thread sending them to the devices. A message written with a
+    coalescing key replaces a pending message with the same key, so
+    for example only the latest level of a button light is sent. The
+    sending rate of each port is limited to avoid flooding the
+    devices. */
 class midi_out {
+ public:
+  /// The longest message which can be written
+  static auto constexpr max_message_size = 128;
+
+  /// The key of the messages which are never coalesced
+  static auto constexpr no_coalescing = 0;
+
+  /// The MIDI 1.0 wire speed in byte per second, the default rate limit
+  static auto constexpr midi_wire_rate = 3125;
+
+ private:
+  /// A message in flight to the sending thread
+  struct out_msg {
+    /// The output port
+    std::int8_t port;
+    /// The size of the message in byte
+    std::uint8_t size;
+    /// Messages with the same non-0 key replace each other
+    std::uint32_t key;
+    /// The message itself
+    std::array<std::uint8_t, max_message_size> bytes;
+  };
+
+  /// The messages written but not yet handled by the sending thread
+  static inline mpsc_queue<out_msg> messages { 256 };
+
+  /// The state of the sending thread for each port
+  struct port_state {
+    /// The messages waiting for their turn, in writing order
+    std::list<out_msg> pending;
+    /// The pending message for each coalescing key
+    std::map<std::uint32_t, std::list<out_msg>::iterator> latest;
+    /// Byte budget of the rate limiter
+    double tokens = 0;
+    /// Maximum number of bytes sent per second
+    double rate = midi_wire_rate;
+  };
+
+  /// The sending state of each port, only used by the sending thread
+  static inline std::map<std::int8_t, port_state> ports;
+
+  /// The rate limit requested for each port before it is used
+  static inline std::map<std::int8_t, double> rate_limits;
+
+  /// Period at which the sending thread looks for new messages
+  static auto constexpr polling_period = 1ms;
+
   /** The handlers to control the MIDI output interfaces
 
       Use a pointer because RtMidiOut is a broken type and is neither
       copyable nor movable */
   static inline std::vector<std::unique_ptr<RtMidiOut>> interfaces;
 
+  /// The thread sending the messages to the devices
+  static inline std::jthread sender;
+
+  /// Where the messages are sent instead of the devices, if any
+  static inline std::function<void(std::int8_t, std::span<const std::uint8_t>)>
+      sink;
+
   /// Check for RtMidi errors
   static auto constexpr check_error = [] (auto&& function) {
     try {
@@ -45,6 +120,63 @@ class midi_out {
     }
   };
 
+  /// Queue a new message for a port, coalescing it with a pending one
+  static void enqueue(const out_msg& m) {
+    auto& p = ports[m.port];
+    if (m.key != no_coalescing)
+      if (auto l = p.latest.find(m.key); l != p.latest.end()) {
+        // The latest message wins but keeps the place of the previous one
+        *l->second = m;
+        return;
+      }
+    p.pending.push_back(m);
+    if (m.key != no_coalescing)
+      p.latest[m.key] = std::prev(p.pending.end());
+  }
+
+  /// Send the pending messages of a port allowed by the rate limiter
+  static void send(std::int8_t port, port_state& p, double elapsed) {
+    // Do not accumulate more than 1 second of budget
+    p.tokens = std::min(p.tokens + elapsed * p.rate, p.rate);
+    std::vector<std::uint8_t> message;
+    while (!p.pending.empty() && p.tokens >= p.pending.front().size) {
+      auto& m = p.pending.front();
+      p.tokens -= m.size;
+      if (sink)
+        sink(port, std::span { m.bytes.data(), m.size });
+      else if (port < interfaces.size()) {
+        message.assign(m.bytes.begin(), m.bytes.begin() + m.size);
+        interfaces[port]->sendMessage(&message);
+      }
+      if (m.key != no_coalescing)
+        p.latest.erase(m.key);
+      p.pending.pop_front();
+    }
+  }
+
+  /// The loop of the sending thread
+  static void send_loop(std::stop_token stop) {
+    auto last = std::chrono::steady_clock::now();
+    while (!stop.stop_requested()) {
+      out_msg m;
+      while (messages.try_pop(m))
+        enqueue(m);
+      auto now = std::chrono::steady_clock::now();
+      auto elapsed = std::chrono::duration<double> { now - last }.count();
+      last = now;
+      for (auto& [port, p] : ports)
+        send(port, p, elapsed);
+      std::this_thread::sleep_for(polling_period);
+    }
+  }
+
+  /// Start the thread sending the messages written so far
+  static void start_sending() {
+    for (auto [port, rate] : rate_limits)
+      ports[port].rate = rate;
+    sender = std::jthread { send_loop };
+  }
+
 public:
 
   /// Open all the IMID input ports available
@@ -71,30 +203,87 @@ public:
       // Open the port and give it a fancy name
       check_error([&] { interfaces[i]->openPort(i, port_name); });
     }
+    start_sending();
   }
 
+  /** Send the messages to a function instead of the MIDI devices
+
+      This allows running without any MIDI device, for example to
+      capture the output in a test.
 
-  /// The sycl::pipe::write-like interface to write a MIDI message
-  static void write(const std::vector<std::uint8_t>& v) {
-#if 0
-    for (int e : v)
-      std::cout << std::hex << e << ' ';
-    std::cout << std::endl;
-    for (int e : v)
-      std::cout << std::dec << e << ' ';
-    std::cout << std::endl;
-#endif
-    // Hard-code now for KeyLab Essential
-    interfaces[1]->sendMessage(&v);
+      \param[in] s is called from the sending thread with the port and
+      the bytes of each message, at the rate limit of the port
+  */
+  void open(std::function<void(std::int8_t, std::span<const std::uint8_t>)> s) {
+    sink = std::move(s);
+    start_sending();
   }
 
+  /// Stop sending the messages, dropping the ones not sent yet
+  static void close() {
+    if (sender.joinable()) {
+      sender.request_stop();
+      sender.join();
+    }
+    sink = {};
+  }
+
+
+  /** Limit the sending rate of a port
+
+      This has to be called before open()
+
+      \param[in] port is the MIDI output port
 
-  /// The non-blocking sycl::pipe::write-like interface to write a MIDI message
-  static void try_write(const std::vector<std::uint8_t>& v) {
-    write(v);
+      \param[in] bytes_per_second is the maximum number of bytes sent
+      per second
+  */
+  static void set_rate_limit(std::int8_t port, double bytes_per_second) {
+    rate_limits[port] = bytes_per_second;
   }
 
 
+  /** The non-blocking sycl::pipe::write-like interface to write a MIDI
+      message, usable from any thread
+
+      \param[in] v is the MIDI message
+
+      \param[in] key is a non-0 value to have this message replaced by
+      a later message with the same key if it has not been sent yet
+
+      \param[in] port is the MIDI output port
+
+      \return false if the message is dropped because it is too long
+      or there are too many messages in flight
+  */
+  static bool try_write(std::span<const std::uint8_t> v,
+                        std::uint32_t key = no_coalescing,
+                        // Hard-code now for KeyLab Essential
+                        std::int8_t port = 1) {
+    assert(v.size() <= max_message_size && "MIDI output message too long");
+    if (v.size() > max_message_size)
+      return false;
+    out_msg m { .port = port,
+                .size = static_cast<std::uint8_t>(v.size()),
+                .key = key };
+    std::ranges::copy(v, m.bytes.begin());
+    return messages.try_push(m);
+  }
+
+
+  /** The sycl::pipe::write-like interface to write a MIDI message
+
+      The messages dropped because there are too many in flight are
+      counted by overflow_count()
+  */
+  static void write(std::span<const std::uint8_t> v,
+                    std::uint32_t key = no_coalescing,
+                    std::int8_t port = 1) {
+    try_write(v, key, port);
+  }
+
+  /// The number of messages dropped because too many were in flight
+  static std::uint64_t overflow_count() { return messages.overflow_count(); }
 };
 
 }
@@ -0,0 +1,135 @@
+#ifndef MUSYCL_MIDI_PLAYER_HPP
+#define MUSYCL_MIDI_PLAYER_HPP
+
+/** \file Play a MIDI sequence frame by frame with a sample accurate
+    timing
+*/
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include "musycl/config.hpp"
+
+#include "musycl/clock.hpp"
+#include "musycl/midi.hpp"
+#include "musycl/midi/file.hpp"
+
+namespace musycl::midi {
+
+/** Play a MIDI sequence, like one read from a Standard MIDI File
+
+    The sequence is played at the pace of the audio frames, either
+    with its own tempo map or following the tempo of musycl::clock,
+    and each message is delivered with the index of the sample of the
+    frame where it applies.
+*/
+class player {
+  /// The sequence played, which is not owned
+  const sequence* s;
+
+  /// Index of the next event to play
+  std::size_t next = 0;
+
+  /// Index of the current tempo in the tempo map
+  std::size_t tempo = 0;
+
+  /// Current position in tick
+  double tick = 0;
+
+  /// Follow the musycl::clock tempo instead of the tempo map
+  bool follow_clock = false;
+
+  /// Restart from the beginning at the end of the sequence
+  bool looping = false;
+
+  /// Number of tick per sample at the current tempo
+  double ticks_per_sample() const {
+    if (follow_clock)
+      return s->ticks_per_quarter * clock::tempo_frequency() /
+             sample_frequency;
+    return s->ticks_per_quarter * 1e6 /
+           s->tempo_map[tempo].microseconds_per_quarter / sample_frequency;
+  }
+
+  /// The tick where the current tempo ends
+  double tempo_end() const {
+    if (follow_clock || tempo + 1 >= s->tempo_map.size())
+      return std::numeric_limits<double>::infinity();
+    return s->tempo_map[tempo + 1].tick;
+  }
+
+ public:
+  /// Create a player for a sequence which has to outlive the player
+  player(const sequence& seq)
+      : s { &seq } {}
+
+  /** Follow the tempo of musycl::clock instead of the tempo map of the
+      sequence
+
+      \return the player itself to enable command chaining
+  */
+  auto& set_follow_clock(bool f) {
+    follow_clock = f;
+    return *this;
+  }
+
+  /** Restart from the beginning at the end of the sequence
+
+      \return the player itself to enable command chaining
+  */
+  auto& set_loop(bool l) {
+    looping = l;
+    return *this;
+  }
+
+  /** Go back to the beginning of the sequence
+
+      \return the player itself to enable command chaining
+  */
+  auto& rewind() {
+    next = 0;
+    tempo = 0;
+    tick = 0;
+    return *this;
+  }
+
+  /// Whether all the events have been played
+  bool finished() const { return next >= s->events.size(); }
+
+  /** Play the events of the next audio frame
+
+      \param[in] emit is called with the sample index in the frame and
+      the message for each event of the frame, in time order
+  */
+  template <typename Callable> void play_frame(Callable&& emit) {
+    if (finished() && looping)
+      rewind();
+    // Samples of the frame remaining to play
+    double remaining = frame_size;
+    while (remaining > 0) {
+      auto rate = ticks_per_sample();
+      // Play up to the end of the frame or to the next tempo change
+      auto frame_end = tick + remaining * rate;
+      auto tempo_change = tempo_end() < frame_end;
+      auto end = tempo_change ? tempo_end() : frame_end;
+      for (; next < s->events.size() && s->events[next].tick < end; ++next) {
+        auto offset = frame_size - remaining +
+                      std::max(s->events[next].tick - tick, 0.) / rate;
+        emit(std::min(static_cast<int>(offset), frame_size - 1),
+             s->message(s->events[next]));
+      }
+      if (tempo_change) {
+        remaining -= (end - tick) / rate;
+        ++tempo;
+      } else
+        remaining = 0;
+      tick = end;
+    }
+  }
+};
+
+} // namespace musycl::midi
+
+#endif // MUSYCL_MIDI_PLAYER_HPP
@@ -0,0 +1,99 @@
+#ifndef MUSYCL_MIDI_RECORDER_HPP
+#define MUSYCL_MIDI_RECORDER_HPP
+
+/** \file Record MIDI messages into a Standard MIDI File
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <variant>
+
+#include "musycl/clock.hpp"
+#include "musycl/midi.hpp"
+#include "musycl/midi/file.hpp"
+
+namespace musycl::midi {
+
+/** Capture MIDI messages with their time to save them as a Standard
+    MIDI File
+
+    The file tempo is the musycl::clock tempo when the recording
+    starts, so the recording can be edited against the beat.
+*/
+class recorder {
+  /// The clock used to time the messages
+  using clock_type = std::chrono::steady_clock;
+
+  /// The recorded messages
+  sequence s;
+
+  /// Time of the start of the recording
+  clock_type::time_point origin = clock_type::now();
+
+ public:
+  /** Forget the recorded messages and start a new recording now
+
+      \return the recorder itself to enable command chaining
+  */
+  auto& start(clock_type::time_point now = clock_type::now()) {
+    origin = now;
+    s.events.clear();
+    s.sysex_payloads.clear();
+    s.tempo_map = { { 0, static_cast<std::uint32_t>(
+                             std::lround(1e6 / clock::tempo_frequency())) } };
+    return *this;
+  }
+
+  /** Create a recorder
+
+      \param[in] reserved_events is the number of events which can be
+      recorded before any memory allocation
+
+      \param[in] reserved_sysex_bytes is the size of the SysEx payloads
+      which can be recorded before any memory allocation
+  */
+  recorder(std::size_t reserved_events = 1 << 16,
+           std::size_t reserved_sysex_bytes = 1 << 16) {
+    s.events.reserve(reserved_events);
+    s.sysex_payloads.reserve(reserved_sysex_bytes);
+    start();
+  }
+
+  /** Record a message
+
+      \param[in] m is the MIDI message
+
+      \param[in] time is the time of the message, typically its
+      arrival time
+  */
+  void record(const msg& m, clock_type::time_point time) {
+    if (std::holds_alternative<std::monostate>(m) || time < origin)
+      return;
+    auto seconds = std::chrono::duration<double> { time - origin }.count();
+    auto tick = static_cast<std::uint32_t>(
+        seconds * 1e6 / s.tempo_map.front().microseconds_per_quarter *
+        s.ticks_per_quarter);
+    // Keep the events sorted even if the times are slightly out of order
+    if (!s.events.empty())
+      tick = std::max(tick, s.events.back().tick);
+    // Copy the SysEx payload before the arena recycles it
+    s.add(tick, m);
+  }
+
+  /// The recorded messages
+  const sequence& recording() const { return s; }
+
+  /** Save the recording as a Standard MIDI File of type 0
+
+      \throw std::runtime_error if the file cannot be written
+  */
+  void save(const std::string& file_name) const { write_file(file_name, s); }
+};
+
+} // namespace musycl::midi
+
+#endif // MUSYCL_MIDI_RECORDER_HPP
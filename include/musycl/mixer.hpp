@@ -0,0 +1,351 @@
+#ifndef MUSYCL_MIXER_HPP
+#define MUSYCL_MIXER_HPP
+
+/** \file A mixing console with per-channel strips and auxiliary
+    send/return buses
+
+    https://en.wikipedia.org/wiki/Aux-send
+*/
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include <sycl/sycl.hpp>
+
+#include "config.hpp"
+
+#include "audio.hpp"
+#include "tail.hpp"
+
+namespace musycl {
+
+/** Mix the audio of several channels into a stereo output
+
+    Each channel has a strip with a gain, a pan, a chain of insert
+    effects and a send level to each auxiliary bus. Each auxiliary bus
+    runs its return effect chain once on the sum of what the channels
+    send to it, so a heavy effect like a reverberation is shared by all
+    the channels.
+
+    All the frames are allocated up-front so nothing is allocated
+    while mixing. The effects of a silent strip or bus are skipped once
+    their tails are over.
+*/
+class mixer {
+ public:
+  /// A processing applied in place on a frame
+  using processor = std::function<void(audio::frame&)>;
+
+  /** Return the number of frames a processing keeps producing sound
+      after its input became silent */
+  using tail_function = std::function<int()>;
+
+  /// The stereo gains applied by a strip to a channel
+  using stereo_gain = sycl::marray<audio::value_type, audio::channel_number>;
+
+ private:
+  /// A chain of processings with the tails of the processings
+  class chain {
+    /// The processings applied in sequence
+    std::vector<processor> processors;
+
+    /// The tail of each processing, infinite if empty
+    std::vector<tail_function> tails;
+
+    /// Number of consecutive frames with a silent input
+    int silent_frames = 0;
+
+   public:
+    /// Append a processing
+    void add(processor p, tail_function tail) {
+      processors.push_back(std::move(p));
+      tails.push_back(std::move(tail));
+    }
+
+    /// Whether there is no processing
+    bool empty() const { return processors.empty(); }
+
+    /// The tail of the whole chain, the sum of the processing tails
+    int tail() const {
+      long long total = 0;
+      for (auto& t : tails)
+        total += t ? t() : infinite_tail;
+      return std::min<long long>(total, infinite_tail);
+    }
+
+    /** Run the chain on a frame, unless the input has been silent for
+        longer than the tail of the chain
+
+        \param[inout] audio is the frame to process
+
+        \param[in] silent_input tells whether the input is silent
+
+        \return true if the chain was run, false if the frame was left
+        untouched
+    */
+    bool process(audio::frame& audio, bool silent_input) {
+      silent_frames =
+          silent_input ? std::min(silent_frames + 1, infinite_tail - 1) : 0;
+      if (processors.empty() || silent_frames > tail())
+        return false;
+      for (auto& p : processors)
+        p(audio);
+      return true;
+    }
+  };
+
+ public:
+
+  /// The processing and routing of a channel
+  class strip {
+    friend mixer;
+
+    /// Linear gain of the channel
+    float gain = 1;
+
+    /// Pan of the channel from -1 for left to +1 for right
+    float pan = 0;
+
+    /// Level sent to each auxiliary bus, after the gain
+    std::vector<float> sends;
+
+    /// The insert effects applied in sequence on the channel
+    chain inserts;
+
+    /// Stereo gain with a balance pan law, unity in the center
+    stereo_gain balance(float level) const {
+      return { level * std::min(1 - pan, 1.f),
+               level * std::min(1 + pan, 1.f) };
+    }
+
+   public:
+    /** Set the linear gain of the channel
+
+        \return the strip itself to enable command chaining
+    */
+    auto& set_gain(float g) {
+      gain = g;
+      return *this;
+    }
+
+    /** Set the pan of the channel, from -1 for left to +1 for right
+
+        \return the strip itself to enable command chaining
+    */
+    auto& set_pan(float p) {
+      pan = std::clamp(p, -1.f, 1.f);
+      return *this;
+    }
+
+    /** Set the level sent to an auxiliary bus
+
+        \return the strip itself to enable command chaining
+    */
+    auto& set_send(int bus, float level) {
+      sends.at(bus) = level;
+      return *this;
+    }
+
+    /** Append an insert processing to the channel
+
+        \param[in] tail returns the number of frames the processing
+        keeps producing sound after its input became silent. Without
+        it the processing runs forever, even without input
+
+        \return the strip itself to enable command chaining
+    */
+    auto& add_insert(processor p, tail_function tail = {}) {
+      inserts.add(std::move(p), std::move(tail));
+      return *this;
+    }
+
+    /** Append an effect like the ones from musycl::effect, used by
+        reference, as an insert
+
+        \return the strip itself to enable command chaining
+    */
+    template <typename Effect>
+      requires requires(Effect e, audio::frame f) { e.process(f); }
+    auto& add_insert(Effect& effect) {
+      return add_insert([&effect](audio::frame& f) { effect.process(f); },
+                        [&effect] { return tail_frames(effect); });
+    }
+  };
+
+  /// An auxiliary bus fed by the channel sends
+  class bus {
+    friend mixer;
+
+    /// Linear level of the bus return into the output
+    float return_gain = 1;
+
+    /// Return only what the effects add to their input
+    bool wet_only = true;
+
+    /// The return effects applied in sequence on the bus
+    chain effects;
+
+   public:
+    /** Set the linear level of the bus return
+
+        \return the bus itself to enable command chaining
+    */
+    auto& set_return(float g) {
+      return_gain = g;
+      return *this;
+    }
+
+    /** Return only the difference between the output and the input
+        of the effects, which is the right thing for the effects of
+        this library which add their output to their input
+
+        \return the bus itself to enable command chaining
+    */
+    auto& set_wet_only(bool w) {
+      wet_only = w;
+      return *this;
+    }
+
+    /** Append a return processing to the bus
+
+        \param[in] tail returns the number of frames the processing
+        keeps producing sound after its input became silent. Without
+        it the processing runs forever, even without input
+
+        \return the bus itself to enable command chaining
+    */
+    auto& add_effect(processor p, tail_function tail = {}) {
+      effects.add(std::move(p), std::move(tail));
+      return *this;
+    }
+
+    /** Append an effect like the ones from musycl::effect, used by
+        reference
+
+        \return the bus itself to enable command chaining
+    */
+    template <typename Effect>
+      requires requires(Effect e, audio::frame f) { e.process(f); }
+    auto& add_effect(Effect& effect) {
+      return add_effect([&effect](audio::frame& f) { effect.process(f); },
+                        [&effect] { return tail_frames(effect); });
+    }
+  };
+
+ private:
+  /// The strip of each channel
+  std::vector<strip> strips;
+
+  /// The auxiliary buses
+  std::vector<bus> buses;
+
+  /// The audio accumulated for each channel during the current frame
+  std::vector<audio::frame> channel_frames;
+
+  /// Whether each channel received some audio during the current frame
+  std::vector<bool> active;
+
+  /// The audio accumulated for each bus during the current frame
+  std::vector<audio::frame> bus_frames;
+
+  /// A copy of the bus input to extract the wet part of the effects
+  audio::frame dry;
+
+  /// The frames a channel is mixed into with their gains, for each frame
+  std::vector<std::pair<audio::frame*, stereo_gain>> routes;
+
+ public:
+  /** Create a mixer
+
+      \param[in] channel_number is the number of channel strips
+
+      \param[in] bus_number is the number of auxiliary buses
+  */
+  mixer(int channel_number, int bus_number)
+      : strips(channel_number)
+      , buses(bus_number)
+      , channel_frames(channel_number)
+      , active(channel_number)
+      , bus_frames(bus_number) {
+    for (auto& s : strips)
+      s.sends.assign(bus_number, 0);
+    routes.reserve(bus_number + 1);
+  }
+
+  /// Access the strip of a channel
+  strip& channel(int c) { return strips.at(c); }
+
+  /// Access an auxiliary bus
+  bus& aux(int b) { return buses.at(b); }
+
+  /// The number of channel strips
+  int channel_number() const { return strips.size(); }
+
+  /** Accumulate some audio into a channel for the current frame
+
+      Audio for a channel without strip is mixed into the last channel.
+  */
+  void add(int channel, const audio::frame& audio) {
+    if (channel < 0 || channel >= channel_number())
+      channel = channel_number() - 1;
+    auto& f = channel_frames[channel];
+    if (!active[channel]) {
+      f = audio;
+      active[channel] = true;
+    } else
+      for (auto&& [a, e] : ranges::views::zip(f, audio))
+        a += e;
+  }
+
+  /** Mix all the channels of the current frame and start a new frame
+
+      \param[out] audio receives the stereo mix
+  */
+  void process(audio::frame& audio) {
+    audio.fill(0);
+    for (auto& f : bus_frames)
+      f.fill(0);
+    for (int c = 0; c < channel_number(); ++c) {
+      auto& s = strips[c];
+      auto& f = channel_frames[c];
+      auto silent = !active[c];
+      active[c] = false;
+      if (silent) {
+        // Keep running the inserts without input to let their tails ring
+        f.fill(0);
+        if (!s.inserts.process(f, true))
+          continue;
+      } else
+        s.inserts.process(f, false);
+      routes.clear();
+      routes.emplace_back(&audio, s.balance(s.gain));
+      for (std::size_t b = 0; b < buses.size(); ++b)
+        if (s.sends[b] != 0)
+          routes.emplace_back(&bus_frames[b], s.balance(s.gain * s.sends[b]));
+      // Route the channel to the output and all the buses in 1 pass
+      for (int i = 0; i < frame_size; ++i) {
+        const auto& v = f[i];
+        for (auto& [destination, gain] : routes)
+          (*destination)[i] += v * gain;
+      }
+    }
+    // Run each bus effect once and mix back its return
+    for (std::size_t b = 0; b < buses.size(); ++b) {
+      auto& u = buses[b];
+      auto& f = bus_frames[b];
+      if (u.wet_only)
+        dry = f;
+      if (!u.effects.process(f, is_silent(f)) && u.wet_only)
+        // Nothing is added when the effects are skipped
+        continue;
+      for (int i = 0; i < frame_size; ++i)
+        audio[i] += (u.wet_only ? f[i] - dry[i] : f[i]) * u.return_gain;
+    }
+  }
+};
+
+} // namespace musycl
+
+#endif // MUSYCL_MIXER_HPP
@@ -0,0 +1,119 @@
+#ifndef MUSYCL_MPSC_QUEUE_HPP
+#define MUSYCL_MPSC_QUEUE_HPP
+
+/** \file A lock-free multiple-producer single-consumer bounded queue
+
+    This is the bounded queue from Dmitry Vyukov where each cell has a
+    sequence number telling whether it can be written or read, so the
+    producers only compete on the tail index and never block.
+
+    https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+*/
+
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace musycl {
+
+/** A bounded FIFO between any number of producer threads and 1
+    consumer thread
+
+    All the storage is allocated at construction. When the queue is
+    full the element is dropped and counted as an overflow.
+
+    \param T is the type of the elements, copied in and moved out of
+    the queue
+*/
+template <typename T> class mpsc_queue {
+  /// Assume a cache line of 64 bytes to avoid false sharing
+  static constexpr std::size_t cache_line = 64;
+
+  /// An element with its sequence number
+  struct cell {
+    /** Equal to the tail index when the cell is free to be written,
+        to the tail index + 1 when it can be read */
+    std::atomic<std::size_t> sequence;
+    T value;
+  };
+
+  /// The storage of the elements, with a power of 2 size
+  std::unique_ptr<cell[]> cells;
+
+  /// To compute an index modulo the number of cells
+  std::size_t mask;
+
+  /// Number of elements pushed since the beginning, shared by the producers
+  alignas(cache_line) std::atomic<std::size_t> tail = 0;
+
+  /// Number of elements popped since the beginning, owned by the consumer
+  alignas(cache_line) std::size_t head = 0;
+
+  /// Number of elements dropped because the queue was full
+  alignas(cache_line) std::atomic<std::uint64_t> overflows = 0;
+
+ public:
+  /// Create a queue able to hold at least \c capacity elements
+  explicit mpsc_queue(std::size_t capacity)
+      : cells { std::make_unique<cell[]>(std::bit_ceil(capacity)) }
+      , mask { std::bit_ceil(capacity) - 1 } {
+    assert(capacity > 0);
+    for (std::size_t i = 0; i <= mask; ++i)
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  /// The maximum number of elements in the queue
+  std::size_t capacity() const { return mask + 1; }
+
+  /** Try to push an element without blocking, from any thread
+
+      \return false if the queue is full and the element is dropped
+  */
+  bool try_push(const T& value) {
+    auto t = tail.load(std::memory_order_relaxed);
+    for (;;) {
+      auto& c = cells[t & mask];
+      auto s = c.sequence.load(std::memory_order_acquire);
+      auto difference = static_cast<std::ptrdiff_t>(s - t);
+      if (difference == 0) {
+        // The cell is free, try to claim it
+        if (tail.compare_exchange_weak(t, t + 1, std::memory_order_relaxed)) {
+          c.value = value;
+          c.sequence.store(t + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (difference < 0) {
+        // The cell has not been read yet since last round: full queue
+        overflows.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      } else
+        // Another producer claimed the cell, try with the new tail
+        t = tail.load(std::memory_order_relaxed);
+    }
+  }
+
+  /// Try to pop an element without blocking, only from the consumer thread
+  bool try_pop(T& value) {
+    auto& c = cells[head & mask];
+    if (c.sequence.load(std::memory_order_acquire) != head + 1)
+      return false;
+    value = std::move(c.value);
+    // Free the cell for the next round of the producers
+    c.sequence.store(head + mask + 1, std::memory_order_release);
+    ++head;
+    return true;
+  }
+
+  /// The number of elements dropped because the queue was full
+  std::uint64_t overflow_count() const {
+    return overflows.load(std::memory_order_relaxed);
+  }
+};
+
+} // namespace musycl
+
+#endif // MUSYCL_MPSC_QUEUE_HPP
@@ -6,26 +6,49 @@
 #include "arpeggiator.hpp"
 #include "automate.hpp"
 #include "audio.hpp"
+#include "backend.hpp"
 #include "clock.hpp"
 #include "control.hpp"
+#include "counter_rng.hpp"
 #include "dco.hpp"
+#include "effect/compressor.hpp"
+#include "effect/convolution.hpp"
 #include "effect/delay.hpp"
 #include "effect/flanger.hpp"
+#include "effect/level_detector.hpp"
+#include "effect/limiter.hpp"
 #include "effect/range_delay.hpp"
+#include "effect/reverb.hpp"
 #include "envelope.hpp"
+#include "fft.hpp"
+#include "graph.hpp"
 #include "ladder_filter.hpp"
 #include "lfo.hpp"
+#include "log.hpp"
 #include "low_pass_filter.hpp"
 #include "midi.hpp"
 #include "midi/channel_assignment.hpp"
+#include "midi/file.hpp"
 #include "midi/midi_in.hpp"
 #include "midi/midi_out.hpp"
+#include "midi/player.hpp"
+#include "midi/recorder.hpp"
+#include "mixer.hpp"
 #include "modulation_actuator.hpp"
+#include "mpsc_queue.hpp"
 #include "noise.hpp"
+#include "oversampler.hpp"
+#include "pipeline.hpp"
 #include "pitch_bend.hpp"
 #include "resonance_filter.hpp"
+#include "rt_safety.hpp"
 #include "sound_generator.hpp"
+#include "spsc_queue.hpp"
 #include "sustain.hpp"
+#include "tail.hpp"
+#include "trace.hpp"
 #include "user_interface.hpp"
+#include "wav.hpp"
+#include "watchdog.hpp"
 
 #endif // MUSYCL_MUSYCL_HPP
@@ -3,15 +3,17 @@
 #ifndef MUSYCL_NOISE_HPP
 #define MUSYCL_NOISE_HPP
 
-#include <limits>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <span>
 
 #include <range/v3/all.hpp>
 
-#include <triSYCL/vendor/triSYCL/random/xorshift.hpp>
-
 #include "config.hpp"
 
 #include "audio.hpp"
+#include "counter_rng.hpp"
 #include "group.hpp"
 #include "envelope.hpp"
 #include "low_pass_filter.hpp"
@@ -25,8 +27,18 @@ class noise {
   /// Track if the noise generator is generating a signal or just 0
   bool running = false;
 
-  /// Some fast random generator
-  static inline trisycl::vendor::trisycl::random::xorshift<> rng;
+  /// The seed of the random streams of all the noise generators
+  static inline std::uint64_t random_seed = 0;
+
+  /** Number of notes started since the seed, numbering the random
+      streams in the note order, whatever the rendering order */
+  static inline std::uint64_t started_notes = 0;
+
+  /// The random stream of the current note
+  counter_rng rng;
+
+  /// Index of the next sample of the note, the counter of its random stream
+  std::uint64_t sample_index = 0;
 
   /// To filter the noise
   low_pass_filter lpf_filter;
@@ -91,6 +103,13 @@ class noise {
       , rf_env { p->rf_env }
       , param { p } {}
 
+  /** Restart the random streams of the noise generators from a seed,
+      to render reproducibly */
+  static void seed(std::uint64_t s) {
+    random_seed = s;
+    started_notes = 0;
+  }
+
   /** Start a note
 
       \param[in] on is the "note on" MIDI event to start with
@@ -100,6 +119,8 @@ class noise {
   auto& start(const midi::on& on) {
     velocity = on.velocity_1();
     frequency = midi::frequency(on);
+    rng = { random_seed, started_notes++ };
+    sample_index = 0;
     running = lpf_env.start().is_running() || rf_env.start().is_running();
     return *this;
   }
@@ -119,27 +140,39 @@ class noise {
   /// Return the running status
   bool is_running() { return running; }
 
-  /// Generate an audio sample
-  musycl::audio::frame audio() {
+  /** Generate a part of an audio frame
+
+      \param[out] f is the audio frame to write into
+
+      \param[in] begin is the index of the first sample to generate
+
+      \param[in] end is the index past the last sample to generate
+  */
+  void render(musycl::audio::frame& f, int begin, int end) {
     lpf_filter.set_cutoff_frequency(frequency * lpf_env.out());
     res_filter.set_resonance(0.99).set_frequency(2 * frequency * rf_env.out());
     running = lpf_env.is_running() || rf_env.is_running();
 
-    musycl::audio::frame f;
     if (running) {
-      for (auto& e : f) {
-        // A random number between -1 and 1
-        auto random =
-            rng() * 2. / std::numeric_limits<decltype(rng)::value_type>::max() -
-            1;
+      // The random numbers between -1 and 1 as a batch, which vectorizes
+      std::array<float, frame_size> random;
+      rng.uniform(sample_index,
+                  std::span { random }.subspan(begin, end - begin));
+      sample_index += end - begin;
+      for (int i = begin; i < end; ++i)
         // Generate a filtered noise sample with an amplitude directly
         // proportional to the velocity
-        e = lpf_filter.filter(random) * 10 * res_filter.filter(random) *
-            velocity * volume;
-      }
+        f[i] = lpf_filter.filter(random[i]) * 10 *
+               res_filter.filter(random[i]) * velocity * volume;
     } else
       // If the DCO is not running, the output is 0
-      ranges::fill(f, 0);
+      std::fill(f.begin() + begin, f.begin() + end, 0);
+  }
+
+  /// Generate an audio sample
+  musycl::audio::frame audio() {
+    musycl::audio::frame f;
+    render(f, 0, frame_size);
     return f;
   }
 };
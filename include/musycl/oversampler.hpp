@@ -0,0 +1,224 @@
+#ifndef MUSYCL_OVERSAMPLER_HPP
+#define MUSYCL_OVERSAMPLER_HPP
+
+/** \file Oversampling to run nonlinear processing with less aliasing
+
+    Based on cascaded polyphase half-band filters.
+
+    https://en.wikipedia.org/wiki/Half-band_filter
+*/
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <numbers>
+#include <span>
+#include <type_traits>
+
+#include "config.hpp"
+
+#include "audio.hpp"
+
+namespace musycl {
+
+/** A 2× polyphase half-band interpolator and decimator
+
+    A half-band filter has every other coefficient equal to 0 except
+    the center one which is 1/2, so the even polyphase branch is a
+    pure delay and only the odd branch needs a FIR computation.
+*/
+class half_band_filter {
+ public:
+  using sample = audio::sample<>;
+
+  /// Half the number of non-zero coefficients of the odd branch
+  static constexpr int half_length = 12;
+
+  /// Number of coefficients of the odd polyphase branch
+  static constexpr int taps = 2 * half_length;
+
+ private:
+  /// Largest block of input samples processed at once
+  static constexpr int max_block = 8 * frame_size;
+
+  /** The odd polyphase branch coefficients, normalized to a unit DC
+      gain, computed from a Blackman-windowed sinc */
+  static inline const std::array<double, taps> coefficients = [] {
+    std::array<double, taps> c;
+    double sum = 0;
+    for (int i = 0; i < taps; ++i) {
+      // The odd tap index of the full filter centered on 0
+      auto n = 2 * (i - half_length) + 1;
+      auto x = std::numbers::pi * n / taps;
+      auto window = 0.42 + 0.5 * std::cos(x) + 0.08 * std::cos(2 * x);
+      c[i] = std::sin(std::numbers::pi * n / 2) / (std::numbers::pi * n) *
+             window;
+      sum += c[i];
+    }
+    for (auto& e : c)
+      e /= sum;
+    return c;
+  }();
+
+  /// Input history prepended to the interpolator input
+  std::array<sample, taps + max_block> up_work {};
+
+  /// Even-phase history prepended to the decimator input
+  std::array<sample, half_length + max_block / 2> down_even {};
+
+  /// Odd-phase history prepended to the decimator input
+  std::array<sample, taps + max_block / 2> down_odd {};
+
+ public:
+  /** Interpolate by 2
+
+      \param[in] in is the input block
+
+      \param[out] out receives twice as many samples as in the input
+  */
+  void upsample(std::span<const sample> in, std::span<sample> out) {
+    const int n = in.size();
+    assert(n <= max_block && out.size() == 2 * in.size());
+    std::ranges::copy(in, up_work.begin() + taps);
+    for (int m = 0; m < n; ++m) {
+      // x[m - i] for the current output is at x[taps + m - i]
+      const auto* x = &up_work[taps + m];
+      // The even branch is just the input delayed
+      out[2 * m] = x[-half_length];
+      sample acc { 0 };
+      for (int i = 0; i < taps; ++i)
+        acc += coefficients[i] * x[-i];
+      out[2 * m + 1] = acc;
+    }
+    // Keep the end of the input as the history for the next block
+    std::ranges::copy_n(up_work.begin() + n, taps, up_work.begin());
+  }
+
+  /** Decimate by 2
+
+      \param[in] in is the input block, of even size
+
+      \param[out] out receives half as many samples as in the input
+  */
+  void downsample(std::span<const sample> in, std::span<sample> out) {
+    const int n = out.size();
+    assert(n <= max_block / 2 && in.size() == 2 * out.size());
+    for (int m = 0; m < n; ++m) {
+      down_even[half_length + m] = in[2 * m];
+      down_odd[taps + m] = in[2 * m + 1];
+    }
+    for (int m = 0; m < n; ++m) {
+      // Odd samples v_o[m - 1 - i] are at down_odd[taps + m - 1 - i]
+      const auto* v_o = &down_odd[taps + m - 1];
+      sample acc { 0 };
+      for (int i = 0; i < taps; ++i)
+        acc += coefficients[i] * v_o[-i];
+      out[m] = (down_even[m] + acc) * 0.5;
+    }
+    std::ranges::copy_n(down_even.begin() + n, half_length,
+                        down_even.begin());
+    std::ranges::copy_n(down_odd.begin() + n, taps, down_odd.begin());
+  }
+};
+
+/** Run a nonlinear processing on an audio frame at a higher sampling
+    rate to reduce the aliasing it produces
+
+    The frame is interpolated by 2×, 4× or 8× with cascaded half-band
+    filters, processed and decimated back. An oversampling factor of 1
+    runs the processing directly.
+*/
+class oversampler {
+ public:
+  /// Maximum oversampling factor
+  static constexpr int max_factor = 8;
+
+  /// A block of samples at the highest rate
+  using block = std::array<audio::sample<>, max_factor * frame_size>;
+
+ private:
+  /// Number of 2× stages, log2 of the oversampling factor
+  int stages;
+
+  /// 1 interpolator/decimator per 2× stage
+  std::array<half_band_filter, 3> filters;
+
+  /// Ping-pong work blocks at the oversampled rates
+  block work[2];
+
+ public:
+  /** Set the oversampling factor to 1, 2, 4 or 8
+
+      \return the oversampler itself to enable command chaining
+  */
+  auto& set_factor(int factor) {
+    assert((factor == 1 || factor == 2 || factor == 4 || factor == 8) &&
+           "oversampling factor has to be 1, 2, 4 or 8");
+    stages = std::countr_zero(static_cast<unsigned>(factor));
+    return *this;
+  }
+
+  /// Create an oversampler with a factor of 1, 2, 4 or 8
+  oversampler(int factor = 2) { set_factor(factor); }
+
+  /// The oversampling factor
+  int factor() const { return 1 << stages; }
+
+  /// The half-band filters delay the signal by less than a frame
+  int tail_frames() const { return 1; }
+
+  /// The sampling frequency at which the processing runs
+  float frequency() const { return factor() * sample_frequency; }
+
+  /** Process an audio frame with a nonlinearity at the oversampled rate
+
+      \param[inout] audio frame which is processed
+
+      \param[in] nonlinearity is either a callable taking a
+      std::span<audio::sample<>> to process a whole block or a
+      callable taking an audio::sample<>& to process each sample
+  */
+  template <typename Nonlinearity>
+  void process(audio::frame& audio, Nonlinearity&& nonlinearity) {
+    auto apply = [&](std::span<audio::sample<>> s) {
+      if constexpr (std::is_invocable_v<Nonlinearity,
+                                        std::span<audio::sample<>>>)
+        nonlinearity(s);
+      else
+        for (auto& e : s)
+          nonlinearity(e);
+    };
+    if (stages == 0) {
+      apply(audio);
+      return;
+    }
+    // Interpolate up through the stages
+    std::span<const audio::sample<>> in = audio;
+    int current = 0;
+    for (int s = 0; s < stages; ++s) {
+      std::span<audio::sample<>> out { work[current].data(), 2 * in.size() };
+      filters[s].upsample(in, out);
+      in = out;
+      current = 1 - current;
+    }
+    std::span<audio::sample<>> oversampled { work[1 - current].data(),
+                                             in.size() };
+    apply(oversampled);
+    // Decimate down through the stages in reverse order
+    in = oversampled;
+    for (int s = stages - 1; s >= 0; --s) {
+      std::span<audio::sample<>> out = s == 0
+          ? std::span<audio::sample<>> { audio }
+          : std::span<audio::sample<>> { work[current].data(), in.size() / 2 };
+      filters[s].downsample(in, out);
+      in = out;
+      current = 1 - current;
+    }
+  }
+};
+
+} // namespace musycl
+
+#endif // MUSYCL_OVERSAMPLER_HPP
@@ -0,0 +1,111 @@
+#ifndef MUSYCL_PIPELINE_HPP
+#define MUSYCL_PIPELINE_HPP
+
+/** \file Pipeline the audio frame processing across 2 threads
+
+    While the back-end stage processes frame N on its own thread, the
+    front-end stage can already compute frame N + 1 on the calling
+    thread. This roughly doubles the CPU time available per frame at
+    the cost of some frames of latency.
+*/
+
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <utility>
+
+#include "config.hpp"
+
+#include "audio.hpp"
+#include "spsc_queue.hpp"
+#include "trace.hpp"
+
+namespace musycl {
+
+/** A 2-stage frame pipeline: the front-end stage runs on the thread
+    pushing the frames and the back-end stage on a worker thread
+
+    The frames are handed over through a lock-free queue whose
+    capacity is the pipeline depth, the number of frames which can be
+    in flight between the stages, adding as many frames of latency.
+    With a depth of 0 the back-end stage runs synchronously on the
+    calling thread.
+
+    \tparam Frame is what is handed over for each audio frame, like
+    an audio::frame with the parameters the back-end stage needs to
+    process it, so the back-end stage never reads the state of the
+    front-end stage while it changes
+*/
+template <typename Frame = audio::frame> class pipeline {
+  /// The processing done by the back-end stage on each frame
+  std::function<void(Frame&)> back_end;
+
+  /// The frames in flight from the front-end to the back-end
+  spsc_queue<Frame> frames;
+
+  /// Number of frames which can be in flight
+  int depth;
+
+  /// The thread running the back-end stage
+  std::jthread worker;
+
+ public:
+  /** Create a pipeline
+
+      \param[in] pipeline_depth is the number of frames of latency
+      added, 0 for a synchronous execution
+
+      \param[in] back_end_stage is the processing run for each frame
+      on the back-end thread
+  */
+  pipeline(int pipeline_depth, std::function<void(Frame&)> back_end_stage)
+      : back_end { std::move(back_end_stage) }
+      , frames(std::max(pipeline_depth, 1))
+      , depth { pipeline_depth } {
+    if (depth > 0)
+      worker = std::jthread { [this] {
+        if constexpr (trace::enabled)
+          trace::set_thread_name("pipeline back-end");
+        while (auto f = frames.pop())
+          back_end(*f);
+      } };
+  }
+
+  pipeline(const pipeline&) = delete;
+  pipeline& operator=(const pipeline&) = delete;
+
+  /// Let the back-end stage finish the frames in flight
+  ~pipeline() { finish(); }
+
+  /** Let the back-end stage finish the frames in flight and stop it
+
+      No frame can be pushed afterwards.
+  */
+  void finish() {
+    if (worker.joinable()) {
+      frames.close();
+      worker.join();
+    }
+  }
+
+  /// The pipeline depth in frame
+  int latency() const { return depth; }
+
+  /** Hand over a frame computed by the front-end stage to the
+      back-end stage
+
+      This blocks while the back-end stage is \c depth frames late,
+      which paces the front-end stage with the audio output.
+  */
+  void push(Frame&& frame) {
+    MUSYCL_TRACE_SCOPE("pipeline::push");
+    if (depth == 0)
+      back_end(frame);
+    else
+      frames.push(std::move(frame));
+  }
+};
+
+} // namespace musycl
+
+#endif // MUSYCL_PIPELINE_HPP
@@ -6,6 +6,8 @@
 #include <cmath>
 #include <numbers>
 
+#include "log.hpp"
+
 namespace musycl {
 
 /** A resonance filter based on 2-tap IIR with a 2-tap FIR to
@@ -50,7 +52,7 @@ public:
   */
   auto& set_frequency(float f) {
     frequency = f;
-    std::cout << "resonance_filter frequency = " << f << std::endl;
+    MUSYCL_LOG_TRACE("resonance_filter frequency = {}", f);
     update_parameters();
     return *this;
   }
@@ -65,7 +67,7 @@ public:
   */
   auto& set_resonance(float r) {
     resonance = r;
-    std::cout << "resonance_filter resonance = " << r << std::endl;
+    MUSYCL_LOG_TRACE("resonance_filter resonance = {}", r);
     update_parameters();
     return *this;
   }
@@ -0,0 +1,175 @@
+#ifndef MUSYCL_RT_SAFETY_HPP
+#define MUSYCL_RT_SAFETY_HPP
+
+/** \file Check that the real-time audio computation does not allocate
+    memory, lock a mutex or make a blocking system call
+
+    The code computing the audio is marked with MUSYCL_RT_SAFETY_SCOPE()
+    and the forbidden operations are intercepted by the functions of
+    musycl/rt_safety/interposers.hpp. Each violation inside a scope is
+    reported with its stack trace, only once per call stack, or aborts
+    the program in fatal mode.
+
+    This is a debug mode only compiled in when MUSYCL_RT_SAFETY is
+    defined, for example with the CMake option of the same name,
+    otherwise the macros expand to nothing. It relies on glibc.
+*/
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef MUSYCL_RT_SAFETY
+#include <execinfo.h>
+#include <unistd.h>
+#endif
+
+namespace musycl::rt_safety {
+
+/// Whether the checker is compiled in
+#ifdef MUSYCL_RT_SAFETY
+inline constexpr bool enabled = true;
+#else
+inline constexpr bool enabled = false;
+#endif
+
+namespace detail {
+
+/** Nesting depth of the real-time scopes on this thread
+
+    Plain thread-local integers, so reading them from an interposed
+    malloc() does not allocate anything.
+*/
+inline thread_local int depth = 0;
+
+/// Nesting depth of the scopes allowing the forbidden operations
+inline thread_local int allowed = 0;
+
+/// Set while reporting a violation, which itself does some forbidden things
+inline thread_local bool reporting = false;
+
+/// Abort on the first violation instead of reporting it
+inline std::atomic<bool> fatal = false;
+
+/// Number of violations detected
+inline std::atomic<std::uint64_t> violations = 0;
+
+/// The hashes of the call stacks already reported, 0 for a free entry
+inline std::array<std::atomic<std::uint64_t>, 1024> reported {};
+
+/// Write a string on the standard error without any allocation
+inline void write_error([[maybe_unused]] const char* s) {
+#ifdef MUSYCL_RT_SAFETY
+  [[maybe_unused]] auto r = ::write(STDERR_FILENO, s, std::strlen(s));
+#endif
+}
+
+/** Remember a call stack hash
+
+    \return true if it is the first time it is seen
+*/
+inline bool first_report(std::uint64_t hash) {
+  // Never 0, which marks a free entry
+  hash |= 1;
+  // Open addressing with linear probing
+  for (std::size_t probe = 0; probe < reported.size(); ++probe) {
+    auto& e = reported[(hash + probe) % reported.size()];
+    std::uint64_t expected = 0;
+    if (e.compare_exchange_strong(expected, hash))
+      return true;
+    if (expected == hash)
+      return false;
+  }
+  // The table is full, so report everything
+  return true;
+}
+
+} // namespace detail
+
+/// Whether the current thread is in a real-time scope
+inline bool in_real_time() {
+  return detail::depth > 0 && detail::allowed == 0 && !detail::reporting;
+}
+
+/// Abort on the first violation instead of reporting it
+inline void set_fatal(bool f) { detail::fatal = f; }
+
+/// Number of violations detected so far
+inline std::uint64_t violation_count() { return detail::violations; }
+
+/** Report a forbidden operation if it happens in a real-time scope
+
+    \param[in] operation is the name of the intercepted function
+*/
+inline void check([[maybe_unused]] const char* operation) {
+  if (!in_real_time())
+    return;
+  detail::reporting = true;
+  ++detail::violations;
+#ifdef MUSYCL_RT_SAFETY
+  constexpr int max_frames = 32;
+  void* frames[max_frames];
+  auto size = ::backtrace(frames, max_frames);
+  // Identify the call stack, skipping the checking functions
+  std::uint64_t hash = 14695981039346656037u;
+  for (int i = 1; i < size; ++i)
+    hash = (hash ^ reinterpret_cast<std::uintptr_t>(frames[i])) *
+           1099511628211u;
+  if (detail::fatal || detail::first_report(hash)) {
+    detail::write_error("rt_safety: ");
+    detail::write_error(operation);
+    detail::write_error(" called from a real-time scope\n");
+    ::backtrace_symbols_fd(frames, size, STDERR_FILENO);
+  }
+#endif
+  if (detail::fatal)
+    std::abort();
+  detail::reporting = false;
+}
+
+/// Mark the rest of the enclosing scope as real-time
+class scope {
+ public:
+  scope() { ++detail::depth; }
+
+  scope(const scope&) = delete;
+  scope& operator=(const scope&) = delete;
+
+  ~scope() { --detail::depth; }
+};
+
+/** Allow the forbidden operations in the rest of the enclosing scope,
+    for some rare code known to be unsafe inside a real-time scope */
+class allow {
+ public:
+  allow() { ++detail::allowed; }
+
+  allow(const allow&) = delete;
+  allow& operator=(const allow&) = delete;
+
+  ~allow() { --detail::allowed; }
+};
+
+} // namespace musycl::rt_safety
+
+#define MUSYCL_RT_SAFETY_CONCAT_DETAIL(a, b) a##b
+#define MUSYCL_RT_SAFETY_CONCAT(a, b) MUSYCL_RT_SAFETY_CONCAT_DETAIL(a, b)
+
+#ifdef MUSYCL_RT_SAFETY
+/// Check the rest of the enclosing scope as real-time code
+#define MUSYCL_RT_SAFETY_SCOPE()                                             \
+  ::musycl::rt_safety::scope MUSYCL_RT_SAFETY_CONCAT(musycl_rt_scope_,      \
+                                                     __LINE__)
+/// Allow the forbidden operations in the rest of the enclosing scope
+#define MUSYCL_RT_SAFETY_ALLOW()                                             \
+  ::musycl::rt_safety::allow MUSYCL_RT_SAFETY_CONCAT(musycl_rt_allow_,      \
+                                                     __LINE__)
+#else
+#define MUSYCL_RT_SAFETY_SCOPE() static_cast<void>(0)
+#define MUSYCL_RT_SAFETY_ALLOW() static_cast<void>(0)
+#endif
+
+#endif // MUSYCL_RT_SAFETY_HPP
@@ -0,0 +1,150 @@
+#ifndef MUSYCL_RT_SAFETY_INTERPOSERS_HPP
+#define MUSYCL_RT_SAFETY_INTERPOSERS_HPP
+
+/** \file Intercept the memory allocations, the mutex locks and the
+    blocking system calls to check the real-time scopes
+
+    The C library functions are replaced by some functions checking
+    whether they are called from a real-time scope before calling the
+    original ones, found with dlsym(RTLD_NEXT) or through the glibc
+    internal allocator entry points.
+
+    Since this defines the functions, it has to be included in only 1
+    translation unit of the program. It defines nothing if
+    MUSYCL_RT_SAFETY is not defined.
+*/
+
+#include "musycl/rt_safety.hpp"
+
+#ifdef MUSYCL_RT_SAFETY
+
+#include <cerrno>
+#include <cstddef>
+
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/select.h>
+#include <time.h>
+#include <unistd.h>
+
+// The glibc allocator, which does not go through the interposers
+extern "C" {
+void* __libc_malloc(std::size_t);
+void* __libc_calloc(std::size_t, std::size_t);
+void* __libc_realloc(void*, std::size_t);
+void* __libc_memalign(std::size_t, std::size_t);
+void __libc_free(void*);
+}
+
+namespace musycl::rt_safety::detail {
+
+/// The next definition of a function, usually the C library one
+template <typename Function> Function* next(const char* name) {
+  return reinterpret_cast<Function*>(::dlsym(RTLD_NEXT, name));
+}
+
+/** Load the unwinder used by backtrace() at start-up, since loading
+    it allocates memory */
+inline const bool backtrace_ready = [] {
+  void* frame;
+  ::backtrace(&frame, 1);
+  return true;
+}();
+
+} // namespace musycl::rt_safety::detail
+
+/** Replace a function of the C library by a checking one
+
+    The exception specification has to be the one of the C library
+    declaration.
+*/
+#define MUSYCL_RT_SAFETY_INTERPOSE(result, name, parameters, arguments,     \
+                                   exception_specification)                 \
+  extern "C" result name parameters exception_specification {               \
+    static auto real =                                                       \
+        ::musycl::rt_safety::detail::next<result parameters>(#name);         \
+    ::musycl::rt_safety::check(#name);                                       \
+    return real arguments;                                                   \
+  }
+
+extern "C" {
+
+void* malloc(std::size_t size) __THROW {
+  musycl::rt_safety::check("malloc");
+  return __libc_malloc(size);
+}
+
+void* calloc(std::size_t number, std::size_t size) __THROW {
+  musycl::rt_safety::check("calloc");
+  return __libc_calloc(number, size);
+}
+
+void* realloc(void* p, std::size_t size) __THROW {
+  musycl::rt_safety::check("realloc");
+  return __libc_realloc(p, size);
+}
+
+void free(void* p) __THROW {
+  if (p)
+    musycl::rt_safety::check("free");
+  __libc_free(p);
+}
+
+void* memalign(std::size_t alignment, std::size_t size) __THROW {
+  musycl::rt_safety::check("memalign");
+  return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(std::size_t alignment, std::size_t size) __THROW {
+  musycl::rt_safety::check("aligned_alloc");
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** p, std::size_t alignment, std::size_t size) __THROW {
+  musycl::rt_safety::check("posix_memalign");
+  *p = __libc_memalign(alignment, size);
+  return *p || size == 0 ? 0 : ENOMEM;
+}
+
+} // extern "C"
+
+MUSYCL_RT_SAFETY_INTERPOSE(int, pthread_mutex_lock, (pthread_mutex_t * m),
+                           (m), __THROWNL)
+MUSYCL_RT_SAFETY_INTERPOSE(int, pthread_rwlock_rdlock,
+                           (pthread_rwlock_t * l), (l), __THROWNL)
+MUSYCL_RT_SAFETY_INTERPOSE(int, pthread_rwlock_wrlock,
+                           (pthread_rwlock_t * l), (l), __THROWNL)
+MUSYCL_RT_SAFETY_INTERPOSE(int, pthread_cond_wait,
+                           (pthread_cond_t * c, pthread_mutex_t* m), (c, m), )
+MUSYCL_RT_SAFETY_INTERPOSE(int, pthread_cond_timedwait,
+                           (pthread_cond_t * c, pthread_mutex_t* m,
+                            const struct timespec* t),
+                           (c, m, t), )
+MUSYCL_RT_SAFETY_INTERPOSE(int, sem_wait, (sem_t * s), (s), )
+MUSYCL_RT_SAFETY_INTERPOSE(ssize_t, read, (int fd, void* b, std::size_t n),
+                           (fd, b, n), )
+MUSYCL_RT_SAFETY_INTERPOSE(ssize_t, write,
+                           (int fd, const void* b, std::size_t n), (fd, b, n),
+                           )
+MUSYCL_RT_SAFETY_INTERPOSE(int, fsync, (int fd), (fd), )
+MUSYCL_RT_SAFETY_INTERPOSE(int, poll, (struct pollfd * f, nfds_t n, int t),
+                           (f, n, t), )
+MUSYCL_RT_SAFETY_INTERPOSE(int, select,
+                           (int n, fd_set* r, fd_set* w, fd_set* e,
+                            struct timeval* t),
+                           (n, r, w, e, t), )
+MUSYCL_RT_SAFETY_INTERPOSE(int, nanosleep,
+                           (const struct timespec* t, struct timespec* r),
+                           (t, r), )
+MUSYCL_RT_SAFETY_INTERPOSE(int, clock_nanosleep,
+                           (clockid_t c, int f, const struct timespec* t,
+                            struct timespec* r),
+                           (c, f, t, r), )
+MUSYCL_RT_SAFETY_INTERPOSE(int, usleep, (useconds_t u), (u), )
+
+#endif // MUSYCL_RT_SAFETY
+
+#endif // MUSYCL_RT_SAFETY_INTERPOSERS_HPP
@@ -3,6 +3,8 @@
 
 /// \file Concept of sound generators to be used to play a note
 
+#include <algorithm>
+#include <cmath>
 #include <type_traits>
 #include <variant>
 
@@ -23,6 +25,21 @@ class sound_generator {
 
   sound_generator_t sg;
 
+  /// The MIDI channel of the note played, to route the sound in a mixer
+  int channel = 0;
+
+ private:
+  /// The audio of the current frame rendered so far
+  musycl::audio::frame output;
+
+  /// Number of samples of the current frame already rendered
+  int rendered = 0;
+
+  /// Whether the note has been stopped, the sound being in its release
+  bool released = false;
+
+ public:
+
   using pointer = sound_generator*;
 
   ///  Parameter of the sound generators
@@ -99,6 +116,8 @@ class sound_generator {
       \return itself to allow operation chaining
   */
   sound_generator& start(const musycl::midi::on& on) {
+    channel = on.channel;
+    released = false;
     std::visit([&] (auto &s) { s.start(on); }, sg);
     return *this;
   }
@@ -111,14 +130,53 @@ class sound_generator {
       \return itself to allow operation chaining
   */
   sound_generator& stop(const musycl::midi::off& off) {
+    released = true;
     std::visit([&] (auto &s) { s.stop(off); }, sg);
     return *this;
   }
 
 
-  /// Generate an audio sample
+  /** Render the current frame up to a sample, to apply a MIDI event
+      at this sample afterwards
+
+      \param[in] offset is the index in the frame of the first sample
+      not to render yet
+
+      \return itself to allow operation chaining
+  */
+  sound_generator& render_until(int offset) {
+    offset = std::min(offset, frame_size);
+    if (offset > rendered) {
+      std::visit([&] (auto &s) { s.render(output, rendered, offset); }, sg);
+      rendered = offset;
+    }
+    return *this;
+  }
+
+
+  /** Start the sound at some sample of the current frame, with
+      silence before
+
+      \param[in] offset is the index in the frame of the first sample
+      of the sound
+
+      \return itself to allow operation chaining
+  */
+  sound_generator& skip_until(int offset) {
+    offset = std::min(offset, frame_size);
+    if (offset > rendered) {
+      std::fill(output.begin() + rendered, output.begin() + offset, 0);
+      rendered = offset;
+    }
+    return *this;
+  }
+
+
+  /// Generate an audio frame, completing the part not rendered yet
   musycl::audio::frame audio() {
-    return std::visit([&] (auto &s) { return s.audio(); }, sg);
+    render_until(frame_size);
+    rendered = 0;
+    return output;
   }
 
 
@@ -126,6 +184,20 @@ class sound_generator {
   bool is_running() {
     return std::visit([&] (auto &s) { return s.is_running(); }, sg);
   }
+
+
+  /// Whether the note has been stopped, the sound possibly fading out
+  bool is_released() const { return released; }
+
+
+  /** The peak level of the last frame returned by audio(), valid
+      until some new audio is rendered */
+  audio::value_type level() const {
+    audio::value_type peak = 0;
+    for (auto& s : output)
+      peak = std::max({ peak, std::abs(s[0]), std::abs(s[1]) });
+    return peak;
+  }
 };
 
 
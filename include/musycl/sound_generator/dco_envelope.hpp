@@ -11,6 +11,7 @@
 #include "../dco.hpp"
 #include "../envelope.hpp"
 #include "../group.hpp"
+#include "../log.hpp"
 #include "../midi.hpp"
 
 namespace musycl {
@@ -66,9 +67,7 @@ class dco_envelope
     env.start();
     dco::start(on);
     volume = env.out();
-    std::cout << "Start " << on
-              << " with volume " << volume << std::endl;
-    std::cout << to_string(env) << std::endl;
+    MUSYCL_LOG_DEBUG("Start {} with volume {}", on, volume);
     return *this;
   }
 
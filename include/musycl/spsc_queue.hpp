@@ -0,0 +1,121 @@
+#ifndef MUSYCL_SPSC_QUEUE_HPP
+#define MUSYCL_SPSC_QUEUE_HPP
+
+/** \file A lock-free single-producer single-consumer bounded queue
+
+    The blocking operations wait on the atomic indices with the C++20
+    atomic wait/notify, so there is no mutex and no system call as
+    long as the queue is neither full nor empty.
+*/
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace musycl {
+
+/** A bounded FIFO between exactly 1 producer thread and 1 consumer
+    thread
+
+    \param T is the type of the elements, moved in and out of the
+    queue
+*/
+template <typename T> class spsc_queue {
+  /// Assume a cache line of 64 bytes to avoid false sharing
+  static constexpr std::size_t cache_line = 64;
+
+  /// The storage of the elements
+  std::vector<T> elements;
+
+  /** Bit of \c tail set when the producer will not push anymore, so
+      a consumer waiting on \c tail is woken up by the closing */
+  static constexpr std::size_t closed_bit = ~(~std::size_t {} >> 1);
+
+  /// Number of elements pushed since the beginning, written by the producer
+  alignas(cache_line) std::atomic<std::size_t> tail = 0;
+
+  /// Number of elements popped since the beginning, written by the consumer
+  alignas(cache_line) std::atomic<std::size_t> head = 0;
+
+ public:
+  /// Create a queue able to hold \c capacity elements
+  explicit spsc_queue(std::size_t capacity)
+      : elements(capacity) {
+    assert(capacity > 0);
+  }
+
+  /// The maximum number of elements in the queue
+  std::size_t capacity() const { return elements.size(); }
+
+  /// Try to push an element without blocking, returning false if full
+  bool try_push(T&& value) {
+    auto t = tail.load(std::memory_order_relaxed);
+    assert(!(t & closed_bit) && "no push after close()");
+    if (t - head.load(std::memory_order_acquire) == elements.size())
+      return false;
+    elements[t % elements.size()] = std::move(value);
+    tail.store(t + 1, std::memory_order_release);
+    tail.notify_one();
+    return true;
+  }
+
+  /// Push an element, waiting for some room if the queue is full
+  void push(T&& value) {
+    auto t = tail.load(std::memory_order_relaxed);
+    assert(!(t & closed_bit) && "no push after close()");
+    for (auto h = head.load(std::memory_order_acquire);
+         t - h == elements.size(); h = head.load(std::memory_order_acquire))
+      head.wait(h, std::memory_order_acquire);
+    elements[t % elements.size()] = std::move(value);
+    tail.store(t + 1, std::memory_order_release);
+    tail.notify_one();
+  }
+
+  /// Try to pop an element without blocking
+  std::optional<T> try_pop() {
+    auto h = head.load(std::memory_order_relaxed);
+    if ((tail.load(std::memory_order_acquire) & ~closed_bit) == h)
+      return std::nullopt;
+    std::optional<T> value { std::move(elements[h % elements.size()]) };
+    head.store(h + 1, std::memory_order_release);
+    head.notify_one();
+    return value;
+  }
+
+  /** Pop an element, waiting for one if the queue is empty
+
+      \return the element or nothing if the queue is empty and closed
+  */
+  std::optional<T> pop() {
+    auto h = head.load(std::memory_order_relaxed);
+    for (auto t = tail.load(std::memory_order_acquire);
+         (t & ~closed_bit) == h; t = tail.load(std::memory_order_acquire)) {
+      if (t & closed_bit)
+        return std::nullopt;
+      tail.wait(t, std::memory_order_acquire);
+    }
+    std::optional<T> value { std::move(elements[h % elements.size()]) };
+    head.store(h + 1, std::memory_order_release);
+    head.notify_one();
+    return value;
+  }
+
+  /// Tell the consumer that nothing more will be pushed
+  void close() {
+    tail.fetch_or(closed_bit, std::memory_order_release);
+    tail.notify_all();
+  }
+
+  /// The number of elements currently in the queue, approximate
+  std::size_t size() const {
+    return (tail.load(std::memory_order_acquire) & ~closed_bit) -
+           head.load(std::memory_order_acquire);
+  }
+};
+
+} // namespace musycl
+
+#endif // MUSYCL_SPSC_QUEUE_HPP
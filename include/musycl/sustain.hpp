@@ -34,6 +34,9 @@ class sustain {
   /// Keep track of a note-on message which has to be processed later
   std::optional<midi::msg> postponed_note_on;
 
+  /// The arrival time of the postponed note-on message
+  midi_in::clock_type::time_point postponed_time;
+
  public:
   /// Get the current state of the sustain pedal
   bool value() { return state; }
@@ -57,10 +60,38 @@ class sustain {
       consumption
   */
   bool process(int midi_port, midi::msg& m) {
+    midi_in::clock_type::time_point time;
+    return process(midi_port, m, time);
+  }
+
+  /** Add sustain on a MIDI flow by postponing MIDI off-note while
+      sustain is on, keeping track of the time of the messages
+
+      \param[in] midi_port is the MIDI port to listen to
+
+      \param[out] MIDI message produced after processing the MIDI
+      input according to sustain
+
+      \param[out] time is the arrival time of the message. The
+      note-off messages released by the sustain pedal get the epoch
+      time, which is the beginning of the current audio frame
+
+      \param[in] limit is the time the input messages have to arrive
+      before to be processed, the later ones being kept for a later
+      call
+
+      \return whether a MIDI message is produced to output for further
+      consumption
+  */
+  bool process(int midi_port, midi::msg& m,
+               midi_in::clock_type::time_point& time,
+               midi_in::clock_type::time_point limit =
+                   midi_in::clock_type::time_point::max()) {
     /* If there is a pending note-on message, first process it, to a
        void a corresponding note-off to be scheduled before */
     if (postponed_note_on) {
       m = *postponed_note_on;
+      time = postponed_time;
       postponed_note_on.reset();
       return true;
     }
@@ -68,6 +99,7 @@ class sustain {
     if (just_released && !sustained_notes.empty()) {
       // Pick a holding note-off and send it
       m = sustained_notes.cbegin()->second;
+      time = {};
       sustained_notes.erase(sustained_notes.cbegin());
       // We have produced a MIDI message to process
       return true;
@@ -75,14 +107,14 @@ class sustain {
     // No longer any sustained note back-log to process
     just_released = false;
     // Now we can process the MIDI input
-    if (midi_in::try_read(0, m)) {
+    while (midi_in::try_read_before(midi_port, limit, m, time)) {
       // If the sustain is on and a not-off comes, just put it on hold
       if (state && std::holds_alternative<midi::off>(m))
         // Only handle first MIDI channel
         if (auto off = std::get<midi::off>(m); off.channel == 0) {
           sustained_notes.insert_or_assign(off.base_header(), m);
-          // Do not return the note-off message for now
-          return false;
+          // Do not return the note-off message for now but the next one
+          continue;
         }
       if (state && std::holds_alternative<midi::on>(m))
         // Only handle first MIDI channel
@@ -91,6 +123,7 @@ class sustain {
           if (auto it = sustained_notes.find(on.base_header());
               it != sustained_notes.end()) {
             postponed_note_on = m;
+            postponed_time = time;
             // Return the sustained note-off
             m = it->second;
             return true;
@@ -0,0 +1,72 @@
+#ifndef MUSYCL_TAIL_HPP
+#define MUSYCL_TAIL_HPP
+
+/** \file Track how long a processing keeps producing sound after its
+    input became silent, to bypass it when it has nothing to do
+*/
+
+#include <cmath>
+#include <limits>
+
+#include <sycl/sycl.hpp>
+
+#include "config.hpp"
+
+#include "audio.hpp"
+
+namespace musycl {
+
+/// The tail of a processing which can sound forever, like a feedback loop
+inline constexpr int infinite_tail = std::numeric_limits<int>::max();
+
+/// Audio below this level, -120 dB, is considered as silence
+inline constexpr audio::value_type silence_threshold = 1e-6;
+
+/// Convert a duration in second into a number of frames, rounded up
+inline int frames_from_time(float time) {
+  // Anything longer than a day is considered as infinite
+  if (!(time < 86400))
+    return infinite_tail;
+  return static_cast<int>(std::ceil(time / frame_period));
+}
+
+/** The time for an exponential decay from full scale down to the
+    silence threshold, twice the reverberation time for -120 dB
+
+    \param[in] rt60 is the time of a -60 dB decay in second
+*/
+inline float time_to_silence(float rt60) {
+  return rt60 * std::log10(silence_threshold) / -3;
+}
+
+/// Convert a number of samples into a number of frames, rounded up
+constexpr int frames_from_samples(int samples) {
+  return (samples + frame_size - 1) / frame_size;
+}
+
+/** Number of frames a processing keeps producing sound after its
+    input became silent
+
+    This uses the \c tail_frames() member of the processing if any,
+    otherwise the tail is assumed to be infinite so the processing is
+    never bypassed.
+*/
+template <typename Effect> int tail_frames(const Effect& e) {
+  if constexpr (requires { e.tail_frames(); })
+    return e.tail_frames();
+  else
+    return infinite_tail;
+}
+
+/// Test whether an audio frame is below the silence threshold
+inline bool is_silent(const audio::frame& audio) {
+  sycl::marray<audio::value_type, audio::channel_number> peak { 0 };
+  for (auto& s : audio)
+    peak = sycl::fmax(peak, s.fabs());
+  return peak[audio::left] <= silence_threshold &&
+         peak[audio::right] <= silence_threshold;
+}
+
+} // namespace musycl
+
+#endif // MUSYCL_TAIL_HPP
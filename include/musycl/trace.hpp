@@ -0,0 +1,392 @@
+#ifndef MUSYCL_TRACE_HPP
+#define MUSYCL_TRACE_HPP
+
+/** \file Lightweight instrumentation of the audio hot path
+
+    Some scoped timers measure the stages of the frame computation,
+    like the MIDI dispatch, the voices or the effects. Each thread
+    records its timings into its own lock-free ring, which keeps the
+    last events like a flight recorder, and into a duration histogram
+    per stage. The rings can be exported in the Chrome trace event
+    format, readable by https://ui.perfetto.dev or chrome://tracing,
+    to find what causes an audio drop-out.
+
+    The timers are only compiled in when MUSYCL_TRACE is defined, for
+    example with the CMake option of the same name, otherwise
+    MUSYCL_TRACE_SCOPE() and MUSYCL_TRACE_MARK() expand to nothing.
+
+    https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+*/
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "rt_safety.hpp"
+
+namespace musycl::trace {
+
+/// Whether the timers are compiled in
+#ifdef MUSYCL_TRACE
+inline constexpr bool enabled = true;
+#else
+inline constexpr bool enabled = false;
+#endif
+
+/// Identify a stage of the computation, the name of a timer
+using stage_id = std::uint16_t;
+
+/// The maximum number of stage names, the extra ones sharing the last one
+inline constexpr std::size_t max_stages = 256;
+
+/// Number of events kept per thread, the older ones being overwritten
+inline constexpr std::size_t ring_capacity = 1 << 16;
+
+/** Number of duration buckets of the histograms, bucket b counting
+    the durations in [2^(b-1), 2^b) ns */
+inline constexpr std::size_t bucket_number = 40;
+
+/// The clock of the timers
+using clock_type = std::chrono::steady_clock;
+
+/// A timed execution of a stage
+struct event {
+  /// Start time in ns since the origin of the trace
+  std::uint64_t begin;
+  /// Duration in ns, 0 for an instant event
+  std::uint32_t duration;
+  /// The stage executed
+  stage_id stage;
+};
+
+/** The events of 1 thread, written only by this thread and read by
+    the exporting thread
+
+    This is a seqlock-like ring: the reader copies the events and then
+    discards the ones the writer may have overwritten meanwhile.
+*/
+class ring {
+  std::unique_ptr<event[]> events =
+      std::make_unique<event[]>(ring_capacity);
+
+  /// Number of events written since the beginning
+  std::atomic<std::uint64_t> written = 0;
+
+ public:
+  /// The thread name displayed in the trace
+  std::string name;
+
+  /// Record an event, only from the owning thread
+  void push(const event& e) {
+    auto w = written.load(std::memory_order_relaxed);
+    events[w % ring_capacity] = e;
+    written.store(w + 1, std::memory_order_release);
+  }
+
+  /// Copy the events still in the ring, from any thread
+  std::vector<event> snapshot() const {
+    auto end = written.load(std::memory_order_acquire);
+    auto begin = end - std::min<std::uint64_t>(end, ring_capacity);
+    std::vector<event> copy;
+    copy.reserve(end - begin);
+    for (auto i = begin; i < end; ++i)
+      copy.push_back(events[i % ring_capacity]);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    /* The events overwritten during the copy, or being overwritten,
+       are no longer valid */
+    if (auto after = written.load(std::memory_order_relaxed);
+        after + 1 > begin + ring_capacity)
+      copy.erase(copy.begin(),
+                 copy.begin() + std::min(after + 1 - ring_capacity - begin,
+                                         end - begin));
+    return copy;
+  }
+};
+
+/// The rolling duration histogram of a stage, updated from any thread
+struct histogram {
+  std::array<std::atomic<std::uint64_t>, bucket_number> buckets {};
+
+  /// Longest duration in ns
+  std::atomic<std::uint32_t> max = 0;
+
+  /// The bucket of a duration
+  static std::size_t bucket(std::uint32_t duration) {
+    return std::min<std::size_t>(std::bit_width(duration), bucket_number - 1);
+  }
+
+  /// Account for a duration in ns
+  void add(std::uint32_t duration) {
+    buckets[bucket(duration)].fetch_add(1, std::memory_order_relaxed);
+    for (auto m = max.load(std::memory_order_relaxed);
+         duration > m && !max.compare_exchange_weak(
+                             m, duration, std::memory_order_relaxed);)
+      ;
+  }
+
+  /// Start a new window
+  void reset() {
+    for (auto& b : buckets)
+      b.store(0, std::memory_order_relaxed);
+    max.store(0, std::memory_order_relaxed);
+  }
+};
+
+/// The statistics of a stage over a window
+struct statistics {
+  std::string name;
+  /// Number of executions
+  std::uint64_t count;
+  /// Upper bounds in ns of the percentiles, from the histogram buckets
+  std::uint64_t p50, p99;
+  /// Longest duration in ns
+  std::uint32_t max;
+};
+
+namespace detail {
+
+/// All the tracing state, shared by the threads
+struct registry {
+  /// Protect the stage names and the ring list, never used on the hot path
+  std::mutex m;
+
+  std::vector<std::string> names;
+
+  std::array<histogram, max_stages> histograms;
+
+  /// The rings of all the threads which have recorded something
+  std::vector<std::unique_ptr<ring>> rings;
+
+  /// The origin of the event times
+  const clock_type::time_point origin = clock_type::now();
+
+  /// Whether the events are recorded
+  std::atomic<bool> recording = true;
+};
+
+inline registry& state() {
+  static registry r;
+  return r;
+}
+
+/// The ring of the current thread, registered on its first event
+inline ring& thread_ring() {
+  thread_local ring* r = [] {
+    // Only once per thread
+    MUSYCL_RT_SAFETY_ALLOW();
+    auto& s = state();
+    std::scoped_lock lock { s.m };
+    return s.rings.emplace_back(std::make_unique<ring>()).get();
+  }();
+  return *r;
+}
+
+/// The time since the origin of the trace in ns
+inline std::uint64_t now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             clock_type::now() - state().origin)
+      .count();
+}
+
+} // namespace detail
+
+/** Get the identifier of a stage name, registering it the first time
+
+    This takes a lock, so it is meant to be called once per timer,
+    as done by MUSYCL_TRACE_SCOPE().
+*/
+inline stage_id stage(std::string_view name) {
+  MUSYCL_RT_SAFETY_ALLOW();
+  auto& s = detail::state();
+  std::scoped_lock lock { s.m };
+  if (auto n = std::ranges::find(s.names, name); n != s.names.end())
+    return n - s.names.begin();
+  if (s.names.size() == max_stages - 1)
+    s.names.emplace_back("other");
+  if (s.names.size() == max_stages)
+    return max_stages - 1;
+  s.names.emplace_back(name);
+  return s.names.size() - 1;
+}
+
+/// Name the current thread in the trace
+inline void set_thread_name(std::string name) {
+  auto& r = detail::thread_ring();
+  std::scoped_lock lock { detail::state().m };
+  r.name = std::move(name);
+}
+
+/// Start or stop recording the events, to freeze the trace after an incident
+inline void set_recording(bool on) { detail::state().recording = on; }
+
+/// Record a timing of a stage measured elsewhere
+inline void record(stage_id stage, std::uint64_t begin, std::uint64_t end) {
+  auto& s = detail::state();
+  auto duration = static_cast<std::uint32_t>(
+      std::min<std::uint64_t>(end - begin, UINT32_MAX));
+  s.histograms[stage].add(duration);
+  if (s.recording.load(std::memory_order_relaxed))
+    detail::thread_ring().push({ begin, duration, stage });
+}
+
+/// Record an instant event, like an audio drop-out
+inline void mark(stage_id stage) {
+  if (detail::state().recording.load(std::memory_order_relaxed))
+    detail::thread_ring().push({ detail::now(), 0, stage });
+}
+
+/// Time the execution of a stage up to the end of the scope
+class scope {
+  stage_id id;
+  std::uint64_t begin = detail::now();
+
+ public:
+  explicit scope(stage_id stage)
+      : id { stage } {}
+
+  scope(const scope&) = delete;
+  scope& operator=(const scope&) = delete;
+
+  ~scope() { record(id, begin, detail::now()); }
+};
+
+/** The statistics of each executed stage since the last call
+
+    \param[in] reset starts a new window, to have rolling statistics
+*/
+inline std::vector<statistics> stage_statistics(bool reset = true) {
+  auto& s = detail::state();
+  std::scoped_lock lock { s.m };
+  std::vector<statistics> result;
+  for (std::size_t id = 0; id < s.names.size(); ++id) {
+    auto& h = s.histograms[id];
+    std::array<std::uint64_t, bucket_number> counts;
+    std::uint64_t count = 0;
+    for (std::size_t b = 0; b < bucket_number; ++b)
+      count += counts[b] = h.buckets[b].load(std::memory_order_relaxed);
+    if (count == 0)
+      continue;
+    // The upper bound of the bucket reaching a fraction of the count
+    auto percentile = [&](double p) {
+      std::uint64_t sum = 0;
+      for (std::size_t b = 0; b < bucket_number; ++b)
+        if ((sum += counts[b]) >= p * count)
+          return std::uint64_t { 1 } << b;
+      return std::uint64_t { 1 } << (bucket_number - 1);
+    };
+    result.push_back({ s.names[id], count, percentile(0.5), percentile(0.99),
+                       h.max.load(std::memory_order_relaxed) });
+    if (reset)
+      h.reset();
+  }
+  return result;
+}
+
+/// Display the statistics of the stages, in µs
+inline void display_statistics(std::ostream& os,
+                               const std::vector<statistics>& stats) {
+  for (auto& s : stats)
+    os << std::setw(36) << std::left << s.name << std::right
+       << " count " << std::setw(8) << s.count << " p50 <" << std::setw(8)
+       << s.p50 / 1e3 << " p99 <" << std::setw(8) << s.p99 / 1e3 << " max "
+       << std::setw(8) << s.max / 1e3 << " us\n";
+  os.flush();
+}
+
+/** Write the events of all the threads in the Chrome trace event
+    format, to be loaded into Perfetto or chrome://tracing
+
+    \throw std::runtime_error if the file cannot be written
+*/
+inline void write_chrome_json(const std::string& file_name) {
+  std::ofstream f { file_name };
+  if (!f)
+    throw std::runtime_error { "trace: cannot open " + file_name };
+  auto& s = detail::state();
+  std::scoped_lock lock { s.m };
+  // Quote a name for JSON
+  auto quoted = [](std::string_view n) {
+    std::string q { '"' };
+    for (auto c : n) {
+      if (c == '"' || c == '\\')
+        q += '\\';
+      q += static_cast<unsigned char>(c) < ' ' ? ' ' : c;
+    }
+    return q + '"';
+  };
+  f << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\": \"ms\", "
+    << "\"traceEvents\": [";
+  auto first = true;
+  auto separator = [&] {
+    f << (first ? "\n" : ",\n");
+    first = false;
+  };
+  for (std::size_t tid = 0; tid < s.rings.size(); ++tid) {
+    auto& r = *s.rings[tid];
+    separator();
+    f << R"({"name": "thread_name", "ph": "M", "pid": 1, "tid": )" << tid
+      << R"(, "args": {"name": )"
+      << quoted(r.name.empty() ? "thread " + std::to_string(tid) : r.name)
+      << "}}";
+    for (auto& e : r.snapshot()) {
+      separator();
+      f << R"({"name": )" << quoted(s.names[e.stage])
+        << R"(, "cat": "musycl", "ph": ")" << (e.duration ? 'X' : 'i')
+        << R"(", "pid": 1, "tid": )" << tid << R"(, "ts": )" << e.begin / 1e3;
+      if (e.duration)
+        f << R"(, "dur": )" << e.duration / 1e3;
+      else
+        f << R"(, "s": "t")";
+      f << '}';
+    }
+  }
+  f << "\n]}\n";
+  if (!f)
+    throw std::runtime_error { "trace: cannot write " + file_name };
+}
+
+} // namespace musycl::trace
+
+#define MUSYCL_TRACE_CONCAT_DETAIL(a, b) a##b
+#define MUSYCL_TRACE_CONCAT(a, b) MUSYCL_TRACE_CONCAT_DETAIL(a, b)
+
+#ifdef MUSYCL_TRACE
+/** Time the rest of the enclosing scope as the stage \c name, with a
+    name computed only once */
+#define MUSYCL_TRACE_SCOPE(name)                                             \
+  static const auto MUSYCL_TRACE_CONCAT(musycl_trace_stage_, __LINE__) =    \
+      ::musycl::trace::stage(name);                                          \
+  ::musycl::trace::scope MUSYCL_TRACE_CONCAT(musycl_trace_scope_, __LINE__) { \
+    MUSYCL_TRACE_CONCAT(musycl_trace_stage_, __LINE__)                       \
+  }
+/// Time the rest of the enclosing scope as a stage_id computed elsewhere
+#define MUSYCL_TRACE_STAGE_SCOPE(id)                                         \
+  ::musycl::trace::scope MUSYCL_TRACE_CONCAT(musycl_trace_scope_, __LINE__) { \
+    id                                                                       \
+  }
+/// Record an instant event named \c name, like an audio drop-out
+#define MUSYCL_TRACE_MARK(name)                                              \
+  do {                                                                       \
+    static const auto musycl_trace_stage = ::musycl::trace::stage(name);    \
+    ::musycl::trace::mark(musycl_trace_stage);                               \
+  } while (false)
+#else
+#define MUSYCL_TRACE_SCOPE(name) static_cast<void>(0)
+#define MUSYCL_TRACE_STAGE_SCOPE(id) static_cast<void>(0)
+#define MUSYCL_TRACE_MARK(name) static_cast<void>(0)
+#endif
+
+#endif // MUSYCL_TRACE_HPP
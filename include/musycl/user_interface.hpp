@@ -13,6 +13,7 @@
 #include <range/v3/all.hpp>
 
 #include "control.hpp"
+#include "log.hpp"
 
 // Forward declare for now
 //#include "group.hpp"
@@ -81,8 +82,8 @@ class user_interface {
       \param[in] pi is the physical_item to process
   */
   void dispatch(control::physical_item& pi) {
-    std::cout << "Dispatch from UI " << (void*)this << " with "
-              << active_layers.size() << " layers" << std::endl;
+    MUSYCL_LOG_DEBUG("Dispatch from UI {} with {} layers", (void*)this,
+                     active_layers.size());
     // Dispatch the physical_item with the first matching dispatcher
     // across the layer stack
     for (auto layer : active_layers | ranges::views::reverse)
@@ -0,0 +1,178 @@
+#ifndef MUSYCL_WATCHDOG_HPP
+#define MUSYCL_WATCHDOG_HPP
+
+/** \file Detect the frames computed too late and degrade the sound
+    quality gracefully instead of having audio drop-outs
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "config.hpp"
+
+#include "log.hpp"
+#include "trace.hpp"
+
+namespace musycl {
+
+/** Track the computation time of each audio frame against the frame
+    period, which is the deadline of a real-time audio output
+
+    On a sustained overload the next degradation step is applied, like
+    bypassing an expensive effect, and when there is enough headroom
+    for a while the last applied step is reverted. The steps are
+    applied in their insertion order, so the less audible ones should
+    come first.
+*/
+class watchdog {
+ public:
+  /** A degradation of the quality, called with true to degrade and
+      false to restore */
+  using action = std::function<void(bool)>;
+
+ private:
+  /// A degradation step
+  struct step {
+    std::string name;
+    action apply;
+  };
+
+  /// The degradation steps in application order
+  std::vector<step> steps;
+
+  /// Number of steps currently applied
+  int applied = 0;
+
+  /// The load above which a frame is considered as overloaded
+  double overload_load = 0.9;
+
+  /// The load below which a frame leaves enough headroom
+  double headroom_load = 0.6;
+
+  /// Number of overloaded frames in a window triggering a degradation
+  int overload_frames = 4;
+
+  /// Number of frames of the window where the overloaded frames are counted
+  int window_frames = static_cast<int>(frame_frequency / 2);
+
+  /// Number of consecutive frames with headroom to trigger a restoration
+  int headroom_frames = static_cast<int>(2 * frame_frequency);
+
+  /** Number of overloaded frames in the current window, to react to a
+      sustained overload but not to a single spike */
+  int overloaded = 0;
+
+  /// Number of frames in the current window
+  int window_position = 0;
+
+  /// Number of consecutive frames with headroom
+  int relaxed = 0;
+
+  /// Number of frames computed later than the frame period
+  std::uint64_t misses = 0;
+
+  /// Apply or revert a step and tell it
+  void change(bool degrade) {
+    auto& s = steps[degrade ? applied++ : --applied];
+    // Told through the logger since this runs on the audio thread
+    MUSYCL_LOG_WARNING(degrade ? "Watchdog: overload, {}"
+                               : "Watchdog: headroom, undo {}",
+                       std::string_view { s.name });
+    if (degrade)
+      MUSYCL_TRACE_MARK("watchdog::degrade");
+    else
+      MUSYCL_TRACE_MARK("watchdog::restore");
+    s.apply(degrade);
+    overloaded = 0;
+    window_position = 0;
+    relaxed = 0;
+  }
+
+ public:
+  /** Append a degradation step
+
+      \param[in] name describes the step when it is applied
+
+      \param[in] apply is called with true to degrade, false to restore
+
+      \return the watchdog itself to enable command chaining
+  */
+  auto& add_step(std::string name, action apply) {
+    steps.push_back({ std::move(name), std::move(apply) });
+    return *this;
+  }
+
+  /** Set the loads, as a ratio of the frame computation time over the
+      frame period, considered as an overload and as enough headroom
+
+      \return the watchdog itself to enable command chaining
+  */
+  auto& set_loads(double overload, double headroom) {
+    overload_load = overload;
+    headroom_load = headroom;
+    return *this;
+  }
+
+  /** Set the reactivity
+
+      \param[in] overload is the number of overloaded frames during
+      \c window which triggers a degradation
+
+      \param[in] window is the time in second where the overloaded
+      frames are counted
+
+      \param[in] recovery is the time with enough headroom in second
+      which triggers a restoration
+
+      \return the watchdog itself to enable command chaining
+  */
+  auto& set_reaction(int overload, double window, double recovery) {
+    overload_frames = overload;
+    window_frames = std::max(1, static_cast<int>(window * frame_frequency));
+    headroom_frames = static_cast<int>(recovery * frame_frequency);
+    return *this;
+  }
+
+  /** Account for the computation of a frame, possibly changing the
+      quality
+
+      This is called from the thread computing the frames, which is
+      also where the steps are applied.
+
+      \param[in] time is the computation time of the frame in second
+  */
+  void frame(double time) {
+    auto load = time / frame_period;
+    if (load > 1)
+      ++misses;
+    if (++window_position > window_frames) {
+      // Start a new window
+      window_position = 1;
+      overloaded = 0;
+    }
+    if (load > overload_load) {
+      relaxed = 0;
+      if (++overloaded >= overload_frames &&
+          applied < static_cast<int>(steps.size()))
+        change(true);
+    } else if (load >= headroom_load)
+      relaxed = 0;
+    else if (++relaxed >= headroom_frames && applied > 0)
+      change(false);
+  }
+
+  /// Number of degradation steps currently applied
+  int level() const { return applied; }
+
+  /// Number of frames computed later than the frame period
+  std::uint64_t deadline_misses() const { return misses; }
+};
+
+} // namespace musycl
+
+#endif // MUSYCL_WATCHDOG_HPP
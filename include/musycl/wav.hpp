@@ -0,0 +1,330 @@
+#ifndef MUSYCL_WAV_HPP
+#define MUSYCL_WAV_HPP
+
+/** \file Read and write audio content as WAV files
+
+    http://soundfile.sapp.org/doc/WaveFormat/
+    https://tech.ebu.ch/docs/tech/tech3306v1_1.pdf for the RF64 extension
+*/
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+
+namespace musycl::wav {
+
+/// The audio content of a WAV file, 1 sample vector per channel
+struct content {
+  /// The sampling frequency of the content in Hz
+  int sample_rate = sample_frequency;
+
+  /// The samples of each channel, in [ -1, +1 ]
+  std::vector<std::vector<float>> channels;
+
+  /// Number of samples per channel
+  std::size_t length() const {
+    return channels.empty() ? 0 : channels.front().size();
+  }
+
+  /** Resample the content with a linear interpolation
+
+      This is only intended to adapt some content like impulse
+      responses to the synthesizer sampling frequency.
+
+      \return the content itself to enable command chaining
+  */
+  content& resample(int new_sample_rate) {
+    if (new_sample_rate == sample_rate || length() == 0)
+      return *this;
+    auto ratio = static_cast<double>(sample_rate) / new_sample_rate;
+    auto new_length =
+        static_cast<std::size_t>((length() - 1) / ratio) + 1;
+    for (auto& c : channels) {
+      std::vector<float> r(new_length);
+      for (std::size_t i = 0; i < new_length; ++i) {
+        auto position = i * ratio;
+        auto index = static_cast<std::size_t>(position);
+        auto fraction = static_cast<float>(position - index);
+        auto next = std::min(index + 1, c.size() - 1);
+        r[i] = c[index] * (1 - fraction) + c[next] * fraction;
+      }
+      c = std::move(r);
+    }
+    sample_rate = new_sample_rate;
+    return *this;
+  }
+};
+
+namespace detail {
+
+  /// Read a little-endian unsigned integer of \c Bytes bytes
+  template <int Bytes> std::uint64_t little_endian(const std::uint8_t* p) {
+    std::uint64_t v = 0;
+    for (int i = Bytes - 1; i >= 0; --i)
+      v = v << 8 | p[i];
+    return v;
+  }
+
+  /// Store a little-endian unsigned integer of \c Bytes bytes
+  template <int Bytes> void put_little_endian(std::uint8_t* p, std::uint64_t v) {
+    for (int i = 0; i < Bytes; ++i)
+      p[i] = v >> 8 * i;
+  }
+
+  /// Decode 1 sample stored in a given format into [ -1, +1 ]
+  inline float decode(const std::uint8_t* p, bool is_float, int bits) {
+    if (is_float) {
+      if (bits == 32) {
+        float f;
+        std::memcpy(&f, p, sizeof f);
+        return f;
+      }
+      double d;
+      std::memcpy(&d, p, sizeof d);
+      return d;
+    }
+    switch (bits) {
+    case 8:
+      // 8-bit PCM is unsigned
+      return (p[0] - 128) / 128.f;
+    case 16:
+      return static_cast<std::int16_t>(little_endian<2>(p)) / 32768.f;
+    case 24:
+      // Sign-extend by shifting into the 32-bit MSB
+      return static_cast<std::int32_t>(little_endian<3>(p) << 8) /
+             2147483648.f;
+    default:
+      return static_cast<std::int32_t>(little_endian<4>(p)) / 2147483648.f;
+    }
+  }
+
+} // namespace detail
+
+/** Read a WAV file
+
+    Handle 8/16/24/32-bit PCM and 32/64-bit IEEE float content, with
+    RIFF, RF64 and WAVE_FORMAT_EXTENSIBLE headers.
+
+    \param[in] file_name is the path of the file to read
+
+    \throw std::runtime_error if the file cannot be read or decoded
+*/
+inline content read(const std::string& file_name) {
+  std::ifstream f { file_name, std::ios::binary };
+  if (!f)
+    throw std::runtime_error { "Cannot open WAV file " + file_name };
+  const std::vector<std::uint8_t> b { std::istreambuf_iterator<char> { f },
+                                      {} };
+  auto error = [&](const std::string& message) {
+    return std::runtime_error { file_name + ": " + message };
+  };
+  if (b.size() < 12 ||
+      (std::memcmp(&b[0], "RIFF", 4) && std::memcmp(&b[0], "RF64", 4)) ||
+      std::memcmp(&b[8], "WAVE", 4))
+    throw error("not a RIFF/RF64 WAVE file");
+
+  int format = 0;
+  int channel_number = 0;
+  int sample_rate = 0;
+  int bits = 0;
+  // RF64 stores the real data size in the ds64 chunk
+  std::uint64_t ds64_data_size = 0;
+  const std::uint8_t* data = nullptr;
+  std::uint64_t data_size = 0;
+  // Iterate on the chunks, which are 2-byte aligned
+  for (std::size_t p = 12; p + 8 <= b.size();) {
+    auto id = &b[p];
+    std::uint64_t size = detail::little_endian<4>(&b[p + 4]);
+    auto payload = p + 8;
+    if (!std::memcmp(id, "ds64", 4) && payload + 16 <= b.size())
+      ds64_data_size = detail::little_endian<8>(&b[payload + 8]);
+    else if (!std::memcmp(id, "fmt ", 4) && payload + 16 <= b.size()) {
+      format = detail::little_endian<2>(&b[payload]);
+      channel_number = detail::little_endian<2>(&b[payload + 2]);
+      sample_rate = detail::little_endian<4>(&b[payload + 4]);
+      bits = detail::little_endian<2>(&b[payload + 14]);
+      // WAVE_FORMAT_EXTENSIBLE keeps the real format in the sub-format GUID
+      if (format == 0xfffe && size >= 26 && payload + 26 <= b.size())
+        format = detail::little_endian<2>(&b[payload + 24]);
+    } else if (!std::memcmp(id, "data", 4)) {
+      if (size == 0xffffffff)
+        size = ds64_data_size;
+      data = &b[payload];
+      data_size = std::min<std::uint64_t>(size, b.size() - payload);
+      break;
+    }
+    p = payload + size + (size & 1);
+  }
+  const bool is_float = format == 3;
+  if (!data || channel_number == 0 || (format != 1 && !is_float) ||
+      (is_float && bits != 32 && bits != 64) ||
+      (!is_float && (bits % 8 || bits < 8 || bits > 32)))
+    throw error("unsupported WAV content");
+
+  content c;
+  c.sample_rate = sample_rate;
+  const auto bytes_per_sample = bits / 8;
+  const auto frames = data_size / (bytes_per_sample * channel_number);
+  c.channels.assign(channel_number, std::vector<float>(frames));
+  // Deinterleave the samples
+  for (std::uint64_t i = 0; i < frames; ++i)
+    for (int ch = 0; ch < channel_number; ++ch)
+      c.channels[ch][i] = detail::decode(
+          data + (i * channel_number + ch) * bytes_per_sample, is_float, bits);
+  return c;
+}
+
+/** Write a WAV file incrementally, as 32-bit IEEE float samples
+
+    The header has room for a ds64 chunk, so the file is turned into
+    RF64 when it is closed if the content ends up too large for RIFF.
+*/
+class writer {
+  /// The size of the header up to the audio content
+  static constexpr std::size_t header_size = 12 + 8 + 28 + 8 + 16 + 8;
+
+  /// The file written
+  std::ofstream f;
+
+  /// The name of the file for the error messages
+  std::string file_name;
+
+  /// Number of interleaved channels
+  int channel_number;
+
+  /// Sampling frequency in Hz
+  int sample_rate;
+
+  /// Number of samples per channel written so far
+  std::uint64_t frames = 0;
+
+  /// Conversion buffer reused across the writes
+  std::vector<float> interleaved;
+
+  /// Write the header according to the current content size
+  void write_header() {
+    std::array<std::uint8_t, header_size> h {};
+    auto put_id = [&](std::size_t offset, const char* id) {
+      std::memcpy(&h[offset], id, 4);
+    };
+    const std::uint64_t data_size = frames * channel_number * sizeof(float);
+    const std::uint64_t riff_size = header_size - 8 + data_size;
+    const bool rf64 = riff_size > 0xffffffff;
+    put_id(0, rf64 ? "RF64" : "RIFF");
+    detail::put_little_endian<4>(&h[4], rf64 ? 0xffffffff : riff_size);
+    put_id(8, "WAVE");
+    // A ds64 chunk for RF64, otherwise a JUNK chunk keeping its room
+    put_id(12, rf64 ? "ds64" : "JUNK");
+    detail::put_little_endian<4>(&h[16], 28);
+    if (rf64) {
+      detail::put_little_endian<8>(&h[20], riff_size);
+      detail::put_little_endian<8>(&h[28], data_size);
+      detail::put_little_endian<8>(&h[36], frames);
+    }
+    put_id(48, "fmt ");
+    detail::put_little_endian<4>(&h[52], 16);
+    // WAVE_FORMAT_IEEE_FLOAT
+    detail::put_little_endian<2>(&h[56], 3);
+    detail::put_little_endian<2>(&h[58], channel_number);
+    detail::put_little_endian<4>(&h[60], sample_rate);
+    detail::put_little_endian<4>(&h[64],
+                                 sample_rate * channel_number * sizeof(float));
+    detail::put_little_endian<2>(&h[68], channel_number * sizeof(float));
+    detail::put_little_endian<2>(&h[70], 8 * sizeof(float));
+    put_id(72, "data");
+    detail::put_little_endian<4>(&h[76], rf64 ? 0xffffffff : data_size);
+    f.seekp(0);
+    f.write(reinterpret_cast<const char*>(h.data()), h.size());
+  }
+
+ public:
+  /** Create a WAV file
+
+      \param[in] file_name is the path of the file to write
+
+      \param[in] channels is the number of audio channels
+
+      \param[in] sample_rate is the sampling frequency in Hz
+
+      \throw std::runtime_error if the file cannot be created
+  */
+  writer(const std::string& file_name, int channels = 2,
+         int sample_rate = sample_frequency)
+      : f { file_name, std::ios::binary }
+      , file_name { file_name }
+      , channel_number { channels }
+      , sample_rate { sample_rate } {
+    if (!f)
+      throw std::runtime_error { "Cannot create WAV file " + file_name };
+    write_header();
+  }
+
+  writer(const writer&) = delete;
+  writer& operator=(const writer&) = delete;
+
+  /// Finalize the file if not done yet, ignoring any error
+  ~writer() {
+    try {
+      close();
+    } catch (...) {
+    }
+  }
+
+  /** Append interleaved samples
+
+      \param[in] samples are the samples of all the channels for each
+      time step
+
+      \throw std::runtime_error if the file cannot be written
+  */
+  void write(std::span<const float> samples) {
+    f.write(reinterpret_cast<const char*>(samples.data()),
+            samples.size_bytes());
+    if (!f)
+      throw std::runtime_error { file_name + ": cannot write audio content" };
+    frames += samples.size() / channel_number;
+  }
+
+  /** Append a sequence of multi-channel samples, like an audio frame
+
+      \param[in] samples is a range of samples indexable by channel
+
+      \throw std::runtime_error if the file cannot be written
+  */
+  template <typename Samples> void write_samples(const Samples& samples) {
+    interleaved.clear();
+    for (auto& s : samples)
+      for (int c = 0; c < channel_number; ++c)
+        interleaved.push_back(s[c]);
+    write(interleaved);
+  }
+
+  /// Number of samples per channel written so far
+  std::uint64_t length() const { return frames; }
+
+  /** Update the header with the final size and close the file
+
+      \throw std::runtime_error if the file cannot be written
+  */
+  void close() {
+    if (!f.is_open())
+      return;
+    write_header();
+    f.close();
+    if (!f)
+      throw std::runtime_error { file_name + ": cannot finalize WAV file" };
+  }
+};
+
+} // namespace musycl::wav
+
+#endif // MUSYCL_WAV_HPP
@@ -0,0 +1,300 @@
+/** \file Microbenchmarks of the DSP building blocks
+
+    Each benchmark computes the work of 1 audio frame for a number of
+    voices, repeatedly, and reports the time per voice and per audio
+    sample, as well as the number of such voices a core can compute
+    in real time. The blocks which do not produce audio, like the MIDI
+    parser, report instead the time per unit of their own work. The
+    results are written as JSON on the standard
+    output to track the regressions.
+
+    The frame size is a compile-time constant of muSYCL, so there is 1
+    executable per frame size, like musycl_bench_64.
+*/
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <ranges>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include <sycl/sycl.hpp>
+
+#include <musycl/musycl.hpp>
+
+#include <musycl/midi/controller/keylab_essential.hpp>
+
+namespace {
+
+/// The result of a benchmark
+struct result {
+  /// The building block measured
+  std::string name;
+  /// "sycl" when it runs SYCL kernels, "host" for plain C++
+  std::string path;
+  /// The type of the samples processed
+  std::string sample_type;
+  /// Number of voices computed for each frame
+  int polyphony;
+  /// The unit of work, "sample" for a voice computing an audio sample
+  std::string unit;
+  /// Time per unit of work
+  double ns_per_unit;
+};
+
+/// Minimum time spent measuring each benchmark, in second
+double measure_time = 0.2;
+
+/// Only run the benchmarks whose name contains this
+std::string name_filter;
+
+/// The polyphonies to measure
+std::vector<int> polyphonies { 1, 8, 64 };
+
+/// The results in measuring order
+std::vector<result> results;
+
+/// Something written by the benchmarks so they are not optimized away
+volatile double sink;
+
+/** Measure the time to compute 1 frame for some voices
+
+    The frame computation is run in batches during the measure time
+    after a warm-up and the fastest batch is kept, to filter out the
+    noise from the rest of the system.
+
+    \param[in] unit is the unit of work reported
+
+    \param[in] units is the number of units of work in 1 frame
+*/
+void measure_units(std::string_view name, std::string_view path,
+                   std::string_view sample_type, int polyphony,
+                   std::string_view unit, int units,
+                   const std::function<void()>& frame) {
+  if (!name.contains(name_filter))
+    return;
+  using clock = std::chrono::steady_clock;
+  // Warm up the caches and the branch predictors
+  for (int i = 0; i < 10; ++i)
+    frame();
+  constexpr int batch = 20;
+  double best = std::numeric_limits<double>::max();
+  auto end = clock::now() + std::chrono::duration_cast<clock::duration>(
+                                std::chrono::duration<double> { measure_time });
+  do {
+    auto start = clock::now();
+    for (int i = 0; i < batch; ++i)
+      frame();
+    best = std::min(
+        best, std::chrono::duration<double, std::nano> { clock::now() - start }
+                      .count() /
+                  batch);
+  } while (clock::now() < end);
+  results.push_back({ std::string { name }, std::string { path },
+                      std::string { sample_type }, polyphony,
+                      std::string { unit }, best / units });
+}
+
+/// Measure the time to compute 1 frame of audio samples for some voices
+void measure(std::string_view name, std::string_view path,
+             std::string_view sample_type, int polyphony,
+             const std::function<void()>& frame) {
+  measure_units(name, path, sample_type, polyphony, "sample",
+                polyphony * musycl::frame_size, frame);
+}
+
+/// Keep some audio alive
+void consume(const musycl::audio::frame& f) { sink = sink + f[0][0]; }
+
+/// The name of a sample type
+template <typename T> constexpr const char* type_name() {
+  return std::is_same_v<T, float> ? "float" : "double";
+}
+
+/// Measure a filter on 1 frame of samples per voice
+template <typename Filter, typename T>
+void measure_filter(std::string_view name, int polyphony,
+                    const std::function<void(Filter&)>& setup) {
+  std::vector<Filter> filters(polyphony);
+  for (auto& f : filters)
+    setup(f);
+  std::vector<T> input(musycl::frame_size);
+  for (std::size_t i = 0; i < input.size(); ++i)
+    input[i] = (i % 64) / T { 32 } - 1;
+  measure(name, "host", type_name<T>(), polyphony, [&] {
+    T sum = 0;
+    for (auto& f : filters)
+      for (auto s : input)
+        sum += f.filter(s);
+    sink = sink + sum;
+  });
+}
+
+/// Display the results as JSON
+void display_json() {
+  std::cout << "{\n  \"frame_size\": " << musycl::frame_size
+            << ",\n  \"sample_frequency\": " << musycl::sample_frequency
+            << ",\n  \"benchmarks\": [";
+  for (auto first = true; auto& r : results) {
+    std::cout << (first ? "" : ",") << "\n    { \"name\": \"" << r.name
+              << "\", \"path\": \"" << r.path << "\", \"sample_type\": \""
+              << r.sample_type << "\", \"polyphony\": " << r.polyphony
+              << ", \"ns_per_" << r.unit << "\": " << r.ns_per_unit;
+    // Only the audio voices have a meaningful real-time polyphony
+    if (r.unit == "sample")
+      std::cout << ", \"voices_per_core\": "
+                << 1e9 / (r.ns_per_unit * musycl::sample_frequency);
+    std::cout << " }";
+    first = false;
+  }
+  std::cout << "\n  ]\n}" << std::endl;
+}
+
+/// Parse a comma-separated list of integers
+std::vector<int> parse_list(std::string_view s) {
+  std::vector<int> l;
+  for (auto&& e : std::views::split(s, ','))
+    l.push_back(std::stoi(std::string { e.begin(), e.end() }));
+  return l;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg == "--time" && i + 1 < argc)
+      measure_time = std::stod(argv[++i]);
+    else if (arg == "--filter" && i + 1 < argc)
+      name_filter = argv[++i];
+    else if (arg == "--polyphony" && i + 1 < argc)
+      polyphonies = parse_list(argv[++i]);
+    else {
+      std::cerr << "Usage: " << argv[0]
+                << " [--time seconds] [--filter name]"
+                   " [--polyphony n1,n2,...]"
+                << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  // The parameters of the sound generators need a user interface
+  musycl::user_interface ui;
+  musycl::controller::keylab_essential controller { ui };
+  musycl::dco::param_t dco_param { ui, "DCO" };
+  musycl::noise::param_t noise_param { ui, "Noise" };
+  musycl::envelope::param_t envelope_param { ui, "Envelope" };
+  envelope_param->attack_time = 0.1;
+  envelope_param->decay_time = 0.1;
+  envelope_param->sustain_level = 0.5;
+  envelope_param->release_time = 0.1;
+
+  for (auto polyphony : polyphonies) {
+    // Use a deque so the voices are never moved, since some follow the clock
+    {
+      std::deque<musycl::dco> voices;
+      for (int v = 0; v < polyphony; ++v)
+        voices.emplace_back(dco_param).start({ 0, 36 + v % 48, 100 });
+      measure("dco::audio", "host", "double", polyphony, [&] {
+        for (auto& v : voices)
+          consume(v.audio());
+      });
+    }
+    {
+      std::deque<musycl::noise> voices;
+      for (int v = 0; v < polyphony; ++v)
+        voices.emplace_back(noise_param).start({ 0, 36 + v % 48, 100 });
+      measure("noise::audio", "host", "double", polyphony, [&] {
+        for (auto& v : voices)
+          consume(v.audio());
+      });
+    }
+    {
+      std::deque<musycl::envelope> voices;
+      for (int v = 0; v < polyphony; ++v)
+        voices.emplace_back(envelope_param).start();
+      measure("envelope::frame_clock", "host", "float", polyphony, [&] {
+        for (auto& v : voices) {
+          v.frame_clock();
+          // Keep the envelopes running
+          if (!v.is_running())
+            v.start();
+          sink = sink + v.out();
+        }
+      });
+      /* Clock all the consumers of the frame clock, here the
+         envelopes of the voices */
+      measure("clock::tick_frame_clock", "host", "float", polyphony,
+              [&] { musycl::clock::tick_frame_clock(); });
+    }
+    // The filters with a sample type from the caller
+    auto filters = [&]<typename T>() {
+      measure_filter<musycl::low_pass_filter, T>(
+          "low_pass_filter::filter", polyphony,
+          [](auto& f) { f.set_cutoff_frequency(1000); });
+      measure_filter<musycl::resonance_filter, T>(
+          "resonance_filter::filter", polyphony,
+          [](auto& f) { f.set_frequency(1000).set_resonance(0.9); });
+      measure_filter<musycl::ladder_filter, T>(
+          "ladder_filter::filter", polyphony,
+          [](auto& f) { f.set_frequency(1000).set_resonance(2); });
+    };
+    filters.operator()<float>();
+    filters.operator()<double>();
+    {
+      // A note on and off for each voice, with running status
+      std::vector<std::uint8_t> stream;
+      for (int v = 0; v < polyphony; ++v)
+        for (auto b : { 0x90, 36 + v % 48, 100, 0x80, 36 + v % 48, 0 })
+          stream.push_back(b);
+      musycl::midi::parser p;
+      // The parsing has nothing to do with the audio samples
+      measure_units("midi::parse", "host", "byte", polyphony, "message",
+                    2 * polyphony, [&] {
+                      p.parse(stream,
+                              [](auto& m) { sink = sink + m.index(); });
+                    });
+    }
+  }
+
+  /* The effects are measured per instance, since they usually run
+     once on a bus, and some have large delay lines */
+  musycl::audio::frame audio;
+  for (std::size_t i = 0; i < audio.size(); ++i)
+    audio[i] = (i % 64) / 32. - 1;
+  {
+    musycl::effect::delay delay;
+    measure("effect::delay", "sycl", "double", 1, [&] {
+      auto a = audio;
+      delay.process(a);
+      consume(a);
+    });
+  }
+  {
+    musycl::effect::flanger flanger;
+    measure("effect::flanger", "sycl", "double", 1, [&] {
+      auto a = audio;
+      flanger.process(musycl::audio::buffer { &a, 1 });
+      consume(a);
+    });
+  }
+  {
+    auto range_delay = std::make_unique<musycl::effect::range_delay>();
+    range_delay->delay_line_ratio = 0.5;
+    measure("effect::range_delay", "host", "double", 1, [&] {
+      auto a = audio;
+      range_delay->process(a);
+      consume(a);
+    });
+  }
+  display_json();
+  return 0;
+}
@@ -0,0 +1,513 @@
+/** \file Deterministic golden-output regression checks of the sound
+    generators and the effects
+
+    Each scenario renders a fixed input offline, like a few notes on a
+    sound generator, a test signal through an effect or a MIDI file
+    through the whole synthesizer, with the random generators seeded
+    and the clock restarted, so the output is the same from run to run.
+
+    With --update the outputs are written as reference WAV files into a
+    directory. Otherwise they are compared with the references, both
+    sample-wise and with a log-spectral distance, so an optimization
+    changing the arithmetic, like SIMD, SYCL offload or float32
+    samples, can be accepted or rejected on evidence. The results are
+    written as JSON on the standard output and the exit status tells
+    whether all the scenarios pass.
+*/
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <numbers>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sycl/sycl.hpp>
+
+#include <musycl/musycl.hpp>
+
+#include <musycl/midi/controller/keylab_essential.hpp>
+
+namespace {
+
+/// The seed of the random generators for each scenario
+constexpr std::uint32_t seed = 1;
+
+/// Maximum absolute difference allowed between 2 samples
+double tolerance = 1e-4;
+
+/// Maximum log-spectral distance allowed between 2 blocks, in dB
+double spectral_tolerance = 0.1;
+
+/// Size of the blocks compared spectrally
+constexpr int spectrum_size = 2048;
+
+/// Power below which a spectrum bin is considered as silent, -90 dB
+constexpr double spectrum_floor = 1e-9;
+
+/// A fixed rendering
+struct scenario {
+  /// The name of the scenario, also the name of its reference file
+  std::string name;
+  /// Render the audio
+  std::function<musycl::wav::content()> render;
+};
+
+/// The comparison of an output with its reference
+struct result {
+  std::string name;
+  /// "pass", "fail", "missing" or "updated"
+  std::string status {};
+  double max_abs_error = 0;
+  double rms_error = 0;
+  /// The worst log-spectral distance of a block, in dB
+  double spectral_distance = 0;
+};
+
+/// Append a stereo audio frame to some content
+void append(musycl::wav::content& c, const musycl::audio::frame& f) {
+  c.channels.resize(2);
+  for (auto& s : f)
+    for (int ch = 0; ch < 2; ++ch)
+      c.channels[ch].push_back(s[ch]);
+}
+
+/** The test signal of the effects: an impulse, then some bursts of
+    sawtooth waves of different frequencies on each channel, with some
+    silence between them to hear the tails
+
+    The time is computed with integers, so the signal itself does not
+    depend on the floating-point optimizations being checked.
+*/
+musycl::audio::frame test_signal(int frame_index) {
+  musycl::audio::frame f;
+  constexpr std::int64_t rate = musycl::sample_frequency;
+  for (int i = 0; i < musycl::frame_size; ++i) {
+    std::int64_t n = frame_index * musycl::frame_size + i;
+    // On for 0.25 s every 0.5 s, starting after 0.25 s
+    double gate = n / (rate / 4) % 2 ? 0.5 : 0;
+    auto saw = [&](std::int64_t frequency) {
+      return gate * (2. * (n * frequency % rate) / rate - 1);
+    };
+    f[i] = { saw(110), saw(165) };
+  }
+  if (frame_index == 0)
+    f[0] = { 1, 1 };
+  return f;
+}
+
+/// Number of frames for a duration in second
+int frames(double duration) {
+  return static_cast<int>(duration * musycl::frame_frequency);
+}
+
+/// Render the test signal through an effect processing a frame in place
+musycl::wav::content
+render_effect(const std::function<void(musycl::audio::frame&)>& process) {
+  musycl::wav::content c;
+  for (int f = 0; f < frames(2); ++f) {
+    auto a = test_signal(f);
+    process(a);
+    append(c, a);
+  }
+  return c;
+}
+
+/// Render the left channel of the test signal through a mono filter
+template <typename Filter>
+musycl::wav::content render_filter(Filter filter) {
+  musycl::wav::content c;
+  c.channels.resize(1);
+  for (int f = 0; f < frames(2); ++f)
+    for (auto& s : test_signal(f))
+      c.channels[0].push_back(filter.filter(s[musycl::audio::left]));
+  return c;
+}
+
+/** Render a chord with a sound generator, the notes starting and
+    stopping at various samples inside the frames */
+musycl::wav::content
+render_notes(const musycl::sound_generator::param_t& param) {
+  struct event {
+    int sample;
+    musycl::midi::on on;
+    bool start;
+  };
+  const std::vector<event> events {
+    { 100, { 0, 48, 100 }, true },       { 7000, { 0, 55, 80 }, true },
+    { 15000, { 0, 60, 60 }, true },      { 30000, { 0, 48, 100 }, false },
+    { 40000, { 0, 55, 80 }, false },     { 45000, { 0, 60, 60 }, false },
+    { 60000, { 0, 67, 127 }, true },     { 70000, { 0, 67, 127 }, false },
+  };
+  // Use a deque so the voices are never moved, since some follow the clock
+  std::deque<musycl::sound_generator> voices;
+  std::vector<musycl::sound_generator*> playing(128);
+  musycl::wav::content c;
+  auto e = events.begin();
+  for (int f = 0; f < frames(2); ++f) {
+    for (; e != events.end() && e->sample < (f + 1) * musycl::frame_size;
+         ++e) {
+      auto offset = e->sample - f * musycl::frame_size;
+      auto on = e->on;
+      if (e->start) {
+        auto& v = voices.emplace_back(param);
+        v.skip_until(offset).start(on);
+        playing[on.note] = &v;
+      } else
+        playing[on.note]->render_until(offset).stop(on.as_off());
+    }
+    musycl::audio::frame mix {};
+    for (auto& v : voices) {
+      auto a = v.audio();
+      for (int i = 0; i < musycl::frame_size; ++i)
+        mix[i] += a[i];
+    }
+    append(c, mix);
+    musycl::clock::tick_frame_clock();
+  }
+  return c;
+}
+
+/** Render a Standard MIDI File with the whole synthesizer, like any
+    music, through musycl_render
+
+    The synthesizer uses global state and ends the program when
+    finished, so it runs in its own process.
+
+    \param[in] renderer is the path of the musycl_render program
+*/
+musycl::wav::content render_midi_file(const std::filesystem::path& renderer,
+                                      const musycl::midi::sequence& s) {
+  auto directory = std::filesystem::temp_directory_path();
+  auto input = directory / "musycl_golden.mid";
+  auto output = directory / "musycl_golden.wav";
+  musycl::midi::write_file(input, s);
+  auto command = "'" + renderer.string() + "' '" + input.string() + "' '" +
+                 output.string() + "' > /dev/null 2>&1";
+  if (std::system(command.c_str()) != 0)
+    throw std::runtime_error { "musycl_golden: cannot run " +
+                               renderer.string() };
+  auto c = musycl::wav::read(output);
+  std::filesystem::remove(input);
+  std::filesystem::remove(output);
+  return c;
+}
+
+/** A short piece on all the MIDI channels of the synthesizer, with a
+    tempo change in the middle and the notes starting at various ticks
+*/
+musycl::midi::sequence test_sequence() {
+  musycl::midi::sequence s;
+  auto quarter = s.ticks_per_quarter;
+  // 1 measure at 120 bpm, then 1 at 90 bpm
+  s.tempo_map.push_back({ static_cast<std::uint32_t>(4 * quarter), 666'667 });
+  for (int measure = 0; measure < 2; ++measure)
+    for (int channel = 0; channel < 6; ++channel) {
+      auto start = measure * 4 * quarter + channel * quarter / 2 + 7 * channel;
+      musycl::midi::on on { channel, 48 + 5 * channel + 2 * measure,
+                            64 + 10 * channel };
+      s.add(start, on);
+      s.add(start + 3 * quarter / 2, on.as_off());
+    }
+  std::ranges::stable_sort(s.events, {}, &musycl::midi::sequence::event::tick);
+  return s;
+}
+
+/// Write some content into a 32-bit float WAV file
+void save(const musycl::wav::content& c, const std::string& file_name) {
+  musycl::wav::writer w { file_name, static_cast<int>(c.channels.size()),
+                          c.sample_rate };
+  std::vector<float> interleaved;
+  for (std::size_t i = 0; i < c.length(); ++i)
+    for (auto& ch : c.channels)
+      interleaved.push_back(ch[i]);
+  w.write(interleaved);
+  w.close();
+}
+
+/// The power spectrum of a Hann-windowed block of a channel
+std::vector<double> power_spectrum(const musycl::fft& fft,
+                                   const std::vector<float>& channel,
+                                   std::size_t begin) {
+  std::vector<float> re(spectrum_size);
+  std::vector<float> im(spectrum_size);
+  for (int i = 0; i < spectrum_size && begin + i < channel.size(); ++i)
+    re[i] = channel[begin + i] *
+            (0.5 - 0.5 * std::cos(2 * std::numbers::pi * i / spectrum_size));
+  fft.forward(re, im);
+  std::vector<double> p(spectrum_size / 2 + 1);
+  for (std::size_t k = 0; k < p.size(); ++k)
+    p[k] = static_cast<double>(re[k]) * re[k] +
+           static_cast<double>(im[k]) * im[k];
+  return p;
+}
+
+/// Compare an output with its reference
+void compare(const musycl::wav::content& reference,
+             const musycl::wav::content& output, result& r) {
+  r.status = "fail";
+  if (reference.sample_rate != output.sample_rate ||
+      reference.channels.size() != output.channels.size() ||
+      reference.length() != output.length()) {
+    r.max_abs_error = r.rms_error = r.spectral_distance = INFINITY;
+    return;
+  }
+  double square_sum = 0;
+  for (std::size_t ch = 0; ch < reference.channels.size(); ++ch)
+    for (std::size_t i = 0; i < reference.length(); ++i) {
+      double d = reference.channels[ch][i] - output.channels[ch][i];
+      r.max_abs_error = std::max(r.max_abs_error, std::abs(d));
+      square_sum += d * d;
+    }
+  r.rms_error = std::sqrt(
+      square_sum /
+      std::max<std::size_t>(1, reference.channels.size() * reference.length()));
+  // Half-overlapping blocks
+  musycl::fft fft { spectrum_size };
+  for (std::size_t ch = 0; ch < reference.channels.size(); ++ch)
+    for (std::size_t b = 0; b < reference.length(); b += spectrum_size / 2) {
+      auto pr = power_spectrum(fft, reference.channels[ch], b);
+      auto po = power_spectrum(fft, output.channels[ch], b);
+      double sum = 0;
+      for (std::size_t k = 0; k < pr.size(); ++k) {
+        auto d = 10 * std::log10(std::max(pr[k], spectrum_floor) /
+                                 std::max(po[k], spectrum_floor));
+        sum += d * d;
+      }
+      r.spectral_distance =
+          std::max(r.spectral_distance, std::sqrt(sum / pr.size()));
+    }
+  if (r.max_abs_error <= tolerance && r.spectral_distance <= spectral_tolerance)
+    r.status = "pass";
+}
+
+/// Display the results as JSON
+void display_json(const std::vector<result>& results) {
+  std::cout << "{\n  \"tolerance\": " << tolerance
+            << ",\n  \"spectral_tolerance_db\": " << spectral_tolerance
+            << ",\n  \"scenarios\": [";
+  for (auto first = true; auto& r : results) {
+    std::cout << (first ? "" : ",") << "\n    { \"name\": \"" << r.name
+              << "\", \"status\": \"" << r.status << '"';
+    if (r.status == "pass" || r.status == "fail")
+      // JSON has no infinity
+      for (auto [key, value] :
+           { std::pair { "max_abs_error", r.max_abs_error },
+             std::pair { "rms_error", r.rms_error },
+             std::pair { "spectral_distance_db", r.spectral_distance } })
+        std::cout << ", \"" << key << "\": "
+                  << (std::isfinite(value) ? value : -1);
+    std::cout << " }";
+    first = false;
+  }
+  std::cout << "\n  ]\n}" << std::endl;
+}
+
+/// Whether all the results pass
+bool all_pass(const std::vector<result>& results) {
+  return std::ranges::all_of(results, [](auto& r) {
+    return r.status == "pass" || r.status == "updated";
+  });
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  bool update = false;
+  std::string name_filter;
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg == "--update")
+      update = true;
+    else if (arg == "--filter" && i + 1 < argc)
+      name_filter = argv[++i];
+    else if (arg == "--tolerance" && i + 1 < argc)
+      tolerance = std::stod(argv[++i]);
+    else if (arg == "--spectral-tolerance" && i + 1 < argc)
+      spectral_tolerance = std::stod(argv[++i]);
+    else if (!arg.starts_with("--"))
+      files.emplace_back(arg);
+    else {
+      files.clear();
+      break;
+    }
+  }
+  if (files.empty() || files.size() > 2 || (update && files.size() != 1)) {
+    std::cerr << "Usage: " << argv[0]
+              << " [--update] [--filter name] [--tolerance max_abs_error]"
+                 " [--spectral-tolerance dB] reference_directory\n"
+                 "       "
+              << argv[0]
+              << " [--tolerance max_abs_error] [--spectral-tolerance dB]"
+                 " reference.wav output.wav"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::vector<result> results;
+  if (files.size() == 2) {
+    // Compare 2 files, like 2 renderings of musycl_render
+    auto& r = results.emplace_back(result { files[1] });
+    compare(musycl::wav::read(files[0]), musycl::wav::read(files[1]), r);
+    display_json(results);
+    return all_pass(results) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  // The parameters of the sound generators need a user interface
+  musycl::user_interface ui;
+  musycl::controller::keylab_essential controller { ui };
+  musycl::dco::param_t dco_param { ui, "DCO" };
+  dco_param->square_volume = 0.5;
+  dco_param->square_pwm = 0.3;
+  dco_param->triangle_volume = 0.5;
+  musycl::dco_envelope::param_t dco_envelope_param { ui, "DCO envelope" };
+  dco_envelope_param->dco_param->square_volume = 0.5;
+  dco_envelope_param->dco_param->square_pwm = 0.5;
+  dco_envelope_param->env_param->attack_time = 0.05;
+  dco_envelope_param->env_param->decay_time = 0.1;
+  dco_envelope_param->env_param->sustain_level = 0.5;
+  dco_envelope_param->env_param->release_time = 0.2;
+  musycl::noise::param_t noise_param { ui, "Noise" };
+
+  const std::vector<scenario> scenarios {
+    { "dco", [&] { return render_notes(dco_param); } },
+    { "dco_envelope", [&] { return render_notes(dco_envelope_param); } },
+    { "noise", [&] { return render_notes(noise_param); } },
+    { "low_pass_filter",
+      [] {
+        musycl::low_pass_filter f;
+        f.set_cutoff_frequency(1000);
+        return render_filter(f);
+      } },
+    { "resonance_filter",
+      [] {
+        musycl::resonance_filter f;
+        f.set_frequency(1000).set_resonance(0.9);
+        return render_filter(f);
+      } },
+    { "ladder_filter",
+      [] {
+        musycl::ladder_filter f;
+        f.set_frequency(1000).set_resonance(2);
+        return render_filter(f);
+      } },
+    { "effect::compressor",
+      [] {
+        musycl::effect::compressor c;
+        c.set_threshold(-20).set_ratio(4).set_makeup(6);
+        return render_effect([&](auto& a) { c.process(a); });
+      } },
+    { "effect::convolution",
+      [] {
+        // A decaying noise as impulse response
+        musycl::counter_rng rng { seed };
+        std::vector<float> left(musycl::sample_frequency / 4);
+        std::vector<float> right(left.size());
+        for (std::size_t i = 0; i < left.size(); ++i) {
+          auto decay = std::exp(-10. * i / left.size()) / 32;
+          left[i] = decay * rng.uniform(2 * i);
+          right[i] = decay * rng.uniform(2 * i + 1);
+        }
+        musycl::effect::convolution c;
+        c.set_impulse_response(left, right);
+        return render_effect([&](auto& a) { c.process(a); });
+      } },
+    { "effect::delay",
+      [] {
+        musycl::effect::delay d;
+        d.delay_line_ratio = 0.5;
+        return render_effect([&](auto& a) { d.process(a); });
+      } },
+    { "effect::delay::ping_pong",
+      [] {
+        musycl::effect::delay d;
+        d.set_mode(musycl::effect::delay::mode::ping_pong);
+        d.delay_line_ratio = 0.5;
+        d.feedback_ratio = 0.5;
+        return render_effect([&](auto& a) { d.process(a); });
+      } },
+    { "effect::delay::multi_tap",
+      [] {
+        musycl::effect::delay d;
+        d.set_mode(musycl::effect::delay::mode::multi_tap);
+        d.delay_line_time = 0.1;
+        d.delay_line_ratio = 0.5;
+        return render_effect([&](auto& a) { d.process(a); });
+      } },
+    { "effect::delay::sync",
+      [] {
+        using musycl::effect::delay;
+        delay d;
+        // A dotted eighth note at the default 120 bpm of the clock
+        d.set_sync(delay::dotted(delay::eighth));
+        d.delay_line_ratio = 0.5;
+        return render_effect([&](auto& a) { d.process(a); });
+      } },
+    { "effect::flanger",
+      [] {
+        musycl::effect::flanger f;
+        return render_effect(
+            [&](auto& a) { f.process(musycl::audio::buffer { &a, 1 }); });
+      } },
+    { "effect::limiter",
+      [] {
+        musycl::effect::limiter l;
+        l.set_ceiling(0.3);
+        return render_effect([&](auto& a) { l.process(a); });
+      } },
+    { "effect::range_delay",
+      [] {
+        auto d = std::make_unique<musycl::effect::range_delay>();
+        d->delay_line_ratio = 0.5;
+        return render_effect([&](auto& a) { d->process(a); });
+      } },
+    { "effect::reverb",
+      [] {
+        musycl::effect::reverb r;
+        r.reverb_ratio = 0.5;
+        return render_effect([&](auto& a) { r.process(a); });
+      } },
+    { "synthesizer",
+      [&] {
+        // musycl_render is built next to this program
+        return render_midi_file(
+            std::filesystem::path { argv[0] }.replace_filename(
+                "musycl_render"),
+            test_sequence());
+      } },
+  };
+
+  std::filesystem::path directory = files[0];
+  if (update)
+    std::filesystem::create_directories(directory);
+  for (auto& s : scenarios) {
+    if (!s.name.contains(name_filter))
+      continue;
+    // Each scenario starts from the same random sequences and time
+    musycl::dco::seed(seed);
+    musycl::noise::seed(seed);
+    musycl::clock::reset();
+    auto output = s.render();
+    auto reference_name = s.name;
+    std::ranges::replace(reference_name, ':', '_');
+    auto file_name = directory / (reference_name + ".wav");
+    auto& r = results.emplace_back(result { s.name });
+    if (update) {
+      save(output, file_name);
+      r.status = "updated";
+    } else if (!std::filesystem::exists(file_name))
+      r.status = "missing";
+    else
+      // The content is already quantized to float32 like the reference
+      compare(musycl::wav::read(file_name), output, r);
+  }
+  display_json(results);
+  return all_pass(results) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
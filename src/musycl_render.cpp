@@ -0,0 +1,49 @@
+/** \file Render a MIDI file with the synthesizer into a WAV file, as
+    fast as possible
+
+    The synthesizer runs in a virtual time advancing by 1 audio frame
+    per computed frame instead of following the wall clock, so it can
+    run on a headless server without any MIDI or audio device.
+*/
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include "synth_engine.hpp"
+
+int main(int argc, char* argv[]) {
+  synth::options o;
+  // Let the sounds fade out by default
+  o.stop_after_end = 2;
+  std::string output_file_name;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg == "--follow-clock")
+      o.follow_clock = true;
+    else if (arg == "--tail" && i + 1 < argc)
+      o.stop_after_end = std::stod(argv[++i]);
+    else if (arg == "--record" && i + 1 < argc)
+      o.record_file_name = argv[++i];
+    else if (!o.play && !arg.starts_with("--"))
+      o.play = musycl::midi::read_file(argv[i]);
+    else if (output_file_name.empty() && !arg.starts_with("--"))
+      output_file_name = arg;
+    else {
+      output_file_name.clear();
+      break;
+    }
+  }
+  if (output_file_name.empty()) {
+    std::cerr << "Usage: " << argv[0]
+              << " [--follow-clock] [--tail seconds] [--record file.mid]"
+                 " input.mid output.wav"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  /* There is no MIDI device, so send what the synthesizer writes to
+     the controller nowhere instead of overflowing the output queue */
+  musycl::midi_out {}.open([](auto, auto) {});
+  musycl::backend::file_sink backend { output_file_name };
+  synth::run(backend, o);
+}
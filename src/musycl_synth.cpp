@@ -3,613 +3,178 @@
     Rely on some triSYCL extensions (kernel I/O) and muSYCL extensions
     (MIDI and audio input/output)
 */
-#include <algorithm>
-#include <array>
-#include <cmath>
+#include <cstdlib>
 #include <iostream>
-#include <map>
-#include <memory>
-#include <set>
-#include <variant>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
 
-#include <sycl/sycl.hpp>
-#include <triSYCL/vendor/triSYCL/pipe/cout.hpp>
-#include <triSYCL/detail/overloaded.hpp>
+#include <musycl/rt_safety/interposers.hpp>
 
-auto constexpr debug_midi_input = true;
+#include "synth_engine.hpp"
 
-#include <musycl/musycl.hpp>
-
-#include <musycl/midi/controller/keylab_essential.hpp>
-
-#include <range/v3/all.hpp>
+auto constexpr debug_midi_input = false;
 
 auto constexpr application_name = "musycl_synth";
 
-namespace ts = trisycl::vendor::trisycl;
-
-int main() {
-  // The MIDI input interface
-  musycl::midi_in midi_in;
-  // Access to the right input on the system
-  // - Jack
-  midi_in.open(application_name, "input", RtMidi::UNIX_JACK);
-  // - ALSA
-  // midi_in.open(application_name, "input", RtMidi::LINUX_ALSA);
-
-  // The audio interface
-  musycl::audio audio_interface;
-  /// The configuration part to adapt to the context
-  // - Jack
-  audio_interface.open(application_name, "output", application_name,
-                       RtAudio::UNIX_JACK);
-  // - ALSA
-  // audio_interface.open(application_name, "output", application_name,
-  // RtAudio::LINUX_ALSA);
-
-  // The MIDI controller needs the MIDI output too to update the display/buttons
-  musycl::midi_out midi_out;
-  midi_out.open("muSYCL", "output", RtMidi::UNIX_JACK);
-
-  // The (channel mapping to the sound parameter
-  musycl::midi::channel_assignment channel_assignment;
-
-  // The user interface abstraction
-  musycl::user_interface ui;
-
-  // Assume an Arturia KeyLab essential as a MIDI controller
-  musycl::controller::keylab_essential controller { ui };
-
-  // The mapping of the current active notes to their sounds, 1 per
-  // running note & MIDI channel
-  std::map<musycl::midi::note_base_header,
-           std::weak_ptr<musycl::sound_generator>>
-      notes;
-  // The running sound generators. They might not depend on notes for
-  // generality
-  std::set<std::shared_ptr<musycl::sound_generator>> sounds;
-
-  // MIDI message to be received
-  musycl::midi::msg m;
-
-  // Master volume of the output in [ 0, 1 ]
-  float master_volume = 1;
-
-  /// Master pitch bend on MIDI port 0 channel 0
-  musycl::pitch_bend pb { 0, 0 };
-
-  /// Master modulation wheel on MIDI port 0 channel 0
-  musycl::modulation_actuator ma { 0, 0 };
-
-  // A default arpeggiator
-  musycl::arpeggiator arp;
-  // controller.play_pause.name("Arpeggiator Start/Stop")
-  controller.pad_8.name("Arpeggiator Start/Stop").add_action([&](bool v) {
-    arp.run(v);
-    controller.display("Arpeggiator: " + std::to_string(v));
-  });
-
-  musycl::arpeggiator arp_bass {
-    0, -1,
-    [](auto& self) {
-      static trisycl::vendor::trisycl::random::xorshift<> rng;
-      if (self.current_clock_time.beat) {
-        /// Insert a C0 note on each beat
-        self.current_note = musycl::midi::on { 5, 24, (rng() & 63) + 64 };
-        musycl::midi_in::insert(0, *self.current_note);
-      } else
-        self.stop_current_note();
-    }
-  };
-  controller.pad_7.name("Bass arpeggiator Start/Stop").add_action([&](bool v) {
-    arp_bass.run(v);
-    controller.display("Bass arpeggiator: " + std::to_string(v));
-  });
-
-  musycl::arpeggiator arp_low_high {
-    60, 127,
-    [&, start = false, octave = 0, index = 0](auto& self) mutable {
-      // Otherwise use a default arpeggiator, work on the 16th of note
-      if (self.current_clock_time.midi_clock_index %
-              (musycl::midi::clock_per_quarter / 4) ==
-          0) {
-        start = !start;
-        if (!start)
-          self.stop_current_note();
-        else if (!self.notes.empty()) {
-          std::ranges::sort(self.notes);
-          if (--index < 0 || index >= self.notes.size())
-            index = self.notes.size() - 1;
-          auto n = self.notes[index];
-          n.channel = 1;
-          octave = !octave;
-          n.note += 12 - octave * 48;
-          self.current_note = n;
-          n.velocity = 60;
-          musycl::midi_in::insert(0, n);
-          std::cout << "Insert " << n << std::endl;
-        }
-      }
-    }
-  };
-  controller.pad_1.name("Arpeggiator low & high Start/Stop")
-      .add_action([&](bool v) {
-        arp_low_high.run(v);
-        controller.display("Low & high arpeggiator: " +
-                           std::to_string(v));
-      });
-
-  musycl::arpeggiator arp_bass_4 {
-    60, 127,
-    [&, start = false, running = false, measure = 0,
-     n = std::optional<musycl::midi::on> {}](auto& self) mutable {
-      // Cycle through 2 consecutive measures
-      measure = (measure + self.current_clock_time.measure) % 2;
-      // Run only during the first 2 beats of the first measure
-      if (0 == measure) {
-        if (self.current_clock_time.measure)
-          running = true;
-        else if (2 == self.current_clock_time.beat_index)
-          running = false;
-      }
-      // Register the currently played lowest note
-      if (!self.notes.empty()) {
-        std::ranges::sort(self.notes);
-        n = self.notes[0];
-        n->channel = 2;
-        n->note -= 36;
-      }
-      if (running && self.current_clock_time.midi_clock_index %
-                             (musycl::midi::clock_per_quarter / 4) ==
-                         0) {
-        // Toggle between starting the note and stopping it
-        start = !start;
-        if (!start)
-          self.stop_current_note();
-        else if (n) {
-          musycl::midi_in::insert(0, *n);
-          self.current_note = n;
-          std::cout << "Insert " << *n << std::endl;
-        }
-      }
-    }
-  };
-  controller.pad_6.name("Arpeggiator with 4 basses Start/Stop")
-      .add_action([&](bool v) {
-        arp_bass_4.run(v);
-        controller.display("4 bass arpeggiator: " + std::to_string(v));
-      });
-
-  musycl::arpeggiator arp_exp {
-    60, 127,
-    [&, start = false, p = musycl::dco_envelope::param_t {},
-     sound = std::shared_ptr<musycl::sound_generator> {}](auto& self) mutable {
-      constexpr auto note = 24;
-      constexpr auto velocity = 100;
-      if (self.running && self.current_clock_time.midi_clock_index %
-                                  (musycl::midi::clock_per_quarter / 2) ==
-                              0) {
-        // Toggle between starting the note and stopping it
-        start = !start;
-        if (start) {
-          std::cout << "Insert arp exp" << std::endl;
-          sound = std::make_shared<musycl::sound_generator>(p);
-          sounds.insert(sound);
-          sound->start({ musycl::midi::invalid_channel, note, velocity });
-          self.stop_action = [&] {
-            std::cout << "Stop arp" << std::endl;
-            sound->stop({ musycl::midi::invalid_channel, note, velocity });
-          };
-        } else
-          self.stop_action();
-      }
-      // Make variation to the PWM at MIDI clock speed
-      p->dco_param->square_pwm =
-          std::fmod(p->dco_param->square_pwm + 0.01f, 1.f);
-      std::cout << "PWM arp exp " << p->dco_param->square_pwm << std::endl;
-    }
-  };
-  controller.pad_5.name("Arpeggiator exp Start/Stop")
-      .add_action([&](bool v) {
-        arp_exp.run(v);
-        controller.display("Exp arpeggiator: " + std::to_string(v));
-      });
-
-  musycl::arpeggiator arp_jupiter_8 {
-    60, 127,
-    [&, start = false, index = 0,
-     n = std::optional<musycl::midi::on> {}](auto& self) mutable {
-      if (self.running && self.current_clock_time.midi_clock_index %
-                                  (musycl::midi::clock_per_quarter / 4) ==
-                              0) {
-        // Toggle between starting the note and stopping it
-        start = !start;
-        if (!start)
-          self.stop_current_note();
-        else if (!self.notes.empty()) {
-          std::ranges::sort(self.notes);
-          if (index >= self.notes.size() * 4)
-            index = 0;
-          auto n = self.notes[index % self.notes.size()];
-          n.channel = 1;
-          n.note += 12 * (index / self.notes.size()) - 24;
-          n.velocity = 100;
-          musycl::midi_in::insert(0, n);
-          self.current_note = n;
-          std::cout << "Insert " << n << " at index " << index << std::endl;
-          ++index;
-        }
-      }
-    }
-  };
-  controller.pad_2.name("Jupiter 8 Arpeggiator Start/Stop")
-      .add_action([&](bool v) {
-        arp_jupiter_8.run(v);
-        controller.display("Jupiter 8 arpeggiator: " +
-                           std::to_string(v));
-      });
-
-  // The master of time
-  musycl::clock::set_tempo_bpm(120);
-  // The rotary on the extreme top right of Arturia KeyLab 49
-  controller.top_right_knob_9.name("Tempo rate")
-      .add_action([&](musycl::midi::control_change::value_type v) {
-        auto tempo = int { v } * 2;
-        musycl::clock::set_tempo_bpm(tempo);
-        controller.display("Tempo rate: " + std::to_string(tempo) + " bpm");
-      });
-
-  // The low pass filters for the output channels
-  std::array<musycl::low_pass_filter, musycl::audio::channel_number>
-      low_pass_filter;
-  // Set the frequency for all the channels
-  auto set_low_pass_filter_freq = [&](auto&& cut_off_freq) {
-    for (auto& f : low_pass_filter)
-      f.set_cutoff_frequency(cut_off_freq);
-  };
-
-  // The resonance filters for the output channels
-  //std::array<musycl::resonance_filter, musycl::audio::channel_number>
-  std::array<musycl::ladder_filter, musycl::audio::channel_number>
-      resonance_filter;
-
-  // Use "Cutoff" on Arturia KeyLab 49 to set the resonance frequency
-  controller.cutoff_pan_1.name("Cutoff frequency")
-      .add_action([&](musycl::midi::control_change::value_type v) {
-        auto cut_off_freq =
-            musycl::midi::control_change::get_log_scale_value_in(v, 20, 10000);
-        for (auto& f : resonance_filter)
-          f.set_frequency(cut_off_freq);
-        controller.display("Resonance filter: " + std::to_string(cut_off_freq) +
-                           " Hz");
-      });
-
-  // Use "Resonance" on Arturia KeyLab 49 to set the resonance
-  controller.resonance_pan_2.name("Resonance factor")
-      .add_action([&](float v) {
-        // auto resonance = 10*std::log(v + 1.f) / std::log(128.f);
-        auto resonance = 5*v;
-        for (auto& f : resonance_filter)
-          f.set_resonance(resonance);
-        controller.display("Resonance factor: " + std::to_string(resonance));
-      });
-
-  // Create an LFO and start it
-  musycl::lfo lfo;
-  lfo.set_frequency(2).set_low(0.5).run();
-
-  // Use MIDI CC 76 (LFO Rate on Arturia KeyLab 49) to set the LFO frequency
-  controller.lfo_rate_pan_3.name("LFO rate")
-      .add_action([&](musycl::midi::control_change::value_type v) {
-        auto frequency =
-            musycl::midi::control_change::get_log_scale_value_in(v, 0.1, 20);
-        lfo.set_frequency(frequency);
-        controller.display("LFO rate: " + std::to_string(frequency));
-      });
-
-  // Use MIDI CC 77 (LFO Amt on Arturia KeyLab 49) to set the LFO low level
-  controller.lfo_amt_pan_4.name("LFO amount")
-      .add_action([&](musycl::midi::control_change::value_type v) {
-        auto low = musycl::midi::control_change::get_value_as<float>(v);
-        lfo.set_low(low);
-        controller.display("LFO low bar: " + std::to_string(low));
-      });
-
-  // Use MIDI CC 85 (master volume) to set the value of the... master_volume!
-  musycl::midi_in::cc_variable<85>(master_volume);
-
-  /// No reLU by default
-  float rectication_ratio = 0;
-  // Use MIDI CC 0x12 (Param 2/Pan 6) to set the rectification ratio
-  controller.param_2_pan_6.name("Rectification ratio")
-      .set_variable(rectication_ratio);
-
-  bool enable_automatic_effects = false;
-  musycl::automate automatic_effects { [&](auto& self) mutable {
-    // \todo save the previous settings
-    auto set_rectification = [&](auto&& ratio) {
-      return [&, ratio]() {
-        rectication_ratio = enable_automatic_effects ? ratio : 0;
-      };
-    };
-    auto set_filter = [&](auto&& freq) {
-      return [&, freq]() {
-        set_low_pass_filter_freq(enable_automatic_effects ? freq : 10000);
-      };
-    };
-    for (;;) {
-      self.pause(4)
-          .exec(set_filter(100))
-          .wait_for_next_beats(1)
-          .exec(set_filter(20000))
-          .pause(4)
-          .exec(set_filter(200))
-          .wait_for_next_beats(1)
-          .exec(set_filter(20000))
-          .pause(4)
-          .exec(set_filter(400))
-          .wait_for_next_beats(1)
-          .exec(set_filter(20000))
-          .pause(4)
-          .exec(set_filter(800))
-          .wait_for_next_measures(1)
-          .exec(set_filter(20000))
-          .exec(set_rectification(0.3))
-          .pause(6)
-          .exec(set_rectification(0.))
-          .pause(6)
-          .exec(set_rectification(0.5))
-          .pause(6)
-          .exec(set_rectification(0.))
-          .wait_for_next_beats(3)
-          .pause(18)
-          .exec(set_rectification(0.7))
-          .wait_for_next_measures(1)
-          .exec(set_rectification(0.));
-    }
-  } };
-  controller.pad_3.name("Automatic effects").add_action([&](bool v) {
-    enable_automatic_effects = v;
-    controller.display("Automatic effects: " + std::to_string(v));
-  });
-
-  // A simple stereo delay
-  musycl::effect::delay delay;
-  //musycl::effect::range_delay delay;
-  controller.param_3_pan_7.name("Delay line time")
-      .add_action([&](musycl::midi::control_change::value_type v) {
-        delay.delay_line_time = v * v / 127.f / 127 * 2;
-        controller.display(
-            "Delay line time: " + std::to_string(delay.delay_line_time) + 's');
-      });
-  controller.param_4_pan_8.name("Delay line ratio")
-      .set_variable(delay.delay_line_ratio);
-
-  // A simple stereo flanger
-  musycl::effect::flanger flanger;
-
-  musycl::dco_envelope::param_t dcoe1 { ui, "DCO envelope 1", 0 };
-  channel_assignment.assign(0, dcoe1);
-  dcoe1->env_param->attack_time = 0.1;
-  dcoe1->env_param->decay_time = 0.4;
-  dcoe1->env_param->sustain_level = 0.3;
-  dcoe1->env_param->release_time = 0.5;
-
-  musycl::dco_envelope::param_t dcoe2 { ui, "DCO envelope 2", 1 };
-  channel_assignment.assign(1, dcoe2);
-  dcoe2->env_param->decay_time = .1;
-  dcoe2->env_param->sustain_level = .1;
-
-  // Triangle wave
-  musycl::dco::param_t dco3 { ui, "Triangle wave", 2 };
-  channel_assignment.assign(2, dco3);
-  dco3->square_volume = 0;
-  dco3->triangle_volume = 1;
-
-  musycl::noise::param_t noise { ui, "Noise", 3 };
-  channel_assignment.assign(3, noise);
-
-  musycl::dco::param_t dco5 { ui, "Plain DCO", 4 };
-  channel_assignment.assign(4, dco5);
-
-  // Triangle wave with fast decay
-  musycl::dco_envelope::param_t triangle6_fast_decay { ui,
-                                                       "Triangle fast decay",
-                                                       5 };
-  channel_assignment.assign(5, triangle6_fast_decay);
-  triangle6_fast_decay->dco_param->square_volume = 0;
-  triangle6_fast_decay->dco_param->triangle_volume = 1;
-  triangle6_fast_decay->env_param->decay_time = .1;
-  triangle6_fast_decay->env_param->sustain_level = .1;
-
-  // Control the DCO 1 & 3 parameters
-  controller.attack_ch_1.connect(dcoe1->dco_param->square_volume);
-  controller.attack_ch_1.connect(dco3->square_volume);
-  controller.decay_ch_2.connect(dcoe1->dco_param->triangle_volume);
-  controller.decay_ch_2.connect(dco3->triangle_volume);
-  controller.sustain_ch_3.connect(dcoe1->dco_param->triangle_ratio);
-  controller.sustain_ch_3.connect(dco3->triangle_ratio);
-  controller.release_ch_4.connect(dcoe1->dco_param->triangle_fall_ratio);
-  controller.release_ch_4.connect(dco3->triangle_fall_ratio);
-
-  // Control the envelope of CH1 with Attack/CH5 to Release/CH8
-  controller.attack_ch_5.connect(dcoe1->env_param->attack_time);
-  controller.decay_ch_6.connect(dcoe1->env_param->decay_time);
-  controller.sustain_ch_7.connect(dcoe1->env_param->sustain_level);
-  controller.release_ch_8.connect(dcoe1->env_param->release_time);
-
-  // Connect the sustain pedal to its MIDI event
-  musycl::sustain sustain;
-  musycl::midi_in::cc_action<64>(
-      [&](std::int8_t v) { sustain.value(v); });
-
-  controller.param_1_pan_5.name("Low pass filter").add_action([&](float a) {
-    /* Use a frequency logarithmic scale between 1 Hz and half the
-       sampling frequency */
-    auto cut_off_freq =
-        std::exp((a * std::log(0.5 * musycl::sample_frequency)));
-    set_low_pass_filter_freq(cut_off_freq);
-    controller.display("Low pass filter: " + std::to_string(cut_off_freq) +
-                       " Hz");
-  });
-
-  // Assign on unused MIDI channel 17
-  musycl::dco::param_t random_note_dco_p { ui, "Random note DCO", 17 };
-  auto random_note = std::make_shared<musycl::sound_generator>(musycl::dco {
-    random_note_dco_p });
-  sounds.insert(random_note);
-  auto& random_note_dco = std::get<musycl::dco>(random_note->sg);
-  // Use the lowest note as a base, volume to 0
-  random_note_dco.start({ 17, 0, 20 }).volume = 0;
-  trisycl::vendor::trisycl::random::xorshift<> random_note_rng;
-  musycl::automate random_note_generator { [&](auto& self) mutable {
-    for (;;) {
-      // Wait for 6 MIDI ticks
-      self.pause(6);
-      // Use the tuning parameter to change the note frequency
-      random_note_dco.tune =
-          500. * random_note_rng() /
-          std::numeric_limits<decltype(random_note_rng)::value_type>::max();
-    }
-  } };
-  controller.pad_4.name("Random notes").add_action([&](bool v) {
-    // Just control the output volume for now
-    random_note_dco.volume = v;
-    controller.display("Random notes: " + std::to_string(v));
-  });
-
-  // The forever time loop
-  for (;;) {
-    /* Dispatch here all the potential incoming MIDI registered
-       actions, so they will not cause race condition */
-    musycl::midi_in::dispatch_registered_actions();
-    // Process all the potential incoming MIDI messages on port 0
-    while (sustain.process(0, m)) {
-      // \todo implement as range transformation
-      arp.midi(m);
-      arp_low_high.midi(m);
-      arp_bass_4.midi(m);
-      arp_jupiter_8.midi(m);
-
-      std::visit(
-          trisycl::detail::overloaded {
-              [&](musycl::midi::on& on) {
-                ts::pipe::cout::stream()
-                    << "MIDI on " << (int)on.note << std::endl;
-                if (auto sp = channel_assignment.channels.find(on.channel);
-                    sp != channel_assignment.channels.end()) {
-                  auto sound =
-                      std::make_shared<musycl::sound_generator>(sp->second);
-                  notes.insert_or_assign(on.base_header(), sound);
-                  sounds.insert(sound);
-                  sound->start(on);
-                } else
-                  std::cerr << "Note on to unassigned MIDI channel "
-                            << on.channel + 1 << std::endl;
-              },
-              [&](musycl::midi::off& off) {
-                ts::pipe::cout::stream()
-                    << "MIDI off " << (int)off.note << std::endl;
-                if (auto s = notes.find(off.base_header()); s != notes.end()) {
-                  if (auto sound = s->second.lock())
-                    sound->stop(off);
-                } else
-                  std::cerr << "No note to stop here on MIDI channel "
-                            << off.channel + 1 << std::endl;
-              },
-              [&](musycl::midi::control_change& cc) {
-                ts::pipe::cout::stream()
-                    << "MIDI cc " << (int)cc.number << std::endl;
-                // Attack/CH1 on Arturia Keylab 49 Essential
-                if (cc.number == 73) {
-                }
-              },
-              [&](musycl::midi::sysex& s) {
-                // \todo find a better way
-                if (s.v == std::vector<std::uint8_t> { 0x00, 0x20, 0x6b, 0x7f,
-                                                       0x42, 0x02, 0x00, 0x00,
-                                                       0x18, 0x7f }) {
-                  // backward button on Arturia Keylab 49 Essential
-                  channel_assignment.select_previous_channel();
-                  auto sound_param =
-                      channel_assignment.channels
-                          [channel_assignment.current_selected_channel];
-                  controller.display(
-                      "Channel:" +
-                      std::to_string(
-                          channel_assignment.current_selected_channel) +
-                      " " + sound_param.name());
-                  ui.prioritize_layer(sound_param.get_group());
-                } else if (s.v == std::vector<std::uint8_t> {
-                                      0x00, 0x20, 0x6b, 0x7f, 0x42, 0x02, 0x00,
-                                      0x00, 0x19, 0x7f }) {
-                  // forward button on Arturia Keylab 49 Essential
-                  channel_assignment.select_next_channel();
-                  auto sound_param =
-                      channel_assignment.channels
-                          [channel_assignment.current_selected_channel];
-                  controller.display(
-                      "Channel:" +
-                      std::to_string(
-                          channel_assignment.current_selected_channel) +
-                      " " + sound_param.name());
-                  ui.prioritize_layer(sound_param.get_group());
-                }
-              },
-              [&](auto&& other) {
-                ts::pipe::cout::stream() << "other: " << m << std::endl;
-              } },
-          m);
-    }
-
-    // Propagate the clocks to the consumers
-    musycl::clock::tick_frame_clock();
+/// Display how to use the program
+int usage(const char* program) {
+  std::cerr
+      << "Usage: " << program
+      << " [options]\n"
+         "  --audio jack|alsa|null|file  where the audio goes, jack by "
+         "default\n"
+         "  --output file.wav            the file written by the file audio\n"
+         "  --fast                       compute the null or file audio as "
+         "fast as\n"
+         "                               possible instead of in real time\n"
+         "  --midi jack|alsa|loopback    the MIDI devices, jack by default\n"
+         "  --duration seconds           stop after this amount of audio\n"
+         "  --play file.mid              play a MIDI file\n"
+         "  --follow-clock               play it at the tempo of the clock\n"
+         "  --loop                       play it forever\n"
+         "  --record file.mid            record the MIDI input into a file\n"
+         "  --stress                     measure the sustainable polyphony as "
+         "fast as\n"
+         "                               possible without devices, with the "
+         "notes\n"
+         "                               of the played MIDI file if any\n"
+         "  --stress-voices n            ramp the polyphony up to n voices\n"
+         "  --stress-effects n           ramp the insert effects up to n\n"
+         "  --stress-step seconds        the audio duration of each step\n"
+         "  --no-watchdog                keep the quality even when the "
+         "frames are\n"
+         "                               late, instead of degrading it\n"
+         "  --watchdog-voices n          the polyphony left by the watchdog "
+         "on\n"
+         "                               overload, 32 by default\n"
+         "  --rt-safety-fatal            abort on the first forbidden "
+         "operation in\n"
+         "                               the real-time code, with a "
+         "MUSYCL_RT_SAFETY\n"
+         "                               build\n"
+         "  --trace file.json            export the last hot-path timings in "
+         "Chrome\n"
+         "                               trace format, with a MUSYCL_TRACE "
+         "build\n"
+         "  --trace-stats seconds        display the timer statistics "
+         "periodically"
+      << std::endl;
+  return EXIT_FAILURE;
+}
 
-    // The output audio frame accumulator
-    musycl::audio::frame audio {};
-    // For each sound generator
-    for (auto it = sounds.begin(); it != sounds.end();) {
-      auto& o = **it;
-      auto out = o.audio();
-      // Accumulate its audio output into the main output
-      for (auto&& [e, a] : ranges::views::zip(out, audio))
-        a += e;
-      if (o.is_running())
-        // Just look at the next sound
-        ++it;
+int main(int argc, char* argv[]) {
+  synth::options o;
+  std::string_view audio = "jack";
+  std::string_view midi = "jack";
+  std::string output_file_name;
+  auto pacing = musycl::backend::pacing::real_time;
+  bool stress = false;
+  bool watchdog = true;
+  synth::stress_test::parameters stress_parameters;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    // The options with a value
+    if (i + 1 < argc) {
+      std::string_view value = argv[i + 1];
+      auto matched = true;
+      if (arg == "--audio")
+        audio = value;
+      else if (arg == "--output")
+        output_file_name = value;
+      else if (arg == "--midi")
+        midi = value;
+      else if (arg == "--duration")
+        o.duration = std::stod(argv[i + 1]);
+      else if (arg == "--play")
+        // Read the MIDI file before opening any device to fail early
+        o.play = musycl::midi::read_file(argv[i + 1]);
+      else if (arg == "--record")
+        o.record_file_name = value;
+      else if (arg == "--stress-voices")
+        stress_parameters.max_voices = std::stoi(argv[i + 1]);
+      else if (arg == "--stress-effects")
+        stress_parameters.max_effects = std::stoi(argv[i + 1]);
+      else if (arg == "--stress-step")
+        stress_parameters.step_time = std::stod(argv[i + 1]);
+      else if (arg == "--watchdog-voices")
+        o.watchdog_voices = std::stoi(argv[i + 1]);
+      else if (arg == "--trace")
+        o.trace_file_name = value;
+      else if (arg == "--trace-stats")
+        o.trace_statistics_period = std::stod(argv[i + 1]);
       else
-        // Remove the no longer running sound generator and skip over it
-        it = sounds.erase(it);
-    }
-
-    // Normalize the audio by number of playing voices to avoid saturation
-    for (auto& a : audio) {
-      // Insert a rectifier in the output
-      a = a*(1 - rectication_ratio) + rectication_ratio*a.fabs();
-      /// Dive into each (stereo) channel of the sample...
-        // Insert a low pass filter in the output
-      for (auto&& [s, f] : ranges::views::zip(a, low_pass_filter))
-        // Insert a low pass filter in the output with amplitude
-        // controlled by an LFO
-        s = f.filter(s*lfo.out());
-      // Add a constant factor to avoid too much fading between 1 and 2 voices
-      a /= 4 + sounds.size();
-      // Insert a resonance filter in the output after volume
-      // normalization to avoid too much saturation
-      for (auto&& [s, f] : ranges::views::zip(a, resonance_filter))
-        s = f.filter(s);
-      // Put the master volume control at the end to take over filter
-      // loud oscillation
-      a *= master_volume;
+        matched = false;
+      if (matched) {
+        ++i;
+        continue;
+      }
     }
-
-    // Add some echo-like delay
-    delay.process(audio);
-    // Some flanger effect
-    flanger.process(musycl::audio::buffer { &audio, 1 });
-
-    // Then send the computed audio frame to the output
-    musycl::audio::write(audio);
+    if (arg == "--fast")
+      pacing = musycl::backend::pacing::maximum_speed;
+    else if (arg == "--follow-clock")
+      o.follow_clock = true;
+    else if (arg == "--loop")
+      o.loop = true;
+    else if (arg == "--stress")
+      stress = true;
+    else if (arg == "--no-watchdog")
+      watchdog = false;
+    else if (arg == "--rt-safety-fatal")
+      musycl::rt_safety::set_fatal(true);
+    else
+      return usage(argv[0]);
   }
-  return 0;
+  if (stress) {
+    // Compute the frames as fast as possible to measure their time
+    audio = "null";
+    midi = "loopback";
+    pacing = musycl::backend::pacing::maximum_speed;
+    // The MIDI file is the note storm, looping through the steps
+    stress_parameters.from_file = o.play.has_value();
+    o.loop = true;
+    o.stress = stress_parameters;
+  }
+  // Only degrade the quality to keep up with a real-time output
+  o.watchdog =
+      watchdog && pacing == musycl::backend::pacing::real_time && !stress;
+  if ((audio == "file") == output_file_name.empty())
+    return usage(argv[0]);
+  if constexpr (!musycl::trace::enabled)
+    if (!o.trace_file_name.empty() || o.trace_statistics_period > 0)
+      std::cerr << "Warning: built without MUSYCL_TRACE, so there is no "
+                   "timing to report"
+                << std::endl;
+
+  // Access to the right MIDI devices on the system
+  musycl::midi_in::set_debug(debug_midi_input);
+  std::optional<musycl::backend::rtmidi> rtmidi;
+  std::optional<musycl::backend::midi_loopback> midi_loopback;
+  if (midi == "jack")
+    rtmidi.emplace(application_name, RtMidi::UNIX_JACK);
+  else if (midi == "alsa")
+    rtmidi.emplace(application_name, RtMidi::LINUX_ALSA);
+  else if (midi == "loopback")
+    midi_loopback.emplace();
+  else
+    return usage(argv[0]);
+
+  // Where the audio goes
+  auto make_audio_backend = [&]() -> musycl::audio_backend {
+    using namespace musycl::backend;
+    if (audio == "jack")
+      return { std::in_place_type<rtaudio>, application_name,
+               RtAudio::UNIX_JACK };
+    if (audio == "alsa")
+      return { std::in_place_type<rtaudio>, application_name,
+               RtAudio::LINUX_ALSA };
+    if (audio == "null")
+      return { std::in_place_type<null_sink>, pacing };
+    return { std::in_place_type<file_sink>, output_file_name, pacing };
+  };
+  if (audio != "jack" && audio != "alsa" && audio != "null" && audio != "file")
+    return usage(argv[0]);
+  auto backend = make_audio_backend();
+  synth::run(backend, o);
 }
@@ -0,0 +1,248 @@
+#ifndef MUSYCL_STRESS_TEST_HPP
+#define MUSYCL_STRESS_TEST_HPP
+
+/** \file Measure the polyphony the synthesizer can sustain in real time
+
+    The synthesizer plays a note storm, either synthetic or from a
+    MIDI file, while the number of voices and the number of insert
+    effects are ramped up. The computation time of each frame is
+    compared to the frame period, the deadline of a real-time audio
+    output.
+*/
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include <musycl/musycl.hpp>
+
+namespace synth {
+
+/// Ramp the load of the synthesizer and measure its frame time
+class stress_test {
+ public:
+  /// The parameters of a stress test
+  struct parameters {
+    /// Stop ramping the polyphony at this number of voices
+    int max_voices = 256;
+    /// Stop ramping the number of insert effects at this number
+    int max_effects = 8;
+    /// Duration of each step in second of audio
+    double step_time = 1;
+    /// Play the notes from a MIDI file instead of a synthetic storm
+    bool from_file = false;
+  };
+
+ private:
+  /// The statistics of a step with some load
+  struct step {
+    /// Number of insert effects
+    int effects;
+    /// Number of notes started, or 0 when played from a file
+    int requested_voices;
+    /** Maximum number of running voices seen, including the sounds
+        not started by notes */
+    std::size_t voices = 0;
+    /// The computation time of each frame in second
+    std::vector<double> frame_times {};
+    /// Number of note messages dropped by a full MIDI input queue
+    int dropped_messages = 0;
+
+    /// A percentile of the frame time in second
+    double percentile(double p) const {
+      auto sorted = frame_times;
+      std::ranges::sort(sorted);
+      return sorted[std::min<std::size_t>(p * sorted.size(),
+                                          sorted.size() - 1)];
+    }
+
+    /** Whether the frames are computed in time, for 99 % of them,
+        with all the notes played */
+    bool sustainable() const {
+      return !frame_times.empty() && dropped_messages == 0 &&
+             percentile(0.99) <= musycl::frame_period;
+    }
+  };
+
+  parameters p;
+
+  /// The measured steps, the last one being the current one
+  std::vector<step> steps;
+
+  /// The effects inserted, never moved since the mixer refers to them
+  std::deque<musycl::effect::delay> effects;
+
+  /// The notes started in the current effect count phase
+  std::vector<musycl::midi::on> notes;
+
+  /** The note messages waiting to be injected, spread over the frames
+      to fit in the MIDI input queues */
+  std::deque<musycl::midi::msg> pending;
+
+  /** Maximum number of note messages injected per frame, well below
+      the 256 messages of the MIDI input queues */
+  static constexpr int injections_per_frame = 64;
+
+  /// Frames left in the current step
+  int frames_left = 0;
+
+  /// Whether all the steps have been measured
+  bool done = false;
+
+  /// Frames at the beginning of a step not measured, to let the load settle
+  int settling_frames = 0;
+
+  /// Number of frames per step
+  int step_frames() const {
+    return std::max(1, static_cast<int>(p.step_time / musycl::frame_period));
+  }
+
+  /// The effect counts ramped through
+  int next_effect_count(int e) const { return e == 0 ? 1 : 2 * e; }
+
+  /// Start the notes up to a number of voices, spread on the 6 sounds
+  void start_notes(int voices) {
+    while (std::ssize(notes) < voices) {
+      auto v = static_cast<int>(notes.size());
+      musycl::midi::on on { v % 6, 24 + v / 6 % 96, 100 };
+      notes.push_back(on);
+      pending.push_back(on);
+    }
+  }
+
+  /// Stop all the notes, to restart a polyphony ramp
+  void stop_notes() {
+    for (auto& n : notes)
+      pending.push_back(musycl::midi::off { n.channel, n.note, 0 });
+    notes.clear();
+  }
+
+  /// Inject some pending note messages at the start of the frame
+  void inject_pending() {
+    for (int i = 0; i < injections_per_frame && !pending.empty(); ++i) {
+      auto injected = musycl::midi_in::inject(0, pending.front(),
+                                              musycl::midi_in::frame_time(0));
+      pending.pop_front();
+      // The step does not play what was requested, so it fails
+      if (!injected && !steps.empty())
+        ++steps.back().dropped_messages;
+    }
+  }
+
+  /// Insert delays round-robin on the channels used by the notes
+  void add_effects(musycl::mixer& mixer, int count) {
+    while (std::ssize(effects) < count)
+      mixer.channel(effects.size() % 6).add_insert(effects.emplace_back());
+  }
+
+  /// Start a new step, possibly in a new effect count phase
+  void start_step(musycl::mixer& mixer) {
+    auto effect_count = 0;
+    auto voices = 1;
+    if (!steps.empty()) {
+      auto& last = steps.back();
+      effect_count = last.effects;
+      voices = 2 * last.requested_voices;
+      // Go to the next effect count when the polyphony ramp is over
+      if (p.from_file || !last.sustainable() || voices > p.max_voices) {
+        effect_count = next_effect_count(effect_count);
+        voices = 1;
+        if (!p.from_file)
+          stop_notes();
+      }
+    }
+    if (effect_count > p.max_effects) {
+      stop_notes();
+      done = true;
+      return;
+    }
+    add_effects(mixer, effect_count);
+    if (!p.from_file)
+      start_notes(voices);
+    steps.push_back({ effect_count, p.from_file ? 0 : voices });
+    frames_left = step_frames();
+    // Let the released notes of a previous phase fade out, during 1 s
+    settling_frames =
+        voices == 1 ? static_cast<int>(std::ceil(1 / musycl::frame_period)) : 0;
+    frames_left += settling_frames;
+  }
+
+ public:
+  stress_test(const parameters& params)
+      : p { params } {}
+
+  /// Prepare the load of a new frame, before it is computed
+  void start_frame(musycl::mixer& mixer) {
+    if (!done && frames_left == 0)
+      start_step(mixer);
+    inject_pending();
+  }
+
+  /** Account for the computation of a frame
+
+      \param[in] voices is the number of running voices
+
+      \param[in] time is the computation time of the frame in second
+  */
+  void end_frame(std::size_t voices, double time) {
+    if (done)
+      return;
+    // The step starts once all its notes are injected
+    if (!pending.empty())
+      return;
+    --frames_left;
+    if (settling_frames > 0) {
+      --settling_frames;
+      return;
+    }
+    auto& s = steps.back();
+    s.voices = std::max(s.voices, voices);
+    s.frame_times.push_back(time);
+  }
+
+  /// Whether all the steps have been measured and the notes stopped
+  bool finished() const { return done && pending.empty(); }
+
+  /// Display the results as JSON
+  void report() const {
+    constexpr auto us = 1e6;
+    std::cout << "{\n  \"frame_period_us\": " << musycl::frame_period * us
+              << ",\n  \"steps\": [";
+    // Maximum number of voices computed in time for each effect count
+    std::map<int, std::size_t> max_voices;
+    for (auto first = true; auto& s : steps) {
+      if (s.frame_times.empty())
+        continue;
+      auto misses = std::ranges::count_if(
+          s.frame_times, [](auto t) { return t > musycl::frame_period; });
+      std::cout << (first ? "" : ",") << "\n    { \"effects\": " << s.effects
+                << ", \"requested_voices\": " << s.requested_voices
+                << ", \"voices\": " << s.voices
+                << ", \"frames\": " << s.frame_times.size()
+                << ", \"p50_us\": " << s.percentile(0.5) * us
+                << ", \"p90_us\": " << s.percentile(0.9) * us
+                << ", \"p99_us\": " << s.percentile(0.99) * us
+                << ", \"max_us\": " << s.percentile(1) * us
+                << ", \"deadline_misses\": " << misses
+                << ", \"dropped_messages\": " << s.dropped_messages << " }";
+      first = false;
+      auto& m = max_voices[s.effects];
+      if (s.sustainable())
+        m = std::max(m, s.voices);
+    }
+    std::cout << "\n  ],\n  \"max_sustainable_voices\": {";
+    for (auto first = true; auto [effects, voices] : max_voices) {
+      std::cout << (first ? "" : ",") << "\n    \"" << effects
+                << " effects\": " << voices;
+      first = false;
+    }
+    std::cout << "\n  }\n}" << std::endl;
+  }
+};
+
+} // namespace synth
+
+#endif // MUSYCL_STRESS_TEST_HPP
@@ -0,0 +1,1054 @@
+#ifndef MUSYCL_SYNTH_ENGINE_HPP
+#define MUSYCL_SYNTH_ENGINE_HPP
+
+/** \file The synthesizer engine shared by the real-time synthesizer
+    and the offline renderer
+
+    Rely on some triSYCL extensions (kernel I/O) and muSYCL extensions
+    (MIDI and audio input/output)
+*/
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <variant>
+
+#include <sycl/sycl.hpp>
+#include <triSYCL/detail/overloaded.hpp>
+#include <triSYCL/vendor/triSYCL/random/xorshift.hpp>
+
+#include <musycl/musycl.hpp>
+
+#include <musycl/midi/controller/keylab_essential.hpp>
+
+#include <range/v3/all.hpp>
+
+#include "stress_test.hpp"
+
+namespace synth {
+
+/// The options of a synthesizer run
+struct options {
+  /// The MIDI sequence to play, if any
+  std::optional<musycl::midi::sequence> play;
+
+  /// The MIDI file to record what is played on MIDI port 0 into, if any
+  std::string record_file_name;
+
+  /// Play the MIDI sequence with the musycl::clock tempo instead of its own
+  bool follow_clock = false;
+
+  /// Play the MIDI sequence forever
+  bool loop = false;
+
+  /** Stop this number of seconds after the end of the MIDI sequence,
+      to let the sounds fade out, or never if negative */
+  double stop_after_end = -1;
+
+  /// Stop after computing this number of seconds of audio, never if negative
+  double duration = -1;
+
+  /// Measure the sustainable polyphony instead of playing, if any
+  std::optional<stress_test::parameters> stress;
+
+  /** The file to export the last events of the hot-path timers into,
+      in Chrome trace format, if any. Needs a MUSYCL_TRACE build */
+  std::string trace_file_name;
+
+  /** Degrade the quality on a sustained overload instead of having
+      audio drop-outs, for a real-time output */
+  bool watchdog = false;
+
+  /// The maximum polyphony when the watchdog caps it
+  int watchdog_voices = 32;
+
+  /** Display the timer statistics of each stage every this number of
+      seconds of audio, never if negative. Needs a MUSYCL_TRACE build */
+  double trace_statistics_period = -1;
+};
+
+/** The master bus parameters controlled from the front-end thread
+
+    A copy is handed over with each frame to the master bus thread, so
+    it never reads them while the MIDI actions or the automations
+    change them.
+*/
+struct master_bus_parameters {
+  /// The LFO level modulating the low pass filter input
+  float lfo = 1;
+
+  /// Cutoff frequency of the low pass filters, 0 for a pass-through
+  float low_pass_frequency = 0;
+
+  /// Frequency of the resonance filters, 0 while they are flat
+  float resonance_frequency = 0;
+
+  /// Resonance factor of the resonance filters
+  float resonance = 0;
+
+  /// Mix of the rectified signal, no reLU by default
+  float rectification_ratio = 0;
+
+  /// Master volume of the output in [ 0, 1 ]
+  float master_volume = 1;
+};
+
+/// A frame of the voice mix with the master bus parameters to process it
+struct master_bus_frame {
+  musycl::audio::frame voices;
+  master_bus_parameters parameters;
+};
+
+/// Set by Ctrl-C to stop the synthesizer cleanly
+inline std::atomic<bool> interrupted = false;
+
+/** Run the synthesizer until Ctrl-C or the end of the MIDI sequence,
+    then exit the program
+
+    The MIDI and audio devices used, if any, have to be opened before.
+
+    \param[in] backend provides the audio output with \c
+    write(const musycl::audio::frame&), called from the master bus
+    thread, the time of each new audio frame with \c frame_time()
+    and finalizes the output with \c close(), like a
+    musycl::audio_backend
+
+    \param[in] opts are the options of the run
+*/
+template <typename Backend>
+[[noreturn]] void run(Backend& backend, const options& opts) {
+  // Start writing the log messages before the real-time part
+  musycl::log::start();
+
+  // The (channel mapping to the sound parameter
+  musycl::midi::channel_assignment channel_assignment;
+
+  // The user interface abstraction
+  musycl::user_interface ui;
+
+  // Assume an Arturia KeyLab essential as a MIDI controller
+  musycl::controller::keylab_essential controller { ui };
+
+  // The mapping of the current active notes to their sounds, 1 per
+  // running note & MIDI channel
+  std::map<musycl::midi::note_base_header,
+           std::weak_ptr<musycl::sound_generator>>
+      notes;
+  // The running sound generators. They might not depend on notes for
+  // generality
+  std::set<std::shared_ptr<musycl::sound_generator>> sounds;
+
+  // MIDI message to be received
+  musycl::midi::msg m;
+
+  // The master bus parameters as controlled by the front-end thread
+  master_bus_parameters master_bus;
+
+  /* Frames of latency traded for CPU headroom by running the master
+     bus on another thread, 0 to run everything on this thread */
+  constexpr int pipeline_depth = 1;
+
+  /// Master pitch bend on MIDI port 0 channel 0
+  musycl::pitch_bend pb { 0, 0 };
+
+  /// Master modulation wheel on MIDI port 0 channel 0
+  musycl::modulation_actuator ma { 0, 0 };
+
+  // A default arpeggiator
+  musycl::arpeggiator arp;
+  // controller.play_pause.name("Arpeggiator Start/Stop")
+  controller.pad_8.name("Arpeggiator Start/Stop").add_action([&](bool v) {
+    arp.run(v);
+    controller.display("Arpeggiator: " + std::to_string(v));
+  });
+
+  musycl::arpeggiator arp_bass {
+    0, -1,
+    [](auto& self) {
+      static trisycl::vendor::trisycl::random::xorshift<> rng;
+      if (self.current_clock_time.beat) {
+        /// Insert a C0 note on each beat
+        self.current_note = musycl::midi::on { 5, 24, (rng() & 63) + 64 };
+        musycl::midi_in::insert(0, *self.current_note);
+      } else
+        self.stop_current_note();
+    }
+  };
+  controller.pad_7.name("Bass arpeggiator Start/Stop").add_action([&](bool v) {
+    arp_bass.run(v);
+    controller.display("Bass arpeggiator: " + std::to_string(v));
+  });
+
+  musycl::arpeggiator arp_low_high {
+    60, 127,
+    [&, start = false, octave = 0, index = 0](auto& self) mutable {
+      // Otherwise use a default arpeggiator, work on the 16th of note
+      if (self.current_clock_time.midi_clock_index %
+              (musycl::midi::clock_per_quarter / 4) ==
+          0) {
+        start = !start;
+        if (!start)
+          self.stop_current_note();
+        else if (!self.notes.empty()) {
+          std::ranges::sort(self.notes);
+          if (--index < 0 || index >= self.notes.size())
+            index = self.notes.size() - 1;
+          auto n = self.notes[index];
+          n.channel = 1;
+          octave = !octave;
+          n.note += 12 - octave * 48;
+          self.current_note = n;
+          n.velocity = 60;
+          musycl::midi_in::insert(0, n);
+          MUSYCL_LOG_DEBUG("Insert {}", n);
+        }
+      }
+    }
+  };
+  controller.pad_1.name("Arpeggiator low & high Start/Stop")
+      .add_action([&](bool v) {
+        arp_low_high.run(v);
+        controller.display("Low & high arpeggiator: " +
+                           std::to_string(v));
+      });
+
+  musycl::arpeggiator arp_bass_4 {
+    60, 127,
+    [&, start = false, running = false, measure = 0,
+     n = std::optional<musycl::midi::on> {}](auto& self) mutable {
+      // Cycle through 2 consecutive measures
+      measure = (measure + self.current_clock_time.measure) % 2;
+      // Run only during the first 2 beats of the first measure
+      if (0 == measure) {
+        if (self.current_clock_time.measure)
+          running = true;
+        else if (2 == self.current_clock_time.beat_index)
+          running = false;
+      }
+      // Register the currently played lowest note
+      if (!self.notes.empty()) {
+        std::ranges::sort(self.notes);
+        n = self.notes[0];
+        n->channel = 2;
+        n->note -= 36;
+      }
+      if (running && self.current_clock_time.midi_clock_index %
+                             (musycl::midi::clock_per_quarter / 4) ==
+                         0) {
+        // Toggle between starting the note and stopping it
+        start = !start;
+        if (!start)
+          self.stop_current_note();
+        else if (n) {
+          musycl::midi_in::insert(0, *n);
+          self.current_note = n;
+          MUSYCL_LOG_DEBUG("Insert {}", *n);
+        }
+      }
+    }
+  };
+  controller.pad_6.name("Arpeggiator with 4 basses Start/Stop")
+      .add_action([&](bool v) {
+        arp_bass_4.run(v);
+        controller.display("4 bass arpeggiator: " + std::to_string(v));
+      });
+
+  musycl::arpeggiator arp_exp {
+    60, 127,
+    [&, start = false, p = musycl::dco_envelope::param_t {},
+     sound = std::shared_ptr<musycl::sound_generator> {}](auto& self) mutable {
+      constexpr auto note = 24;
+      constexpr auto velocity = 100;
+      if (self.running && self.current_clock_time.midi_clock_index %
+                                  (musycl::midi::clock_per_quarter / 2) ==
+                              0) {
+        // Toggle between starting the note and stopping it
+        start = !start;
+        if (start) {
+          MUSYCL_LOG_DEBUG("Insert arp exp");
+          sound = std::make_shared<musycl::sound_generator>(p);
+          sounds.insert(sound);
+          sound->start({ musycl::midi::invalid_channel, note, velocity });
+          self.stop_action = [&] {
+            MUSYCL_LOG_DEBUG("Stop arp");
+            sound->stop({ musycl::midi::invalid_channel, note, velocity });
+          };
+        } else
+          self.stop_action();
+      }
+      // Make variation to the PWM at MIDI clock speed
+      p->dco_param->square_pwm =
+          std::fmod(p->dco_param->square_pwm + 0.01f, 1.f);
+      MUSYCL_LOG_TRACE("PWM arp exp {}", p->dco_param->square_pwm.value());
+    }
+  };
+  controller.pad_5.name("Arpeggiator exp Start/Stop")
+      .add_action([&](bool v) {
+        arp_exp.run(v);
+        controller.display("Exp arpeggiator: " + std::to_string(v));
+      });
+
+  musycl::arpeggiator arp_jupiter_8 {
+    60, 127,
+    [&, start = false, index = 0,
+     n = std::optional<musycl::midi::on> {}](auto& self) mutable {
+      if (self.running && self.current_clock_time.midi_clock_index %
+                                  (musycl::midi::clock_per_quarter / 4) ==
+                              0) {
+        // Toggle between starting the note and stopping it
+        start = !start;
+        if (!start)
+          self.stop_current_note();
+        else if (!self.notes.empty()) {
+          std::ranges::sort(self.notes);
+          if (index >= self.notes.size() * 4)
+            index = 0;
+          auto n = self.notes[index % self.notes.size()];
+          n.channel = 1;
+          n.note += 12 * (index / self.notes.size()) - 24;
+          n.velocity = 100;
+          musycl::midi_in::insert(0, n);
+          self.current_note = n;
+          MUSYCL_LOG_DEBUG("Insert {} at index {}", n, index);
+          ++index;
+        }
+      }
+    }
+  };
+  controller.pad_2.name("Jupiter 8 Arpeggiator Start/Stop")
+      .add_action([&](bool v) {
+        arp_jupiter_8.run(v);
+        controller.display("Jupiter 8 arpeggiator: " +
+                           std::to_string(v));
+      });
+
+  // The master of time
+  musycl::clock::set_tempo_bpm(120);
+  // The rotary on the extreme top right of Arturia KeyLab 49
+  controller.top_right_knob_9.name("Tempo rate")
+      .add_action([&](musycl::midi::control_change::value_type v) {
+        auto tempo = int { v } * 2;
+        musycl::clock::set_tempo_bpm(tempo);
+        controller.display("Tempo rate: " + std::to_string(tempo) + " bpm");
+      });
+
+  // The low pass filters for the output channels
+  std::array<musycl::low_pass_filter, musycl::audio::channel_number>
+      low_pass_filter;
+  // Set the frequency for all the channels, from the next frame
+  auto set_low_pass_filter_freq = [&](auto&& cut_off_freq) {
+    master_bus.low_pass_frequency = cut_off_freq;
+  };
+
+  // The resonance filters for the output channels
+  //std::array<musycl::resonance_filter, musycl::audio::channel_number>
+  std::array<musycl::ladder_filter, musycl::audio::channel_number>
+      resonance_filter;
+  // The master bus dynamics
+  musycl::effect::compressor compressor;
+  musycl::effect::limiter limiter;
+
+  /* Degrade the oversampling on overload, set by the watchdog on the
+     front-end thread and used by the master bus thread */
+  std::atomic<bool> low_oversampling = false;
+  // Run the ladder filters at 2x to reduce the aliasing of their clamping
+  musycl::oversampler resonance_oversampler { 2 };
+  for (auto& f : resonance_filter)
+    f.set_oversampling(resonance_oversampler.factor());
+
+  // Use "Cutoff" on Arturia KeyLab 49 to set the resonance frequency
+  controller.cutoff_pan_1.name("Cutoff frequency")
+      .add_action([&](musycl::midi::control_change::value_type v) {
+        auto cut_off_freq =
+            musycl::midi::control_change::get_log_scale_value_in(v, 20, 10000);
+        master_bus.resonance_frequency = cut_off_freq;
+        controller.display("Resonance filter: " + std::to_string(cut_off_freq) +
+                           " Hz");
+      });
+
+  // Use "Resonance" on Arturia KeyLab 49 to set the resonance
+  controller.resonance_pan_2.name("Resonance factor")
+      .add_action([&](float v) {
+        // auto resonance = 10*std::log(v + 1.f) / std::log(128.f);
+        auto resonance = 5*v;
+        master_bus.resonance = resonance;
+        controller.display("Resonance factor: " + std::to_string(resonance));
+      });
+
+  // Create an LFO and start it
+  musycl::lfo lfo;
+  lfo.set_frequency(2).set_low(0.5).run();
+
+  // Use MIDI CC 76 (LFO Rate on Arturia KeyLab 49) to set the LFO frequency
+  controller.lfo_rate_pan_3.name("LFO rate")
+      .add_action([&](musycl::midi::control_change::value_type v) {
+        auto frequency =
+            musycl::midi::control_change::get_log_scale_value_in(v, 0.1, 20);
+        lfo.set_frequency(frequency);
+        controller.display("LFO rate: " + std::to_string(frequency));
+      });
+
+  // Use MIDI CC 77 (LFO Amt on Arturia KeyLab 49) to set the LFO low level
+  controller.lfo_amt_pan_4.name("LFO amount")
+      .add_action([&](musycl::midi::control_change::value_type v) {
+        auto low = musycl::midi::control_change::get_value_as<float>(v);
+        lfo.set_low(low);
+        controller.display("LFO low bar: " + std::to_string(low));
+      });
+
+  // Use MIDI CC 85 (master volume) to set the value of the... master_volume!
+  musycl::midi_in::cc_variable<85>(master_bus.master_volume);
+
+  // Use MIDI CC 0x12 (Param 2/Pan 6) to set the rectification ratio
+  controller.param_2_pan_6.name("Rectification ratio")
+      .set_variable(master_bus.rectification_ratio);
+  // Run the rectifier at 4x to reduce the aliasing of its harmonics
+  musycl::oversampler rectifier_oversampler { 4 };
+
+  bool enable_automatic_effects = false;
+  musycl::automate automatic_effects { [&](auto& self) mutable {
+    // \todo save the previous settings
+    auto set_rectification = [&](auto&& ratio) {
+      return [&, ratio]() {
+        master_bus.rectification_ratio = enable_automatic_effects ? ratio : 0;
+      };
+    };
+    auto set_filter = [&](auto&& freq) {
+      return [&, freq]() {
+        set_low_pass_filter_freq(enable_automatic_effects ? freq : 10000);
+      };
+    };
+    for (;;) {
+      self.pause(4)
+          .exec(set_filter(100))
+          .wait_for_next_beats(1)
+          .exec(set_filter(20000))
+          .pause(4)
+          .exec(set_filter(200))
+          .wait_for_next_beats(1)
+          .exec(set_filter(20000))
+          .pause(4)
+          .exec(set_filter(400))
+          .wait_for_next_beats(1)
+          .exec(set_filter(20000))
+          .pause(4)
+          .exec(set_filter(800))
+          .wait_for_next_measures(1)
+          .exec(set_filter(20000))
+          .exec(set_rectification(0.3))
+          .pause(6)
+          .exec(set_rectification(0.))
+          .pause(6)
+          .exec(set_rectification(0.5))
+          .pause(6)
+          .exec(set_rectification(0.))
+          .wait_for_next_beats(3)
+          .pause(18)
+          .exec(set_rectification(0.7))
+          .wait_for_next_measures(1)
+          .exec(set_rectification(0.));
+    }
+  } };
+  controller.pad_3.name("Automatic effects").add_action([&](bool v) {
+    enable_automatic_effects = v;
+    controller.display("Automatic effects: " + std::to_string(v));
+  });
+
+  // A simple stereo delay
+  musycl::effect::delay delay;
+  //musycl::effect::range_delay delay;
+  // The delay note values selectable, following the tempo
+  using d = musycl::effect::delay;
+  static constexpr std::array<std::pair<float, const char*>, 10> delay_notes {
+    { { d::sixteenth, "1/16" },
+      { d::triplet(d::eighth), "1/8 triplet" },
+      { d::dotted(d::sixteenth), "1/16 dotted" },
+      { d::eighth, "1/8" },
+      { d::triplet(d::quarter), "1/4 triplet" },
+      { d::dotted(d::eighth), "1/8 dotted" },
+      { d::quarter, "1/4" },
+      { d::triplet(d::half), "1/2 triplet" },
+      { d::dotted(d::quarter), "1/4 dotted" },
+      { d::half, "1/2" } }
+  };
+  delay.set_sync(d::eighth);
+  controller.param_3_pan_7.name("Delay line time")
+      .add_action([&](musycl::midi::control_change::value_type v) {
+        auto [note, name] = delay_notes[v * delay_notes.size() / 128];
+        delay.set_sync(note);
+        controller.display("Delay line time: " + std::string { name } + " = " +
+                           std::to_string(delay.time()) + 's');
+      });
+  controller.param_4_pan_8.name("Delay line ratio")
+      .set_variable(delay.delay_line_ratio);
+
+  // A simple stereo flanger
+  musycl::effect::flanger flanger;
+
+  // An algorithmic reverberation
+  musycl::effect::reverb reverb;
+  // Use MIDI CC 91 (effects 1 depth, usually reverb) to set the reverb amount
+  musycl::midi_in::cc_variable<91>(reverb.reverb_ratio);
+
+  /* A mixer strip per channel, sending to the delay and the
+     reverberation which run once on their auxiliary bus */
+  musycl::mixer mixer { 32, 2 };
+  constexpr int delay_bus = 0;
+  constexpr int reverb_bus = 1;
+  mixer.aux(delay_bus).add_effect(delay);
+  // The reverberation can be bypassed by the watchdog on overload
+  bool bypass_reverb = false;
+  mixer.aux(reverb_bus)
+      .add_effect(
+          [&](musycl::audio::frame& audio) {
+            if (!bypass_reverb)
+              reverb.process(audio);
+          },
+          [&] { return musycl::tail_frames(reverb); });
+  for (int c = 0; c < mixer.channel_number(); ++c)
+    mixer.channel(c).set_send(delay_bus, 1).set_send(reverb_bus, 1);
+
+  musycl::dco_envelope::param_t dcoe1 { ui, "DCO envelope 1", 0 };
+  channel_assignment.assign(0, dcoe1);
+  dcoe1->env_param->attack_time = 0.1;
+  dcoe1->env_param->decay_time = 0.4;
+  dcoe1->env_param->sustain_level = 0.3;
+  dcoe1->env_param->release_time = 0.5;
+
+  musycl::dco_envelope::param_t dcoe2 { ui, "DCO envelope 2", 1 };
+  channel_assignment.assign(1, dcoe2);
+  dcoe2->env_param->decay_time = .1;
+  dcoe2->env_param->sustain_level = .1;
+
+  // Triangle wave
+  musycl::dco::param_t dco3 { ui, "Triangle wave", 2 };
+  channel_assignment.assign(2, dco3);
+  dco3->square_volume = 0;
+  dco3->triangle_volume = 1;
+
+  musycl::noise::param_t noise { ui, "Noise", 3 };
+  channel_assignment.assign(3, noise);
+
+  musycl::dco::param_t dco5 { ui, "Plain DCO", 4 };
+  channel_assignment.assign(4, dco5);
+
+  // Triangle wave with fast decay
+  musycl::dco_envelope::param_t triangle6_fast_decay { ui,
+                                                       "Triangle fast decay",
+                                                       5 };
+  channel_assignment.assign(5, triangle6_fast_decay);
+  triangle6_fast_decay->dco_param->square_volume = 0;
+  triangle6_fast_decay->dco_param->triangle_volume = 1;
+  triangle6_fast_decay->env_param->decay_time = .1;
+  triangle6_fast_decay->env_param->sustain_level = .1;
+
+  // Control the DCO 1 & 3 parameters
+  controller.attack_ch_1.connect(dcoe1->dco_param->square_volume);
+  controller.attack_ch_1.connect(dco3->square_volume);
+  controller.decay_ch_2.connect(dcoe1->dco_param->triangle_volume);
+  controller.decay_ch_2.connect(dco3->triangle_volume);
+  controller.sustain_ch_3.connect(dcoe1->dco_param->triangle_ratio);
+  controller.sustain_ch_3.connect(dco3->triangle_ratio);
+  controller.release_ch_4.connect(dcoe1->dco_param->triangle_fall_ratio);
+  controller.release_ch_4.connect(dco3->triangle_fall_ratio);
+
+  // Control the envelope of CH1 with Attack/CH5 to Release/CH8
+  controller.attack_ch_5.connect(dcoe1->env_param->attack_time);
+  controller.decay_ch_6.connect(dcoe1->env_param->decay_time);
+  controller.sustain_ch_7.connect(dcoe1->env_param->sustain_level);
+  controller.release_ch_8.connect(dcoe1->env_param->release_time);
+
+  // Connect the sustain pedal to its MIDI event
+  musycl::sustain sustain;
+  musycl::midi_in::cc_action<64>(
+      [&](std::int8_t v) { sustain.value(v); });
+
+  controller.param_1_pan_5.name("Low pass filter").add_action([&](float a) {
+    /* Use a frequency logarithmic scale between 1 Hz and half the
+       sampling frequency */
+    auto cut_off_freq =
+        std::exp((a * std::log(0.5 * musycl::sample_frequency)));
+    set_low_pass_filter_freq(cut_off_freq);
+    controller.display("Low pass filter: " + std::to_string(cut_off_freq) +
+                       " Hz");
+  });
+
+  // Assign on unused MIDI channel 17
+  musycl::dco::param_t random_note_dco_p { ui, "Random note DCO", 17 };
+  auto random_note = std::make_shared<musycl::sound_generator>(musycl::dco {
+    random_note_dco_p });
+  sounds.insert(random_note);
+  auto& random_note_dco = std::get<musycl::dco>(random_note->sg);
+  // Use the lowest note as a base, volume to 0
+  random_note_dco.start({ 17, 0, 20 }).volume = 0;
+  trisycl::vendor::trisycl::random::xorshift<> random_note_rng;
+  musycl::automate random_note_generator { [&](auto& self) mutable {
+    for (;;) {
+      // Wait for 6 MIDI ticks
+      self.pause(6);
+      // Use the tuning parameter to change the note frequency
+      random_note_dco.tune =
+          500. * random_note_rng() /
+          std::numeric_limits<decltype(random_note_rng)::value_type>::max();
+    }
+  } };
+  controller.pad_4.name("Random notes").add_action([&](bool v) {
+    // Just control the output volume for now
+    random_note_dco.volume = v;
+    controller.display("Random notes: " + std::to_string(v));
+  });
+
+  // The voice mix with its parameters handed over to the master bus
+  const master_bus_frame* current = nullptr;
+  /* The parameters applied to the master bus filters, changed only
+     on the master bus thread */
+  master_bus_parameters applied;
+  // The flanger can be bypassed by the watchdog on overload
+  std::atomic<bool> bypass_flanger = false;
+  // The computation time of the last frame of the master bus, in second
+  std::atomic<double> master_bus_time = 0;
+  /* The audio processing graph of the master bus. Independent
+     branches would run in parallel if some worker threads were
+     requested */
+  musycl::graph patch;
+  auto output = patch.add_effect("Limiter", limiter);
+  patch
+      .chain(
+          { // The voices mixed by the front-end pipeline stage
+            patch.add_generator("Voices",
+                                [&](auto& audio) { audio = current->voices; }),
+            // Insert a rectifier in the output, oversampled since it is
+            // strongly nonlinear
+            patch.add_processor("Rectifier",
+                                [&](auto& audio) {
+                                  rectifier_oversampler.set_factor(
+                                      low_oversampling ? 1 : 4);
+                                  rectifier_oversampler.process(
+                                      audio, [&](musycl::audio::sample<>& a) {
+                                        auto r = current->parameters
+                                                     .rectification_ratio;
+                                        a = a * (1 - r) + r * a.fabs();
+                                      });
+                                },
+                                [&] {
+                                  return rectifier_oversampler.tail_frames();
+                                }),
+            patch.add_processor(
+                "Low pass filter",
+                [&](auto& audio) {
+                  for (auto& a : audio)
+                    /// Dive into each (stereo) channel of the sample...
+                    for (auto&& [s, f] :
+                         ranges::views::zip(a, low_pass_filter))
+                      // Insert a low pass filter in the output with
+                      // amplitude controlled by an LFO
+                      s = f.filter(s * current->parameters.lfo);
+                },
+                [&] {
+                  auto tail = 0;
+                  for (auto& f : low_pass_filter)
+                    tail = std::max(tail, musycl::tail_frames(f));
+                  return tail;
+                }),
+            /* Control the level of the mix to avoid saturation, instead
+               of a normalization by the number of voices making the
+               level jump when a voice starts or stops */
+            patch.add_effect("Compressor", compressor),
+            // Insert a resonance filter in the output after the
+            // compression to avoid too much saturation
+            patch.add_processor(
+                "Resonance filter",
+                [&](auto& audio) {
+                  if (auto factor = low_oversampling ? 1 : 2;
+                      factor != resonance_oversampler.factor()) {
+                    resonance_oversampler.set_factor(factor);
+                    for (auto& f : resonance_filter)
+                      f.set_oversampling(factor);
+                  }
+                  resonance_oversampler.process(
+                      audio, [&](musycl::audio::sample<>& a) {
+                        for (auto&& [s, f] :
+                             ranges::views::zip(a, resonance_filter))
+                          s = f.filter(s);
+                      });
+                },
+                [&] {
+                  auto tail = 0;
+                  for (auto& f : resonance_filter)
+                    tail = std::max(tail, musycl::tail_frames(f));
+                  return tail == musycl::infinite_tail
+                             ? tail
+                             : tail + resonance_oversampler.tail_frames();
+                }),
+            // Put the master volume control at the end to take over
+            // filter loud oscillation
+            patch.add_processor("Master volume",
+                                [&](auto& audio) {
+                                  for (auto& a : audio)
+                                    a *= current->parameters.master_volume;
+                                },
+                                [] { return 0; }),
+            // Some flanger effect
+            patch.add_processor("Flanger",
+                                [&](auto& audio) {
+                                  if (!bypass_flanger)
+                                    flanger.process(
+                                        musycl::audio::buffer { &audio, 1 });
+                                },
+                                [&] { return flanger.tail_frames(); }),
+            // Keep the output below the clipping level
+            output })
+      .set_output(output);
+  patch.display();
+
+  /* Run the master bus and the audio output on another thread while
+     the next frame of voices is rendered, adding some frames of
+     latency */
+  musycl::pipeline<master_bus_frame> master_pipeline {
+    pipeline_depth, [&](auto& frame) {
+      auto start = std::chrono::steady_clock::now();
+      current = &frame;
+      // Update the filters whose parameters changed since the last frame
+      auto& p = frame.parameters;
+      if (p.low_pass_frequency != applied.low_pass_frequency)
+        for (auto& f : low_pass_filter)
+          f.set_cutoff_frequency(p.low_pass_frequency);
+      if (p.resonance_frequency != applied.resonance_frequency)
+        for (auto& f : resonance_filter)
+          f.set_frequency(p.resonance_frequency);
+      if (p.resonance != applied.resonance)
+        for (auto& f : resonance_filter)
+          f.set_resonance(p.resonance);
+      applied = p;
+      musycl::audio::frame audio;
+      {
+        MUSYCL_TRACE_SCOPE("synth::master_chain");
+        MUSYCL_RT_SAFETY_SCOPE();
+        patch.process(audio);
+      }
+      master_bus_time = std::chrono::duration<double> {
+        std::chrono::steady_clock::now() - start
+      }.count();
+      // Then send the computed audio frame to the output
+      backend.write(audio);
+    }
+  };
+
+  // The arrival time of the current MIDI message
+  musycl::midi_in::clock_type::time_point midi_time;
+
+  /* Render the sounds up to the sample where a MIDI message applies,
+     splitting the frame so the MIDI timing is not quantized to the
+     frame size */
+  auto render_until = [&](auto time) {
+    auto offset = musycl::midi_in::frame_offset(time);
+    for (auto& s : sounds)
+      s->render_until(offset);
+  };
+
+  // The MIDI sequence to play, if any
+  const musycl::midi::sequence no_sequence;
+  musycl::midi::player player { opts.play ? *opts.play : no_sequence };
+  player.set_follow_clock(opts.follow_clock).set_loop(opts.loop);
+  // Number of frames to render after the end of the MIDI sequence
+  const auto frames_after_end = static_cast<int>(
+      std::ceil(opts.stop_after_end / musycl::frame_period));
+  // Number of frames to render at most
+  const auto max_frames = static_cast<std::int64_t>(
+      std::ceil(opts.duration / musycl::frame_period));
+
+  /* Record what is played on MIDI port 0, starting on the first
+     frame. The recording can allocate memory, so the messages are
+     handed over from the audio thread to a recording thread */
+  std::optional<musycl::midi::recorder> recorder;
+  musycl::spsc_queue<musycl::midi_in::timed_msg> to_record { 4096 };
+  // Number of messages lost because the recording thread was late
+  std::size_t unrecorded = 0;
+  std::thread recording;
+  if (!opts.record_file_name.empty()) {
+    recorder.emplace();
+    recording = std::thread { [&] {
+      while (auto m = to_record.pop())
+        recorder->record(m->msg, m->time);
+    } };
+    musycl::midi_in::set_monitor([&](auto port, auto& m) {
+      if (port == 0 && !to_record.try_push(auto { m }))
+        ++unrecorded;
+    });
+  }
+  std::signal(SIGINT, [](int) { interrupted = true; });
+
+  // Ramp the load to measure the polyphony, if requested
+  std::optional<stress_test> stress;
+  if (opts.stress)
+    stress.emplace(*opts.stress);
+
+  if constexpr (musycl::trace::enabled)
+    musycl::trace::set_thread_name("synth front-end");
+
+  // The maximum polyphony, lowered by the watchdog on overload
+  auto max_voices = std::numeric_limits<std::size_t>::max();
+  // Whether the released voices are stopped once they are quiet
+  bool steal_quiet_voices = false;
+  // A released voice is quiet below -40 dB
+  constexpr auto quiet_level = 0.01;
+  /* Stop the voice which is the least missed, the quietest of the
+     released ones or else the quietest one, sparing the random notes */
+  auto steal_voice = [&] {
+    auto victim = std::ranges::min_element(sounds, {}, [&](auto& s) {
+      return std::pair { s == random_note || !s->is_released(), s->level() };
+    });
+    if (victim != sounds.end() && *victim != random_note)
+      sounds.erase(victim);
+  };
+  // Degrade the quality gracefully on overload, the less audible first
+  musycl::watchdog watchdog;
+  watchdog
+      .add_step("stop the quiet released voices",
+                [&](bool on) { steal_quiet_voices = on; })
+      .add_step("oversample less", [&](bool on) { low_oversampling = on; })
+      .add_step("bypass the flanger", [&](bool on) { bypass_flanger = on; })
+      .add_step("bypass the reverberation",
+                [&](bool on) { bypass_reverb = on; })
+      .add_step("cap the polyphony to " + std::to_string(opts.watchdog_voices) +
+                    " voices",
+                [&](bool on) {
+                  max_voices = on ? opts.watchdog_voices
+                                  : std::numeric_limits<std::size_t>::max();
+                  /* Keep the random notes on top of the voices, which
+                     are always in the sounds so the size is never 0 */
+                  if (on)
+                    while (sounds.size() - 1 > max_voices)
+                      steal_voice();
+                });
+  // Process the MIDI messages on port 0 arrived before some time
+  auto process_midi_before = [&](auto limit) {
+    while (sustain.process(0, m, midi_time, limit)) {
+      MUSYCL_TRACE_SCOPE("synth::midi_message");
+      render_until(midi_time);
+      // \todo implement as range transformation
+      arp.midi(m);
+      arp_low_high.midi(m);
+      arp_bass_4.midi(m);
+      arp_jupiter_8.midi(m);
+
+      std::visit(
+          trisycl::detail::overloaded {
+              [&](musycl::midi::on& on) {
+                MUSYCL_LOG_DEBUG("MIDI on {}", (int)on.note);
+                if (auto sp = channel_assignment.channels.find(on.channel);
+                    sp != channel_assignment.channels.end()) {
+                  // Make some room when the polyphony is capped
+                  if (sounds.size() > max_voices)
+                    steal_voice();
+                  auto sound =
+                      std::make_shared<musycl::sound_generator>(sp->second);
+                  notes.insert_or_assign(on.base_header(), sound);
+                  sounds.insert(sound);
+                  // Start the sound at the sample where the message applies
+                  sound->skip_until(musycl::midi_in::frame_offset(midi_time))
+                      .start(on);
+                } else
+                  MUSYCL_LOG_WARNING("Note on to unassigned MIDI channel {}",
+                                     on.channel + 1);
+              },
+              [&](musycl::midi::off& off) {
+                MUSYCL_LOG_DEBUG("MIDI off {}", (int)off.note);
+                if (auto s = notes.find(off.base_header()); s != notes.end()) {
+                  if (auto sound = s->second.lock())
+                    sound->stop(off);
+                } else
+                  MUSYCL_LOG_WARNING("No note to stop here on MIDI channel {}",
+                                     off.channel + 1);
+              },
+              [&](musycl::midi::control_change& cc) {
+                MUSYCL_LOG_DEBUG("MIDI cc {}", (int)cc.number);
+                // Attack/CH1 on Arturia Keylab 49 Essential
+                if (cc.number == 73) {
+                }
+              },
+              [&](musycl::midi::sysex& s) {
+                // \todo find a better way
+                if (std::ranges::equal(
+                        s.value(),
+                        std::array<std::uint8_t, 10> { 0x00, 0x20, 0x6b, 0x7f,
+                                                       0x42, 0x02, 0x00, 0x00,
+                                                       0x18, 0x7f })) {
+                  // backward button on Arturia Keylab 49 Essential
+                  channel_assignment.select_previous_channel();
+                  auto sound_param =
+                      channel_assignment.channels
+                          [channel_assignment.current_selected_channel];
+                  controller.display(
+                      "Channel:" +
+                      std::to_string(
+                          channel_assignment.current_selected_channel) +
+                      " " + sound_param.name());
+                  ui.prioritize_layer(sound_param.get_group());
+                } else if (std::ranges::equal(
+                               s.value(),
+                               std::array<std::uint8_t, 10> {
+                                   0x00, 0x20, 0x6b, 0x7f, 0x42, 0x02, 0x00,
+                                   0x00, 0x19, 0x7f })) {
+                  // forward button on Arturia Keylab 49 Essential
+                  channel_assignment.select_next_channel();
+                  auto sound_param =
+                      channel_assignment.channels
+                          [channel_assignment.current_selected_channel];
+                  controller.display(
+                      "Channel:" +
+                      std::to_string(
+                          channel_assignment.current_selected_channel) +
+                      " " + sound_param.name());
+                  ui.prioritize_layer(sound_param.get_group());
+                }
+              },
+              [&](auto&& other) {
+                MUSYCL_LOG_DEBUG("other MIDI message of kind {}", m.index());
+              } },
+          m);
+    }
+  };
+  /* Reach the time of a registered action, applying the previous
+     messages of port 0 at their own sample */
+  auto apply_midi_until = [&](auto time) {
+    process_midi_before(time);
+    render_until(time);
+  };
+  // Number of frames between 2 displays of the timer statistics
+  const auto trace_statistics_frames = static_cast<std::int64_t>(
+      std::ceil(opts.trace_statistics_period / musycl::frame_period));
+
+  // The time loop, up to Ctrl-C or the end of the MIDI sequence
+  for (std::int64_t frames = 0, frames_after = 0; !interrupted; ++frames) {
+    if (opts.play && !opts.loop && opts.stop_after_end >= 0 &&
+        player.finished() && frames_after++ >= frames_after_end)
+      break;
+    if (opts.duration >= 0 && frames >= max_frames)
+      break;
+    if (stress && stress->finished())
+      break;
+    if (trace_statistics_frames > 0 && frames > 0 &&
+        frames % trace_statistics_frames == 0) {
+      std::cerr << "Timer statistics of the last "
+                << opts.trace_statistics_period << " s of audio:\n";
+      musycl::trace::display_statistics(std::cerr,
+                                        musycl::trace::stage_statistics());
+    }
+    // Map the MIDI messages received during the last frame period into this frame
+    musycl::midi_in::start_frame(backend.frame_time());
+    // Start the recording at the first sample of the first frame
+    if (recorder && frames == 0)
+      recorder->start(musycl::midi_in::frame_time(0));
+    /* The computation time of the frame starts once the backend is
+       ready for it */
+    auto frame_computation_start = std::chrono::steady_clock::now();
+    MUSYCL_TRACE_SCOPE("synth::frame");
+    if (stress)
+      stress->start_frame(mixer);
+    // Check the computation of the frame does nothing blocking
+    MUSYCL_RT_SAFETY_SCOPE();
+    // Inject the MIDI file events at their sample in this frame
+    if (opts.play)
+      player.play_frame([](int offset, const auto& m) {
+        musycl::midi_in::inject(0, m, musycl::midi_in::frame_time(offset));
+      });
+    /* Dispatch here all the potential incoming MIDI registered
+       actions, so they will not cause race condition, interleaved in
+       time order with the messages of port 0 */
+    musycl::midi_in::dispatch_registered_actions(apply_midi_until);
+    // Process the remaining MIDI messages on port 0
+    process_midi_before(musycl::midi_in::clock_type::time_point::max());
+
+    // Propagate the clocks to the consumers
+    musycl::clock::tick_frame_clock();
+
+    // For each sound generator
+    for (auto it = sounds.begin(); it != sounds.end();) {
+      auto& o = **it;
+      // Accumulate its audio output into its mixer channel
+      {
+        MUSYCL_TRACE_SCOPE("voice::audio");
+        mixer.add(o.channel, o.audio());
+      }
+      if (o.is_running() && !(steal_quiet_voices && o.is_released() &&
+                              o.level() < quiet_level))
+        // Just look at the next sound
+        ++it;
+      else
+        // Remove the no longer running sound generator and skip over it
+        it = sounds.erase(it);
+    }
+    // Mix the channels with their effects and hand over to the master bus
+    musycl::audio::frame audio;
+    {
+      MUSYCL_TRACE_SCOPE("mixer::process");
+      mixer.process(audio);
+    }
+    /* The computation time of the frame, in parallel with the master
+       bus on the previous frame */
+    auto frame_time = std::chrono::duration<double> {
+      std::chrono::steady_clock::now() - frame_computation_start
+    }.count();
+    // Mark the frames computed too late for a real-time output
+    if (frame_time > musycl::frame_period)
+      MUSYCL_TRACE_MARK("synth::frame_overrun");
+    if (opts.watchdog)
+      watchdog.frame(std::max(frame_time, master_bus_time.load()));
+    // Hand over the master bus parameters of this frame with it
+    master_bus.lfo = lfo.out();
+    master_pipeline.push({ std::move(audio), master_bus });
+    if (stress) {
+      // The measurements are not part of the synthesizer
+      MUSYCL_RT_SAFETY_ALLOW();
+      stress->end_frame(sounds.size(),
+                        std::chrono::duration<double> {
+                            std::chrono::steady_clock::now() -
+                            frame_computation_start }
+                            .count());
+    }
+  }
+  // Let the master bus output the frames in flight
+  master_pipeline.finish();
+  if (stress)
+    stress->report();
+  if (opts.watchdog)
+    std::cerr << "Watchdog: " << watchdog.deadline_misses()
+              << " frames computed too late" << std::endl;
+  if constexpr (musycl::rt_safety::enabled)
+    std::cerr << "rt_safety: " << musycl::rt_safety::violation_count()
+              << " forbidden operations in the real-time code" << std::endl;
+  if (!opts.trace_file_name.empty()) {
+    musycl::trace::write_chrome_json(opts.trace_file_name);
+    std::cout << "Trace written into " << opts.trace_file_name << std::endl;
+  }
+  if (recorder) {
+    to_record.close();
+    recording.join();
+    if (unrecorded)
+      std::cerr << unrecorded << " MIDI messages not recorded" << std::endl;
+    recorder->save(opts.record_file_name);
+    std::cout << "MIDI recorded into " << opts.record_file_name << std::endl;
+  }
+  backend.close();
+  musycl::log::flush();
+  // The automation fibers run forever, so do not wait for them
+  std::quick_exit(EXIT_SUCCESS);
+}
+
+} // namespace synth
+
+#endif // MUSYCL_SYNTH_ENGINE_HPP